@@ -0,0 +1,186 @@
+module;
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif // __linux__
+
+export module emulator:arena;
+
+export namespace emulator
+{
+    /// Size of a cache line on the hosts we care about
+    inline constexpr std::size_t cache_line_size = 64;
+
+    /// Size of a (x86-64/aarch64) transparent huge page
+    inline constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    /// @brief A large, zero initialised block of memory that objects are
+    /// carved out of with a bump pointer.
+    ///
+    /// On Linux the block is mapped with `MAP_HUGETLB` when huge pages
+    /// are reserved. Otherwise it is mapped on a huge page boundary and
+    /// advised for transparent huge pages before its first touch, as the
+    /// kernel only backs aligned, not yet faulted ranges with them.
+    /// Either way it is populated up front, so the objects living in it
+    /// neither page fault nor thrash the TLB once handed out. Nothing is
+    /// freed until the whole arena is destroyed.
+    class HugePageArena
+    {
+    public:
+        /// @brief reserves at least `size` bytes, rounded up to a whole
+        /// number of huge pages.
+        explicit HugePageArena(std::size_t size)
+            : _size{((size + huge_page_size - 1) / huge_page_size) * huge_page_size}
+        {
+            if (_size == 0)
+            {
+                throw std::invalid_argument("arena size cannot be zero");
+            }
+
+#if defined(__linux__)
+            constexpr int prot  = PROT_READ | PROT_WRITE;
+            constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+            void* data  = mmap(nullptr, _size, prot, flags | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+            _huge_pages = data != MAP_FAILED;
+            _data       = _huge_pages ? static_cast<std::byte*>(data) : map_transparent(_size);
+#else
+            _data = new (std::align_val_t{huge_page_size}) std::byte[_size]();
+#endif // __linux__
+        }
+
+        HugePageArena(HugePageArena const&)            = delete;
+        HugePageArena& operator=(HugePageArena const&) = delete;
+
+        HugePageArena(HugePageArena&& other) noexcept
+            : _data{std::exchange(other._data, nullptr)}, _size{std::exchange(other._size, 0)},
+              _used{std::exchange(other._used, 0)}, _huge_pages{other._huge_pages}
+        {
+        }
+
+        HugePageArena& operator=(HugePageArena&& other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                _data       = std::exchange(other._data, nullptr);
+                _size       = std::exchange(other._size, 0);
+                _used       = std::exchange(other._used, 0);
+                _huge_pages = other._huge_pages;
+            }
+            return *this;
+        }
+
+        ~HugePageArena()
+        {
+            release();
+        }
+
+        /// @brief carves `size` bytes aligned to `alignment` out of the
+        /// arena. The bytes are zero the first time they are handed out.
+        /// @return the allocated bytes, or nullptr if the arena is full.
+        [[nodiscard]] void* allocate(std::size_t size, std::size_t alignment = cache_line_size)
+        {
+            auto const begin = (_used + alignment - 1) & ~(alignment - 1);
+            if (begin + size > _size)
+            {
+                return nullptr;
+            }
+
+            _used = begin + size;
+            return _data + begin;
+        }
+
+        [[nodiscard]] std::size_t capacity() const
+        {
+            return _size;
+        }
+
+        [[nodiscard]] std::size_t used() const
+        {
+            return _used;
+        }
+
+        /// @brief whether the arena is backed by reserved huge pages, as
+        /// opposed to transparent huge pages or regular pages
+        [[nodiscard]] bool huge_pages() const
+        {
+            return _huge_pages;
+        }
+
+    private:
+#if defined(__linux__)
+        /// @brief maps `size` bytes on a huge page boundary for transparent
+        /// huge pages, and faults them all in
+        static std::byte* map_transparent(std::size_t size)
+        {
+            // Over-reserve by a huge page so an aligned range fits, then trim
+            // the slack either side of it
+            auto const reserved = size + huge_page_size;
+            void* const data    = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED)
+            {
+                throw std::bad_alloc{};
+            }
+
+            auto const start   = reinterpret_cast<std::uintptr_t>(data);
+            auto const aligned = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+            auto const head    = aligned - start;
+            auto const tail    = reserved - head - size;
+            if (head > 0)
+            {
+                munmap(data, head);
+            }
+            if (tail > 0)
+            {
+                munmap(reinterpret_cast<void*>(aligned + size), tail);
+            }
+
+            // Advise first, the faults below then take whole huge pages
+            auto* const bytes = reinterpret_cast<std::byte*>(aligned);
+            madvise(bytes, size, MADV_HUGEPAGE);
+
+#if defined(MADV_POPULATE_WRITE)
+            if (madvise(bytes, size, MADV_POPULATE_WRITE) == 0)
+            {
+                return bytes;
+            }
+#endif // MADV_POPULATE_WRITE
+
+            // Kernels before 5.14: touch every page, writing the zero it holds
+            for (std::size_t offset = 0; offset < size; offset += 4096)
+            {
+                static_cast<std::byte volatile*>(bytes)[offset] = std::byte{0};
+            }
+            return bytes;
+        }
+#endif // __linux__
+
+        void release()
+        {
+            if (_data == nullptr)
+            {
+                return;
+            }
+
+#if defined(__linux__)
+            munmap(_data, _size);
+#else
+            ::operator delete[](_data, std::align_val_t{huge_page_size});
+#endif // __linux__
+            _data = nullptr;
+        }
+
+        std::byte* _data{nullptr};
+        std::size_t _size{0};
+        std::size_t _used{0};
+        bool _huge_pages{false};
+    };
+} // namespace emulator
@@ -6,17 +6,23 @@ module;
 #include <array>
 #include <bitset>
 #include <chrono>
+#include <coroutine>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <new>
 #include <optional>
 #include <span>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #ifndef CLOCK_SPEED_MHZ
 #define CLOCK_SPEED_MHZ 1.79
@@ -25,36 +31,13 @@ module;
 
 export module emulator;
 
-#ifdef BUILD_PROFILER
-import profiler;
-#endif // BUILD_PROFILER
-
-// Define a macro for the profiler
-#ifdef BUILD_PROFILER
-struct ProfileBook
-{
-    std::unordered_map<std::string, double> functions;
-
-    bool update(std::string const& func_name, double profile)
-    {
-        auto found = functions.find(func_name);
-        if (found != end(functions))
-        {
-            // update it
-            found->second += profile;
-            return true;
-        }
-
-        functions[func_name] = profile;
-        return true;
-    }
-};
-
-#define ENABLE_PROFILER(cpu) \
-    volatile auto profile_result_666 = profiler::FunctionProfiler<ProfileBook, std::string, double>(cpu.profiler_book)
-#else
-#define ENABLE_PROFILER(cpu)
-#endif // BUILD_PROFILER
+export import :arena;
+export import :generator;
+export import :memory;
+export import :observer;
+export import :opcodes;
+export import :sampler;
+export import :trace;
 
 export namespace emulator
 {
@@ -98,6 +81,65 @@ export namespace emulator
                && lhs.c == rhs.c;
     }
 
+    /// @brief How closely throttled runs kept to the cpu's clock speed,
+    /// added up over every instruction they ran. Unthrottled runs (a
+    /// clock speed of zero) are not paced, and not counted here.
+    struct PacingStats
+    {
+        /// cycles the instructions reported
+        std::uint64_t cycles{0};
+
+        /// host time from the start of each instruction to the end of its
+        /// sleep, and the time it takes at the clock speed
+        std::chrono::nanoseconds host_time{0};
+        std::chrono::nanoseconds emulated_time{0};
+
+        /// sleeps asked for, i.e. the emulated time minus the time the
+        /// instruction took to run, and how long they really took
+        std::chrono::nanoseconds requested_sleep{0};
+        std::chrono::nanoseconds actual_sleep{0};
+
+        /// time instructions finished after their emulated time was up,
+        /// and before. Their difference is the drift.
+        std::chrono::nanoseconds overshoot{0};
+        std::chrono::nanoseconds undershoot{0};
+
+        void record(std::uint64_t instruction_cycles,
+                    std::chrono::nanoseconds emulated,
+                    std::chrono::nanoseconds requested,
+                    std::chrono::nanoseconds slept,
+                    std::chrono::nanoseconds host)
+        {
+            cycles += instruction_cycles;
+            host_time += host;
+            emulated_time += emulated;
+            requested_sleep += requested;
+            actual_sleep += slept;
+            if (host > emulated)
+            {
+                overshoot += host - emulated;
+            }
+            else
+            {
+                undershoot += emulated - host;
+            }
+        }
+
+        /// @brief how far the host is behind the emulated clock, ahead
+        /// of it if negative
+        [[nodiscard]] std::chrono::nanoseconds drift() const
+        {
+            return host_time - emulated_time;
+        }
+
+        /// @brief the clock speed the runs actually ran at, in MHz
+        [[nodiscard]] double effective_mhz() const
+        {
+            return host_time.count() > 0 ? static_cast<double>(cycles) * 1'000 / static_cast<double>(host_time.count())
+                                         : 0.0;
+        }
+    };
+
     struct Cpu
     {
         // registers (A, X, Y, SP, PC) - u8
@@ -108,11 +150,15 @@ export namespace emulator
         Flags flags{};
 
         // memory (Zero page/first FF bytes, main memory, vram)
-        std::array<std::uint8_t, 0xFFFF> mem{};
+        Memory mem{};
 
-        // Clock speed for this particular CPU
+        // Clock speed for this particular CPU, in MHz. A clock speed
+        // of zero runs the program as fast as the host can
         double clock_speed = CLOCK_SPEED_MHZ;
 
+        /// how throttled runs kept to `clock_speed`, see `PacingStats`
+        PacingStats pacing{};
+
         auto sr() const -> std::uint8_t
         {
             // clang-format off
@@ -129,24 +175,135 @@ export namespace emulator
             return sp_val;
         }
 
-#ifdef BUILD_PROFILER
-        // If profiling is enabled, create space for a bookeper
-        std::shared_ptr<ProfileBook> profiler_book{std::make_shared<ProfileBook>()};
+        /// @brief brings the registers and flags back to their power-on
+        /// state, clears the pacing stats and restores only the memory
+        /// pages written since the last reset (see `Memory::reset`).
+        void reset()
+        {
+            reg    = Registers{};
+            flags  = Flags{};
+            pacing = PacingStats{};
+            mem.reset();
+        }
+
+        /// @brief same as `reset()`, but memory is restored to `base`
+        /// instead of its initial contents. The first reset to a given
+        /// `base` rewrites every page that differs from it, later ones
+        /// only the pages written since.
+        void reset(Image const& base)
+        {
+            reg    = Registers{};
+            flags  = Flags{};
+            pacing = PacingStats{};
+            mem.reset(base);
+        }
+    };
+
+    /// @brief Hands out cpus whose registers and memory are carved out of
+    /// huge page backed arenas, rather than a heap allocation per cpu.
+    ///
+    /// A released cpu goes back on a free list and is brought back to its
+    /// power-on state the next time it is acquired, so cycling through a
+    /// large number of short runs never goes back to the allocator. The
+    /// pool is not thread safe (use one per thread) and must outlive the
+    /// handles it gives out.
+    class CpuPool
+    {
+        using Ram = std::array<Page, page_count>;
+
+    public:
+        /// @brief returns the cpu to the pool when its handle goes away
+        struct Releaser
+        {
+            CpuPool* pool;
+
+            void operator()(Cpu* cpu) const
+            {
+                pool->_free.push_back(cpu);
+            }
+        };
+
+        using Handle = std::unique_ptr<Cpu, Releaser>;
+
+        explicit CpuPool(std::size_t cpus_per_arena = 32) : _cpus_per_arena{cpus_per_arena}
+        {
+            if (_cpus_per_arena == 0)
+            {
+                throw std::invalid_argument("cpu pool arenas cannot be empty");
+            }
+        }
+
+        CpuPool(CpuPool const&)            = delete;
+        CpuPool& operator=(CpuPool const&) = delete;
+
+        ~CpuPool()
+        {
+            for (auto* cpu : _cpus)
+            {
+                std::destroy_at(cpu);
+            }
+        }
 
-        std::unordered_map<std::string, double> current_profile()
+        /// @brief hands out a cpu that looks freshly constructed: zeroed
+        /// registers, flags and memory, no mapper and the default clock
+        /// speed. Reusing a cpu only clears the pages its previous user
+        /// wrote to, or every page if it was last reset to an `Image`.
+        [[nodiscard]] Handle acquire()
         {
-            if (!profiler_book)
+            if (_free.empty())
             {
-                return {};
+                grow();
             }
-            return profiler_book->functions;
+
+            auto* const cpu = _free.back();
+            _free.pop_back();
+            cpu->mem.unmap_all();
+            cpu->reset();
+            cpu->clock_speed = CLOCK_SPEED_MHZ;
+            return Handle{cpu, Releaser{.pool = this}};
+        }
+
+        /// @brief number of cpus the pool has room for without growing
+        [[nodiscard]] std::size_t capacity() const
+        {
+            return _cpus.size();
+        }
+
+        /// @brief number of cpus currently sitting on the free list
+        [[nodiscard]] std::size_t available() const
+        {
+            return _free.size();
         }
-#else
-        std::unordered_map<std::string, double> current_profile()
+
+    private:
+        /// @brief maps a new arena and fills it with cpus. Each cpu's RAM
+        /// is aligned to a host page and the cpu itself to a cache line.
+        void grow()
         {
-            return {};
+            constexpr std::size_t host_page_size = 4096;
+            constexpr std::size_t slot_size      = sizeof(Ram) + sizeof(Cpu) + host_page_size + cache_line_size;
+
+            auto& arena = _arenas.emplace_back(_cpus_per_arena * slot_size);
+            while (true)
+            {
+                auto* const ram    = static_cast<Page*>(arena.allocate(sizeof(Ram), host_page_size));
+                auto* const memory = ram ? arena.allocate(sizeof(Cpu), cache_line_size) : nullptr;
+                if (memory == nullptr)
+                {
+                    break;
+                }
+
+                // Arena memory starts zeroed, so the cpu starts powered on
+                auto* const cpu = new (memory) Cpu{.mem = Memory{std::span<Page, page_count>{ram, page_count}}};
+                _cpus.push_back(cpu);
+                _free.push_back(cpu);
+            }
         }
-#endif // BUILD_PROFILER
+
+        std::size_t _cpus_per_arena;
+        std::vector<HugePageArena> _arenas;
+        std::vector<Cpu*> _cpus;
+        std::vector<Cpu*> _free;
     };
 } // namespace emulator
 
@@ -250,7 +407,6 @@ void bit_operation(emulator::Cpu& cpu, std::uint8_t value)
 
 std::optional<InstructionConfig> bit_zp(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -263,7 +419,6 @@ std::optional<InstructionConfig> bit_zp(emulator::Cpu& cpu, std::span<const std:
 
 std::optional<InstructionConfig> bit_abs(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -382,14 +537,12 @@ std::optional<InstructionConfig> pull_stack_to_status_reg(emulator::Cpu& cpu, st
 
 std::optional<InstructionConfig> ror_accumulator(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     cpu.reg.a = rotate_right_operation(cpu, cpu.reg.a);
     return std::make_optional<InstructionConfig>(1);
 }
 
 std::optional<InstructionConfig> ror_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -402,7 +555,6 @@ std::optional<InstructionConfig> ror_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> ror_zeropage_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -418,7 +570,6 @@ std::optional<InstructionConfig> ror_zeropage_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> ror_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -434,7 +585,6 @@ std::optional<InstructionConfig> ror_absolute(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> ror_absolute_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -451,14 +601,12 @@ std::optional<InstructionConfig> ror_absolute_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> rol_accumulator(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     cpu.reg.a = rotate_left_operation(cpu, cpu.reg.a);
     return std::make_optional<InstructionConfig>(1);
 }
 
 std::optional<InstructionConfig> rol_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -471,7 +619,6 @@ std::optional<InstructionConfig> rol_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> rol_zeropage_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -487,7 +634,6 @@ std::optional<InstructionConfig> rol_zeropage_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> rol_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -503,7 +649,6 @@ std::optional<InstructionConfig> rol_absolute(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> rol_absolute_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -520,14 +665,12 @@ std::optional<InstructionConfig> rol_absolute_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> lsr_accumulator(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     cpu.reg.a = shift_right_operation(cpu, cpu.reg.a);
     return std::make_optional<InstructionConfig>(1);
 }
 
 std::optional<InstructionConfig> lsr_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -540,7 +683,6 @@ std::optional<InstructionConfig> lsr_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> lsr_zeropage_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -556,7 +698,6 @@ std::optional<InstructionConfig> lsr_zeropage_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> lsr_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -572,7 +713,6 @@ std::optional<InstructionConfig> lsr_absolute(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> lsr_absolute_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -589,14 +729,12 @@ std::optional<InstructionConfig> lsr_absolute_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> asl_accumulator(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     cpu.reg.a = shift_left_operation(cpu, cpu.reg.a);
     return std::make_optional<InstructionConfig>(1);
 }
 
 std::optional<InstructionConfig> asl_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -609,7 +747,6 @@ std::optional<InstructionConfig> asl_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> asl_zeropage_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -625,7 +762,6 @@ std::optional<InstructionConfig> asl_zeropage_indexed(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> asl_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -641,7 +777,6 @@ std::optional<InstructionConfig> asl_absolute(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> asl_absolute_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -662,7 +797,6 @@ Instruction set_flag(bool emulator::Flags::* f)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         (cpu.flags).*f = true;
         return std::make_optional<InstructionConfig>(1);
     };
@@ -674,7 +808,6 @@ Instruction clear_flag(bool emulator::Flags::* f)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         (cpu.flags).*f = false;
         return std::make_optional<InstructionConfig>(1);
     };
@@ -685,7 +818,6 @@ Instruction ld_immediate(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -704,7 +836,6 @@ Instruction ld_zeropage(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -733,7 +864,6 @@ Instruction ld_zeropage_indexed(std::uint8_t emulator::Registers::* to, std::uin
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
 
         if ((cpu.reg.pc + 1) >= program.size())
         {
@@ -755,7 +885,6 @@ Instruction ld_absolute(std::uint8_t emulator::Registers::* to)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -778,7 +907,6 @@ Instruction ld_absolute_plus_reg(std::uint8_t emulator::Registers::* to, std::ui
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -801,7 +929,6 @@ Instruction ld_index_indirect(std::uint8_t emulator::Registers::* to, std::uint8
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -827,7 +954,6 @@ Instruction ld_indirect_index(std::uint8_t emulator::Registers::* to)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -845,7 +971,6 @@ Instruction ld_indirect_index(std::uint8_t emulator::Registers::* to)
 
 std::optional<InstructionConfig> inc_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -861,7 +986,6 @@ std::optional<InstructionConfig> inc_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> inc_zeropage_plus_x(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -878,7 +1002,6 @@ std::optional<InstructionConfig> inc_zeropage_plus_x(emulator::Cpu& cpu, std::sp
 
 std::optional<InstructionConfig> inc_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -896,7 +1019,6 @@ std::optional<InstructionConfig> inc_absolute(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> inc_absolute_plus_x(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
 
     if ((cpu.reg.pc + 2) >= program.size())
     {
@@ -923,7 +1045,6 @@ void decrement_operation(emulator::Cpu& cpu, std::uint16_t pos)
 
 std::optional<InstructionConfig> dec_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -936,7 +1057,6 @@ std::optional<InstructionConfig> dec_zeropage(emulator::Cpu& cpu, std::span<cons
 
 std::optional<InstructionConfig> dec_zp_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -949,7 +1069,6 @@ std::optional<InstructionConfig> dec_zp_indexed(emulator::Cpu& cpu, std::span<co
 
 std::optional<InstructionConfig> dec_abs(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -964,7 +1083,6 @@ std::optional<InstructionConfig> dec_abs(emulator::Cpu& cpu, std::span<const std
 
 std::optional<InstructionConfig> dec_abs_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -981,7 +1099,6 @@ Instruction inc_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> /* program */)
     {
-        ENABLE_PROFILER(cpu);
         ((cpu.reg).*reg)++;
         cpu.flags.n = (cpu.reg).*reg & 0b1000'0000;
         cpu.flags.z = (cpu.reg).*reg == 0;
@@ -993,7 +1110,6 @@ Instruction dec_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> /* program */)
     {
-        ENABLE_PROFILER(cpu);
         ((cpu.reg).*reg)--;
         cpu.flags.n = (cpu.reg).*reg & 0b1000'0000;
         cpu.flags.z = (cpu.reg).*reg == 0;
@@ -1005,7 +1121,6 @@ Instruction transfer_regs(std::uint8_t emulator::Registers::* from, std::uint8_t
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> /* program */)
     {
-        ENABLE_PROFILER(cpu);
         (cpu.reg).*to = (cpu.reg).*from;
         cpu.flags.z   = (cpu.reg).*to == 0;
         cpu.flags.n   = (cpu.reg).*to & 0b1000'0000;
@@ -1017,7 +1132,6 @@ Instruction transfer_regs(std::uint8_t emulator::Registers::* from, std::uint8_t
 // does not set any flags.
 std::optional<InstructionConfig> txa(emulator::Cpu& cpu, std::span<const std::uint8_t> /* program */)
 {
-    ENABLE_PROFILER(cpu);
     cpu.reg.sp = cpu.reg.x;
     return std::make_optional<InstructionConfig>(1);
 }
@@ -1026,7 +1140,6 @@ Instruction st_indirect(std::uint8_t emulator::Registers::* from, std::uint8_t e
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -1050,7 +1163,6 @@ Instruction st_zeropage(std::uint8_t emulator::Registers::* from)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         // LOAD Value into accumulator
         if ((cpu.reg.pc + 1) >= program.size())
         {
@@ -1073,7 +1185,6 @@ Instruction st_zeropage_indexed(std::uint8_t emulator::Registers::* from, std::u
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         // LOAD Value into accumulator
         if ((cpu.reg.pc + 1) >= program.size())
         {
@@ -1091,7 +1202,6 @@ Instruction sta_absolute_indexed(std::uint8_t emulator::Registers::* index)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         // LOAD Value into accumulator
         if ((cpu.reg.pc + 2) >= program.size())
         {
@@ -1110,7 +1220,6 @@ Instruction st_absolute(std::uint8_t emulator::Registers::* from)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1127,7 +1236,6 @@ Instruction st_absolute(std::uint8_t emulator::Registers::* from)
 
 std::optional<InstructionConfig> sta_index_indirect(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1153,7 +1261,6 @@ Instruction cmp_immediate_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -1168,7 +1275,6 @@ Instruction cmp_zeropage_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
 
         if ((cpu.reg.pc + 1) >= program.size())
         {
@@ -1183,7 +1289,6 @@ Instruction cmp_zeropage_reg(std::uint8_t emulator::Registers::* reg)
 
 std::optional<InstructionConfig> cmp_zp_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1198,7 +1303,6 @@ Instruction cmp_absolute(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1218,7 +1322,6 @@ Instruction cmp_abs_indexed(std::uint8_t emulator::Registers::* index)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1235,7 +1338,6 @@ Instruction cmp_abs_indexed(std::uint8_t emulator::Registers::* index)
 
 std::optional<InstructionConfig> cmp_indexed_indirect(emulator::Cpu& cpu, std::span<std::uint8_t const> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1248,7 +1350,6 @@ std::optional<InstructionConfig> cmp_indexed_indirect(emulator::Cpu& cpu, std::s
 
 std::optional<InstructionConfig> cmp_indirect_indexed(emulator::Cpu& cpu, std::span<std::uint8_t const> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1264,7 +1365,6 @@ std::optional<InstructionConfig> cmp_indirect_indexed(emulator::Cpu& cpu, std::s
 /* Begin jump instructions */
 std::optional<InstructionConfig> jmp_abs(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -1279,7 +1379,6 @@ std::optional<InstructionConfig> jmp_abs(emulator::Cpu& cpu, std::span<const std
 
 std::optional<InstructionConfig> jmp_indirect(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -1297,7 +1396,6 @@ std::optional<InstructionConfig> jmp_indirect(emulator::Cpu& cpu, std::span<cons
 // Branching functions here
 std::optional<InstructionConfig> bne(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1321,7 +1419,6 @@ Instruction branch_flag_value(bool emulator::Flags::* flag)
     // TODO : Do we need a return here?
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 1) >= program.size())
         {
             return std::nullopt;
@@ -1363,7 +1460,6 @@ std::optional<std::size_t> eor_operation(emulator::Cpu& cpu, std::uint8_t value)
 // Logical operations
 std::optional<std::size_t> eor_acc_immediate(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1374,7 +1470,6 @@ std::optional<std::size_t> eor_acc_immediate(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> eor_acc_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1386,7 +1481,6 @@ std::optional<std::size_t> eor_acc_zeropage(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> eor_acc_zeropage_x(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1398,7 +1492,6 @@ std::optional<std::size_t> eor_acc_zeropage_x(emulator::Cpu& cpu, std::span<cons
 
 std::optional<std::size_t> eor_acc_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -1416,7 +1509,6 @@ Instruction eor_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1430,7 +1522,6 @@ Instruction eor_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 
 std::optional<std::size_t> eor_acc_indexed_indirect(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1442,7 +1533,6 @@ std::optional<std::size_t> eor_acc_indexed_indirect(emulator::Cpu& cpu, std::spa
 
 std::optional<std::size_t> eor_acc_indirect_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1454,7 +1544,6 @@ std::optional<std::size_t> eor_acc_indirect_indexed(emulator::Cpu& cpu, std::spa
 
 std::optional<std::size_t> and_acc_immediate(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1465,7 +1554,6 @@ std::optional<std::size_t> and_acc_immediate(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> and_acc_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1477,7 +1565,6 @@ std::optional<std::size_t> and_acc_zeropage(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> and_acc_zeropage_x(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1489,7 +1576,6 @@ std::optional<std::size_t> and_acc_zeropage_x(emulator::Cpu& cpu, std::span<cons
 
 std::optional<std::size_t> and_acc_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -1507,7 +1593,6 @@ Instruction and_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1521,7 +1606,6 @@ Instruction and_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 
 std::optional<std::size_t> and_acc_indexed_indirect(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1533,7 +1617,6 @@ std::optional<std::size_t> and_acc_indexed_indirect(emulator::Cpu& cpu, std::spa
 
 std::optional<std::size_t> and_acc_indirect_indexed(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1545,7 +1628,6 @@ std::optional<std::size_t> and_acc_indirect_indexed(emulator::Cpu& cpu, std::spa
 
 std::optional<std::size_t> or_acc_immediate(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1556,7 +1638,6 @@ std::optional<std::size_t> or_acc_immediate(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> or_acc_zeropage(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1568,7 +1649,6 @@ std::optional<std::size_t> or_acc_zeropage(emulator::Cpu& cpu, std::span<const s
 
 std::optional<std::size_t> or_acc_zeropage_x(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1580,7 +1660,6 @@ std::optional<std::size_t> or_acc_zeropage_x(emulator::Cpu& cpu, std::span<const
 
 std::optional<std::size_t> or_acc_absolute(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 2) >= program.size())
     {
         return std::nullopt;
@@ -1598,7 +1677,6 @@ Instruction or_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 {
     return [=](emulator::Cpu& cpu, std::span<const std::uint8_t> program) -> std::optional<InstructionConfig>
     {
-        ENABLE_PROFILER(cpu);
         if ((cpu.reg.pc + 2) >= program.size())
         {
             return std::nullopt;
@@ -1612,7 +1690,6 @@ Instruction or_acc_absolute_plus_reg(std::uint8_t emulator::Registers::* reg)
 
 std::optional<std::size_t> or_acc_indexed_indirect(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1624,7 +1701,6 @@ std::optional<std::size_t> or_acc_indexed_indirect(emulator::Cpu& cpu, std::span
 
 std::optional<std::size_t> or_acc_indirect_index(emulator::Cpu& cpu, std::span<const std::uint8_t> program)
 {
-    ENABLE_PROFILER(cpu);
     if ((cpu.reg.pc + 1) >= program.size())
     {
         return std::nullopt;
@@ -1838,9 +1914,8 @@ std::array<Instruction, 256> get_instructions()
 }
 
 std::optional<InstructionConfig> execute_next(
-    emulator::Cpu& cpu, std::span<const std::uint8_t> program, std::array<Instruction, 256> instructions)
+    emulator::Cpu& cpu, std::span<const std::uint8_t> program, std::array<Instruction, 256> const& instructions)
 {
-    ENABLE_PROFILER(cpu);
     // Read 1 byte for the operator
     if (cpu.reg.pc >= program.size())
     {
@@ -1851,7 +1926,7 @@ std::optional<InstructionConfig> execute_next(
     auto const command = program[cpu.reg.pc];
 
 
-    auto const instruction = instructions[command];
+    auto const& instruction = instructions[command];
     try
     {
         return instruction(cpu, program);
@@ -1866,18 +1941,61 @@ std::optional<InstructionConfig> execute_next(
 
 export namespace emulator
 {
-    std::size_t execute(Cpu& cpu, std::span<const std::uint8_t> program)
+    /// @brief Reason why a call to `run` handed control back
+    enum class StopReason : std::uint8_t
+    {
+        /// the cycle budget for this call was used up
+        Budget,
+
+        /// the program counter went past the end of the program
+        EndOfProgram,
+
+        /// an instruction stopped the program (BRK, unsupported opcode, ...)
+        Halted,
+    };
+
+    struct RunResult
+    {
+        std::size_t cycles;
+        StopReason reason;
+
+        /// cycles charged against the budget, which also counts the
+        /// instructions that do not report their cycles yet as one
+        std::size_t budget_used{0};
+    };
+} // namespace emulator
+
+namespace emulator
+{
+    /// @brief the body of `run`, calling `before(pc)` before every
+    /// instruction and `retired(pc, cycles)` after it, with its address
+    /// and the cycles charged for it. Hooks that do nothing compile away.
+    template <typename Before, typename Retired>
+    RunResult run_with(
+        Cpu& cpu, std::span<const std::uint8_t> program, std::size_t max_cycles, Before&& before, Retired&& retired)
     {
-        std::size_t n_cycles = 0;
-        ENABLE_PROFILER(cpu);
-        auto const instructions = get_instructions();
-        while (cpu.reg.pc < program.size())
+        static auto const instructions = get_instructions();
+
+        RunResult result{.cycles = 0, .reason = StopReason::Budget};
+        while (result.budget_used < max_cycles)
         {
-            auto const time_now  = std::chrono::high_resolution_clock::now();
+            if (cpu.reg.pc >= program.size())
+            {
+                result.reason = StopReason::EndOfProgram;
+                return result;
+            }
+
+            // Only throttled runs need to time the instructions
+            bool const throttled = cpu.clock_speed > 0;
+            auto const time_now  = throttled ? std::chrono::high_resolution_clock::now()
+                                             : std::chrono::high_resolution_clock::time_point{};
+            auto const pc        = cpu.reg.pc;
+            before(pc);
             auto maybe_increment = execute_next(cpu, program, instructions);
             if (!maybe_increment)
             {
-                return false;
+                result.reason = StopReason::Halted;
+                return result;
             }
 
             cpu.reg.pc += maybe_increment->bytes;
@@ -1885,7 +2003,15 @@ export namespace emulator
             // TODO : wait for the time the instruction
             // should actually take here
             double const cycles_taken = maybe_increment->cycles;
-            n_cycles += cycles_taken;
+            auto const charged        = std::max<std::size_t>(maybe_increment->cycles, 1);
+            result.cycles += maybe_increment->cycles;
+            result.budget_used += charged;
+            retired(pc, charged);
+
+            if (!throttled)
+            {
+                continue;
+            }
 
             double const cycles_per_second = cpu.clock_speed * 1'000'000;
             double const time_to_wait_s    = cycles_taken / cycles_per_second;
@@ -1896,9 +2022,761 @@ export namespace emulator
             auto const cpp_time_overhead = time_then - time_now;
             auto const wait_duration =
                 std::chrono::nanoseconds{static_cast<std::size_t>(time_to_wait_s * 1'000'000'000)};
-            std::this_thread::sleep_for(wait_duration - cpp_time_overhead);
+            auto const requested = std::max<std::chrono::nanoseconds>(wait_duration - cpp_time_overhead, {});
+            std::this_thread::sleep_for(requested);
+
+            auto const time_slept = std::chrono::high_resolution_clock::now();
+            cpu.pacing.record(maybe_increment->cycles,
+                wait_duration,
+                requested,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time_slept - time_then),
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time_slept - time_now));
+        }
+
+        return result;
+    }
+
+    /// @brief the address of the operand of the instruction at `pc`,
+    /// resolved the way the instruction handlers do, before it runs
+    std::uint16_t operand_address(Cpu const& cpu, std::span<const std::uint8_t> program, std::uint16_t pc)
+    {
+        auto const byte = [program](std::size_t addr) -> std::uint8_t
+        { return addr < program.size() ? program[addr] : 0; };
+        auto const pointer = [&cpu](std::uint8_t zero_page)
+        {
+            auto const next = static_cast<std::uint8_t>(zero_page + 1);
+            return static_cast<std::uint16_t>(cpu.mem.read(zero_page) | (cpu.mem.read(next) << 8));
+        };
+
+        auto const zero     = byte(pc + 1);
+        auto const absolute = static_cast<std::uint16_t>(zero | (byte(pc + 2) << 8));
+        switch (opcode_table[program[pc]].mode)
+        {
+        case AddressingMode::ZeroPage:
+            return zero;
+        case AddressingMode::ZeroPageX:
+            return static_cast<std::uint8_t>(zero + cpu.reg.x);
+        case AddressingMode::ZeroPageY:
+            return static_cast<std::uint8_t>(zero + cpu.reg.y);
+        case AddressingMode::Absolute:
+            return absolute;
+        case AddressingMode::AbsoluteX:
+            return static_cast<std::uint16_t>(absolute + cpu.reg.x);
+        case AddressingMode::AbsoluteY:
+            return static_cast<std::uint16_t>(absolute + cpu.reg.y);
+        case AddressingMode::IndexedIndirect:
+            return pointer(static_cast<std::uint8_t>(zero + cpu.reg.x));
+        case AddressingMode::IndirectIndexed:
+            return static_cast<std::uint16_t>(pointer(zero) + cpu.reg.y);
+        default:
+            return 0;
+        }
+    }
+} // namespace emulator
+
+export namespace emulator
+{
+    /// @brief same as `run`, reporting what every instruction does to
+    /// `observer`, see `Observer`. Memory accesses and branches are only
+    /// worked out for observers that have their own hooks for them, so
+    /// with a `NullObserver` this is the plain `run` loop. An instruction
+    /// that halts the cpu only has its memory reads reported.
+    template <Observer O>
+    RunResult run(Cpu& cpu, std::span<const std::uint8_t> program, std::size_t max_cycles, O& observer)
+    {
+        // Where the instruction running writes, worked out before it runs
+        // and reported after
+        std::array<std::uint16_t, 3> writes{};
+        std::size_t write_count = 0;
+
+        auto const decode = [&](std::uint16_t pc)
+        {
+            auto const& effects = opcode_effects[program[pc]];
+            auto const stack    = [&cpu](int offset)
+            { return static_cast<std::uint16_t>(0x0100 | ((cpu.reg.sp + offset) & 0xff)); };
+
+            write_count = 0;
+            for (int i = 1; i <= effects.pulls; ++i)
+            {
+                observer.on_mem_read(stack(i), cpu.mem.read(stack(i)));
+            }
+            for (int i = 0; i < effects.pushes; ++i)
+            {
+                writes[write_count++] = stack(-i);
+            }
+
+            if (effects.access == OperandAccess::None)
+            {
+                return;
+            }
+            auto const addr = operand_address(cpu, program, pc);
+            if (effects.access != OperandAccess::Write)
+            {
+                observer.on_mem_read(addr, cpu.mem.read(addr));
+            }
+            if (effects.access != OperandAccess::Read)
+            {
+                writes[write_count++] = addr;
+            }
+        };
+
+        auto const before = [&](std::uint16_t pc)
+        {
+            if constexpr (MemoryObserver<O>)
+            {
+                decode(pc);
+            }
+            if constexpr (FetchObserver<O>)
+            {
+                // Last, so that timing observers leave the decoding out
+                observer.on_fetch(pc, program[pc]);
+            }
+        };
+
+        auto const retired = [&](std::uint16_t pc, std::size_t cycles)
+        {
+            auto const opcode = program[pc];
+            if constexpr (MemoryObserver<O>)
+            {
+                for (std::size_t i = 0; i < write_count; ++i)
+                {
+                    observer.on_mem_write(writes[i], cpu.mem.read(writes[i]));
+                }
+            }
+            if constexpr (BranchObserver<O>)
+            {
+                if (opcode_effects[opcode].jumps)
+                {
+                    auto const mode        = opcode_table[opcode].mode;
+                    auto const fallthrough = pc + instruction_size(mode);
+                    observer.on_branch(pc, cpu.reg.pc, mode != AddressingMode::Relative || cpu.reg.pc != fallthrough);
+                }
+            }
+            observer.on_instruction(pc, opcode, cycles);
+        };
+
+        return run_with(cpu, program, max_cycles, before, retired);
+    }
+
+    /// @brief executes the program on the given cpu until at least
+    /// `max_cycles` cycles have been spent, or the program stops. The
+    /// cpu state is left as is, so calling `run` again carries on from
+    /// where the previous call left off. Instructions that do not report
+    /// their cycles yet count as one cycle against the budget, so a call
+    /// always returns after at most `max_cycles` instructions.
+    /// @param cpu the cpu to run the program on.
+    /// @param program the program bytes, indexed by the program counter.
+    /// @param max_cycles the cycle budget for this call.
+    /// @return the cycles spent and why the call returned.
+    RunResult run(Cpu& cpu, std::span<const std::uint8_t> program, std::size_t max_cycles)
+    {
+        NullObserver observer;
+        return run(cpu, program, max_cycles, observer);
+    }
+
+    /// @brief same as `run`, and also samples the program counter into
+    /// `sampler` every `sampler.period()` cycles. Sampling carries on
+    /// across calls, so one sampler can profile a whole run made of
+    /// many slices.
+    RunResult run(Cpu& cpu, std::span<const std::uint8_t> program, std::size_t max_cycles, PcSampler& sampler)
+    {
+        struct Sampling : NullObserver
+        {
+            PcSampler& sampler;
+
+            void on_instruction(std::uint16_t pc, std::uint8_t /* opcode */, std::size_t cycles)
+            {
+                sampler.advance(pc, cycles);
+            }
+        } observer{{}, sampler};
+        return run(cpu, program, max_cycles, observer);
+    }
+
+    /// @brief same as `run`, and also traces every instruction executed
+    /// into `trace`, with its operands and the registers it left behind
+    RunResult run(Cpu& cpu, std::span<const std::uint8_t> program, std::size_t max_cycles, TraceWriter& trace)
+    {
+        struct Tracing : NullObserver
+        {
+            Cpu const& cpu;
+            std::span<const std::uint8_t> program;
+            TraceWriter& trace;
+
+            void on_instruction(std::uint16_t pc, std::uint8_t opcode, std::size_t cycles)
+            {
+                trace.push(TraceRecord{.cycle = 0,
+                               .pc            = pc,
+                               .opcode        = opcode,
+                               .operands      = {operand(pc + 1), operand(pc + 2)},
+                               .a             = cpu.reg.a,
+                               .x             = cpu.reg.x,
+                               .y             = cpu.reg.y,
+                               .sp            = cpu.reg.sp,
+                               .sr            = cpu.sr()},
+                    cycles);
+            }
+
+            [[nodiscard]] std::uint8_t operand(std::size_t addr) const
+            {
+                return addr < program.size() ? program[addr] : 0;
+            }
+        } observer{{}, cpu, program, trace};
+        return run(cpu, program, max_cycles, observer);
+    }
+
+    /// @brief runs the program `cycles` at a time, handing control back
+    /// to the caller after every slice, without callbacks or threads:
+    ///
+    ///     for (auto const& slice : emulator::slices(cpu, program, 1'000))
+    ///
+    /// Each slice is what `run` returned for it. The last slice is the
+    /// one the program stopped in, unless the caller stops iterating
+    /// first. The cpu and the program must outlive the iteration. A
+    /// budget of zero is taken as one, it would never get anywhere.
+    Generator<RunResult> slices(Cpu& cpu, std::span<const std::uint8_t> program, std::size_t cycles)
+    {
+        cycles = std::max<std::size_t>(cycles, 1);
+        while (true)
+        {
+            auto const result = run(cpu, program, cycles);
+            co_yield result;
+
+            if (result.reason != StopReason::Budget)
+            {
+                co_return;
+            }
+        }
+    }
+
+    /// @brief same as `slices`, handing control back after every
+    /// instruction
+    Generator<RunResult> steps(Cpu& cpu, std::span<const std::uint8_t> program)
+    {
+        // A budget of a single cycle runs exactly one instruction
+        return slices(cpu, program, 1);
+    }
+
+    /// @brief same as `slices`, handing control back after every frame's
+    /// worth of cycles at the cpu's clock speed
+    /// @throws std::invalid_argument unless `frames_per_second` is positive
+    Generator<RunResult> frames(Cpu& cpu, std::span<const std::uint8_t> program, double frames_per_second)
+    {
+        if (!(frames_per_second > 0))
+        {
+            throw std::invalid_argument("frames per second must be positive");
+        }
+
+        auto const cycles = static_cast<std::size_t>(cpu.clock_speed * 1'000'000 / frames_per_second);
+        return slices(cpu, program, std::max<std::size_t>(cycles, 1));
+    }
+
+    /// @brief FNV-1a hash of the registers, the status register and
+    /// every memory page written since the last reset. Two runs of the
+    /// same program from the same starting state hash the same if and
+    /// only if (barring collisions) they end in the same state.
+    std::uint64_t state_hash(Cpu const& cpu)
+    {
+        std::uint64_t hash = 0xcbf2'9ce4'8422'2325;
+        auto const mix     = [&hash](std::uint8_t byte)
+        {
+            hash ^= byte;
+            hash *= 0x0000'0100'0000'01b3;
+        };
+
+        mix(cpu.reg.a);
+        mix(cpu.reg.x);
+        mix(cpu.reg.y);
+        mix(cpu.reg.sp);
+        mix(static_cast<std::uint8_t>(cpu.reg.pc));
+        mix(static_cast<std::uint8_t>(cpu.reg.pc >> 8));
+        mix(cpu.sr());
+
+        for (std::size_t page = 0; page < page_count; ++page)
+        {
+            if (!cpu.mem.is_dirty(page))
+            {
+                continue;
+            }
+
+            mix(static_cast<std::uint8_t>(page));
+            for (auto const byte : cpu.mem.page(page))
+            {
+                mix(byte);
+            }
+        }
+
+        return hash;
+    }
+
+    std::size_t execute(Cpu& cpu, std::span<const std::uint8_t> program)
+    {
+        auto const result = run(cpu, program, std::numeric_limits<std::size_t>::max());
+        if (result.reason == StopReason::Halted)
+        {
+            return 0;
         }
 
-        return n_cycles;
+        return result.cycles;
     }
 } // namespace emulator
+
+export namespace emulator
+{
+    /// @brief Runs the same program on `Lanes` guests at once, keeping
+    /// their registers in structure-of-arrays form.
+    ///
+    /// While every running guest sits at the same program counter, the
+    /// register-only instructions (immediate loads, transfers, increments,
+    /// immediate logic and compares, accumulator shifts, flag changes) are
+    /// executed for all lanes in one go, as fixed-width loops over the
+    /// lane arrays. The default build targets baseline x86-64 (SSE2), so
+    /// configure with `NATIVE_ARCH` to let the compiler use AVX2/AVX-512
+    /// on hosts that have them. Anything else, and every step where the
+    /// lanes have diverged, runs the regular scalar handlers one lane at
+    /// a time. Lanes that come back to the same program counter run in
+    /// lockstep again.
+    template <std::size_t Lanes>
+        requires(Lanes == 8 || Lanes == 16 || Lanes == 32)
+    class Lockstep
+    {
+    public:
+        /// @brief starts every lane from a copy of the given cpu's
+        /// registers, flags and memory
+        explicit Lockstep(std::span<Cpu const, Lanes> initial)
+        {
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                _cpus[lane].mem = initial[lane].mem;
+                store(lane, initial[lane].reg, initial[lane].sr());
+            }
+        }
+
+        /// @brief runs the program on every lane until each of them has
+        /// used up `max_cycles` of budget or stopped, see `emulator::run`.
+        std::array<RunResult, Lanes> run(std::span<const std::uint8_t> program, std::size_t max_cycles)
+        {
+            static auto const instructions = get_instructions();
+
+            std::array<RunResult, Lanes> results{};
+            results.fill({.cycles = 0, .reason = StopReason::Budget});
+
+            std::array<bool, Lanes> stopped{};
+            while (true)
+            {
+                // Lanes still running in this call, all lanes share the
+                // same budget so converged lanes run out of it together
+                Mask running{};
+                std::optional<std::uint16_t> common_pc;
+                bool converged = true;
+                for (std::size_t lane = 0; lane < Lanes; ++lane)
+                {
+                    if (stopped[lane] || results[lane].budget_used >= max_cycles)
+                    {
+                        continue;
+                    }
+
+                    running[lane] = 0xff;
+                    converged     = converged && (!common_pc || *common_pc == pc[lane]);
+                    common_pc     = pc[lane];
+                }
+
+                if (!common_pc)
+                {
+                    break;
+                }
+
+                if (converged)
+                {
+                    if (auto const increment = step_lanes(program, *common_pc, running))
+                    {
+                        ++_vector_steps;
+                        for (std::size_t lane = 0; lane < Lanes; ++lane)
+                        {
+                            if (running[lane] != 0)
+                            {
+                                results[lane].cycles += increment->cycles;
+                                results[lane].budget_used += std::max<std::size_t>(increment->cycles, 1);
+                            }
+                        }
+                        continue;
+                    }
+                }
+
+                for (std::size_t lane = 0; lane < Lanes; ++lane)
+                {
+                    if (running[lane] == 0)
+                    {
+                        continue;
+                    }
+
+                    ++_scalar_steps;
+                    if (pc[lane] >= program.size())
+                    {
+                        results[lane].reason = StopReason::EndOfProgram;
+                        stopped[lane]        = true;
+                        continue;
+                    }
+
+                    auto& cpu = load(lane);
+                    auto const increment = execute_next(cpu, program, instructions);
+                    if (!increment)
+                    {
+                        store(lane, cpu.reg, cpu.sr());
+                        results[lane].reason = StopReason::Halted;
+                        stopped[lane]        = true;
+                        continue;
+                    }
+
+                    cpu.reg.pc += increment->bytes;
+                    store(lane, cpu.reg, cpu.sr());
+                    results[lane].cycles += increment->cycles;
+                    results[lane].budget_used += std::max<std::size_t>(increment->cycles, 1);
+                }
+            }
+
+            return results;
+        }
+
+        /// @brief the registers of the given lane
+        [[nodiscard]] Registers registers(std::size_t lane) const
+        {
+            return {.a = a[lane], .x = x[lane], .y = y[lane], .pc = pc[lane], .sp = sp[lane]};
+        }
+
+        /// @brief the status register of the given lane, as `Cpu::sr`
+        [[nodiscard]] std::uint8_t status(std::size_t lane) const
+        {
+            return p[lane];
+        }
+
+        [[nodiscard]] Memory const& memory(std::size_t lane) const
+        {
+            return _cpus[lane].mem;
+        }
+
+        /// @brief number of steps that ran every lane at once
+        [[nodiscard]] std::size_t vector_steps() const
+        {
+            return _vector_steps;
+        }
+
+        /// @brief number of single lane steps, i.e. after divergence or
+        /// for instructions that touch memory or the program counter
+        [[nodiscard]] std::size_t scalar_steps() const
+        {
+            return _scalar_steps;
+        }
+
+    private:
+        using Mask = std::array<std::uint8_t, Lanes>;
+
+        static constexpr std::uint8_t flag_n = 0b1000'0000;
+        static constexpr std::uint8_t flag_v = 0b0100'0000;
+        static constexpr std::uint8_t flag_d = 0b0000'1000;
+        static constexpr std::uint8_t flag_i = 0b0000'0100;
+        static constexpr std::uint8_t flag_z = 0b0000'0010;
+        static constexpr std::uint8_t flag_c = 0b0000'0001;
+
+        /// @brief copies the lane's registers into its scalar cpu
+        Cpu& load(std::size_t lane)
+        {
+            auto& cpu = _cpus[lane];
+            cpu.reg   = registers(lane);
+            cpu.flags = Flags{
+                .n = static_cast<bool>(p[lane] & flag_n),
+                .v = static_cast<bool>(p[lane] & flag_v),
+                .b = static_cast<bool>(p[lane] & 0b0001'0000),
+                .d = static_cast<bool>(p[lane] & flag_d),
+                .i = static_cast<bool>(p[lane] & flag_i),
+                .z = static_cast<bool>(p[lane] & flag_z),
+                .c = static_cast<bool>(p[lane] & flag_c),
+            };
+            return cpu;
+        }
+
+        void store(std::size_t lane, Registers const& reg, std::uint8_t sr)
+        {
+            a[lane]  = reg.a;
+            x[lane]  = reg.x;
+            y[lane]  = reg.y;
+            sp[lane] = reg.sp;
+            pc[lane] = reg.pc;
+            p[lane]  = sr;
+        }
+
+        /// @brief `to = from` on the running lanes, setting N and Z
+        /// from the new value unless `flags` is false
+        void assign(std::array<std::uint8_t, Lanes>& to,
+                    std::array<std::uint8_t, Lanes> const& from,
+                    Mask const& running,
+                    bool flags = true)
+        {
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                auto const value = from[lane];
+                auto const nz    = with_nz(p[lane], value);
+                to[lane]         = (value & running[lane]) | (to[lane] & ~running[lane]);
+                if (flags)
+                {
+                    p[lane] = (nz & running[lane]) | (p[lane] & ~running[lane]);
+                }
+            }
+        }
+
+        /// @brief applies `op(value, p) -> {value, p}` to `reg` on the
+        /// running lanes
+        template <typename Op>
+        void apply(std::array<std::uint8_t, Lanes>& reg, Mask const& running, Op op)
+        {
+            std::array<std::uint8_t, Lanes> values{};
+            std::array<std::uint8_t, Lanes> status{};
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                auto const [value, new_p] = op(reg[lane], p[lane]);
+                values[lane]              = value;
+                status[lane]              = new_p;
+            }
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                reg[lane] = (values[lane] & running[lane]) | (reg[lane] & ~running[lane]);
+                p[lane]   = (status[lane] & running[lane]) | (p[lane] & ~running[lane]);
+            }
+        }
+
+        static std::uint8_t with_nz(std::uint8_t status, std::uint8_t value)
+        {
+            auto const zero = value == 0 ? flag_z : 0;
+            return static_cast<std::uint8_t>((status & ~(flag_n | flag_z)) | (value & flag_n) | zero);
+        }
+
+        /// @brief executes the instruction at `pc_value` on every running
+        /// lane, if it is one that only touches registers
+        /// @return the bytes and cycles of the instruction, or nothing if
+        /// it has to run lane by lane
+        std::optional<InstructionConfig> step_lanes(
+            std::span<const std::uint8_t> program, std::uint16_t pc_value, Mask const& running)
+        {
+            if (std::size_t{pc_value} + 1 >= program.size())
+            {
+                // Let the scalar handlers deal with truncated operands
+                return std::nullopt;
+            }
+
+            auto const opcode  = program[pc_value];
+            auto const operand = program[pc_value + 1];
+
+            auto const load_immediate = [&](std::array<std::uint8_t, Lanes>& reg)
+            {
+                apply(reg,
+                    running,
+                    [operand](std::uint8_t, std::uint8_t status) { return std::pair{operand, with_nz(status, operand)}; });
+            };
+            auto const add = [&](std::array<std::uint8_t, Lanes>& reg, std::uint8_t delta)
+            {
+                apply(reg,
+                    running,
+                    [delta](std::uint8_t value, std::uint8_t status)
+                    {
+                        auto const result = static_cast<std::uint8_t>(value + delta);
+                        return std::pair{result, with_nz(status, result)};
+                    });
+            };
+            auto const compare = [&](std::array<std::uint8_t, Lanes>& reg)
+            {
+                apply(reg,
+                    running,
+                    [operand](std::uint8_t value, std::uint8_t status)
+                    {
+                        auto const result = static_cast<std::uint8_t>(value - operand);
+                        auto const carry  = value >= operand ? flag_c : 0;
+                        return std::pair{value, static_cast<std::uint8_t>((with_nz(status, result) & ~flag_c) | carry)};
+                    });
+            };
+            auto const logic = [&](auto op)
+            {
+                apply(a,
+                    running,
+                    [operand, op](std::uint8_t value, std::uint8_t status)
+                    {
+                        auto const result = static_cast<std::uint8_t>(op(value, operand));
+                        return std::pair{result, with_nz(status, result)};
+                    });
+            };
+            auto const shift = [&](auto op)
+            {
+                apply(a,
+                    running,
+                    [op](std::uint8_t value, std::uint8_t status)
+                    {
+                        auto const [result, carry] = op(value, static_cast<std::uint8_t>(status & flag_c));
+                        return std::pair{result,
+                            static_cast<std::uint8_t>((with_nz(status, result) & ~flag_c) | (carry ? flag_c : 0))};
+                    });
+            };
+            auto const set_flags = [&](std::uint8_t flag, bool value)
+            {
+                for (std::size_t lane = 0; lane < Lanes; ++lane)
+                {
+                    auto const changed = static_cast<std::uint8_t>(value ? (p[lane] | flag) : (p[lane] & ~flag));
+                    p[lane]            = (changed & running[lane]) | (p[lane] & ~running[lane]);
+                }
+            };
+
+            // Bytes and cycles match what the scalar handlers report
+            std::optional<InstructionConfig> increment;
+            switch (opcode)
+            {
+            case 0xa9: // LDA #
+                load_immediate(a);
+                increment.emplace(2);
+                break;
+            case 0xa2: // LDX #
+                load_immediate(x);
+                increment.emplace(2);
+                break;
+            case 0xa0: // LDY #
+                load_immediate(y);
+                increment.emplace(2);
+                break;
+            case 0xaa: // TAX
+                assign(x, a, running);
+                increment.emplace(1);
+                break;
+            case 0xa8: // TAY
+                assign(y, a, running);
+                increment.emplace(1);
+                break;
+            case 0x8a: // TXA
+                assign(a, x, running);
+                increment.emplace(1);
+                break;
+            case 0x98: // TYA
+                assign(a, y, running);
+                increment.emplace(1);
+                break;
+            case 0xba: // TSX
+                assign(x, sp, running);
+                increment.emplace(1);
+                break;
+            case 0x9a: // TXS
+                assign(sp, x, running, false);
+                increment.emplace(1);
+                break;
+            case 0xe8: // INX
+                add(x, 1);
+                increment.emplace(1, 2);
+                break;
+            case 0xc8: // INY
+                add(y, 1);
+                increment.emplace(1, 2);
+                break;
+            case 0xca: // DEX
+                add(x, 0xff);
+                increment.emplace(1, 2);
+                break;
+            case 0x88: // DEY
+                add(y, 0xff);
+                increment.emplace(1, 2);
+                break;
+            case 0xc9: // CMP #
+                compare(a);
+                increment.emplace(2, 2);
+                break;
+            case 0xe0: // CPX #
+                compare(x);
+                increment.emplace(2, 2);
+                break;
+            case 0xc0: // CPY #
+                compare(y);
+                increment.emplace(2, 2);
+                break;
+            case 0x29: // AND #
+                logic(std::bit_and<>{});
+                increment.emplace(2);
+                break;
+            case 0x09: // ORA #
+                logic(std::bit_or<>{});
+                increment.emplace(2);
+                break;
+            case 0x49: // EOR #
+                logic(std::bit_xor<>{});
+                increment.emplace(2);
+                break;
+            case 0x0a: // ASL A
+                shift([](std::uint8_t value, std::uint8_t)
+                    { return std::pair{static_cast<std::uint8_t>(value << 1), (value & 0x80) != 0}; });
+                increment.emplace(1);
+                break;
+            case 0x4a: // LSR A
+                shift([](std::uint8_t value, std::uint8_t)
+                    { return std::pair{static_cast<std::uint8_t>(value >> 1), (value & 0x01) != 0}; });
+                increment.emplace(1);
+                break;
+            case 0x2a: // ROL A
+                shift([](std::uint8_t value, std::uint8_t carry)
+                    { return std::pair{static_cast<std::uint8_t>((value << 1) | carry), (value & 0x80) != 0}; });
+                increment.emplace(1);
+                break;
+            case 0x6a: // ROR A
+                shift([](std::uint8_t value, std::uint8_t carry)
+                    { return std::pair{static_cast<std::uint8_t>((value >> 1) | (carry << 7)), (value & 0x01) != 0}; });
+                increment.emplace(1);
+                break;
+            case 0x38: // SEC
+                set_flags(flag_c, true);
+                increment.emplace(1);
+                break;
+            case 0x78: // SEI
+                set_flags(flag_i, true);
+                increment.emplace(1);
+                break;
+            case 0xf8: // SED
+                set_flags(flag_d, true);
+                increment.emplace(1);
+                break;
+            case 0x18: // CLC
+                set_flags(flag_c, false);
+                increment.emplace(1);
+                break;
+            case 0x58: // CLI
+                set_flags(flag_i, false);
+                increment.emplace(1);
+                break;
+            case 0xb8: // CLV
+                set_flags(flag_v, false);
+                increment.emplace(1);
+                break;
+            case 0xd8: // CLD
+                set_flags(flag_d, false);
+                increment.emplace(1);
+                break;
+            case 0xea: // NOP
+                increment.emplace(1, 2);
+                break;
+            default:
+                return std::nullopt;
+            }
+
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                auto const next = static_cast<std::uint16_t>(pc[lane] + increment->bytes);
+                pc[lane]        = running[lane] != 0 ? next : pc[lane];
+            }
+            return increment;
+        }
+
+        // Lane registers, one array per register
+        alignas(64) std::array<std::uint8_t, Lanes> a{};
+        alignas(64) std::array<std::uint8_t, Lanes> x{};
+        alignas(64) std::array<std::uint8_t, Lanes> y{};
+        alignas(64) std::array<std::uint8_t, Lanes> sp{};
+        alignas(64) std::array<std::uint8_t, Lanes> p{};
+        alignas(64) std::array<std::uint16_t, Lanes> pc{};
+
+        /// memory of each lane, and the cpu the scalar handlers run on
+        std::array<Cpu, Lanes> _cpus{};
+
+        std::size_t _vector_steps{0};
+        std::size_t _scalar_steps{0};
+    };
+} // namespace emulator
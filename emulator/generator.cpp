@@ -0,0 +1,162 @@
+module;
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <version>
+
+#if __has_include(<generator>)
+#include <generator>
+#endif
+
+export module emulator:generator;
+
+export namespace emulator
+{
+#if defined(__cpp_lib_generator)
+    template <typename T>
+    using Generator = std::generator<T>;
+#else
+    /// @brief Minimal stand-in for C++23 `std::generator<T>`, for the
+    /// standard libraries that do not ship it yet.
+    ///
+    /// It is a lazily evaluated input range: the coroutine body runs up to
+    /// the next `co_yield` each time the iterator is advanced, and the
+    /// yielded value is read in place rather than copied.
+    template <typename T>
+    class Generator
+    {
+    public:
+        struct promise_type
+        {
+            T const* value{nullptr};
+            std::exception_ptr exception{};
+
+            Generator get_return_object()
+            {
+                return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always yield_value(T const& yielded) noexcept
+            {
+                value = std::addressof(yielded);
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+
+            // Generators only ever yield
+            template <typename U>
+            std::suspend_never await_transform(U&&) = delete;
+        };
+
+        class iterator
+        {
+        public:
+            using value_type      = T;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+
+            explicit iterator(std::coroutine_handle<promise_type> coroutine) : _coroutine{coroutine} {}
+
+            T const& operator*() const
+            {
+                return *_coroutine.promise().value;
+            }
+
+            iterator& operator++()
+            {
+                resume(_coroutine);
+                return *this;
+            }
+
+            void operator++(int)
+            {
+                ++*this;
+            }
+
+            friend bool operator==(iterator const& it, std::default_sentinel_t)
+            {
+                return !it._coroutine || it._coroutine.done();
+            }
+
+        private:
+            std::coroutine_handle<promise_type> _coroutine{};
+        };
+
+        Generator(Generator const&)            = delete;
+        Generator& operator=(Generator const&) = delete;
+
+        Generator(Generator&& other) noexcept : _coroutine{std::exchange(other._coroutine, nullptr)} {}
+
+        Generator& operator=(Generator&& other) noexcept
+        {
+            if (this != &other)
+            {
+                destroy();
+                _coroutine = std::exchange(other._coroutine, nullptr);
+            }
+            return *this;
+        }
+
+        ~Generator()
+        {
+            destroy();
+        }
+
+        /// @brief runs the coroutine up to its first yield
+        iterator begin()
+        {
+            resume(_coroutine);
+            return iterator{_coroutine};
+        }
+
+        std::default_sentinel_t end() const noexcept
+        {
+            return {};
+        }
+
+    private:
+        explicit Generator(std::coroutine_handle<promise_type> coroutine) : _coroutine{coroutine} {}
+
+        static void resume(std::coroutine_handle<promise_type> coroutine)
+        {
+            coroutine.resume();
+            if (coroutine.promise().exception)
+            {
+                std::rethrow_exception(std::exchange(coroutine.promise().exception, nullptr));
+            }
+        }
+
+        void destroy()
+        {
+            if (_coroutine)
+            {
+                _coroutine.destroy();
+                _coroutine = nullptr;
+            }
+        }
+
+        std::coroutine_handle<promise_type> _coroutine;
+    };
+#endif // __cpp_lib_generator
+} // namespace emulator
@@ -0,0 +1,219 @@
+module;
+
+#include <algorithm>
+#include <barrier>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+export module machine;
+
+import emulator;
+
+export namespace emulator
+{
+    /// @brief A range of whole pages that every core of a `Machine` sees
+    /// the same contents in, e.g. a mailbox between a main cpu and a
+    /// sound coprocessor.
+    struct SharedRegion
+    {
+        std::uint8_t first_page;
+        std::size_t pages;
+    };
+
+    /// @brief Several 6502 cores, each running its own program on its
+    /// own host thread, with some of the address space shared.
+    ///
+    /// Cores run in lockstep quanta: every core runs `quantum` cycles
+    /// (see `emulator::run`), then all of them meet at a barrier before
+    /// the next quantum starts. Outside the shared regions a core's
+    /// memory is its own plain `cpu.mem`. Inside them each core reads and
+    /// writes a private copy during a quantum, and the copies are merged
+    /// at the barrier: every byte a core changed is published to all the
+    /// others, and when several cores changed the same byte the highest
+    /// numbered core wins. Writes to shared memory therefore become
+    /// visible to the other cores at the start of the next quantum, never
+    /// in the middle of one, and the whole run is deterministic no matter
+    /// how the host schedules the threads.
+    class Machine
+    {
+    public:
+        /// @param shared regions of the address space every core shares
+        /// @param quantum cycles each core runs between two synchronisations
+        explicit Machine(std::vector<SharedRegion> const& shared, std::size_t quantum = 1'000) : _quantum{quantum}
+        {
+            if (_quantum == 0)
+            {
+                throw std::invalid_argument("machine quantum cannot be zero");
+            }
+
+            std::bitset<page_count> used{};
+            for (auto const& region : shared)
+            {
+                if (region.pages == 0 || region.first_page + region.pages > page_count)
+                {
+                    throw std::invalid_argument("shared region does not fit in the address space");
+                }
+
+                for (std::size_t page = region.first_page; page < region.first_page + region.pages; ++page)
+                {
+                    if (used.test(page))
+                    {
+                        throw std::invalid_argument("shared regions overlap");
+                    }
+                    used.set(page);
+                    _shared_pages.push_back(static_cast<std::uint8_t>(page));
+                }
+            }
+            _shared.resize(_shared_pages.size());
+        }
+
+        Machine(Machine const&)            = delete;
+        Machine& operator=(Machine const&) = delete;
+
+        /// @brief adds a core running `program` on `cpu`, and returns its
+        /// number. The shared regions of its memory are remapped onto
+        /// the machine, and the program must outlive the machine.
+        std::size_t add(std::unique_ptr<Cpu> cpu, std::span<const std::uint8_t> program)
+        {
+            auto& core   = _cores.emplace_back();
+            core.cpu     = std::move(cpu);
+            core.program = program;
+            core.shared  = std::make_unique<Page[]>(_shared_pages.size());
+            for (std::size_t i = 0; i < _shared_pages.size(); ++i)
+            {
+                core.shared[i] = _shared[i];
+                core.cpu->mem.map(_shared_pages[i], core.shared[i].data());
+            }
+            return _cores.size() - 1;
+        }
+
+        /// @brief runs every core on its own thread until all of them
+        /// stopped, or ran for `max_cycles` each
+        /// @return what each core's run ended with, in core order
+        std::vector<RunResult> run(std::size_t max_cycles)
+        {
+            std::vector<RunResult> results(_cores.size(), RunResult{.cycles = 0, .reason = StopReason::Budget});
+            std::vector<char> done(_cores.size(), 0);
+            bool finished = _cores.empty();
+
+            std::barrier sync{static_cast<std::ptrdiff_t>(_cores.size()),
+                [&]() noexcept
+                {
+                    merge();
+                    finished = std::ranges::all_of(done, [](char core_done) { return core_done != 0; });
+                }};
+
+            {
+                std::vector<std::jthread> threads;
+                threads.reserve(_cores.size());
+                for (std::size_t i = 0; i < _cores.size(); ++i)
+                {
+                    threads.emplace_back(
+                        [&, i]
+                        {
+                            auto& core   = _cores[i];
+                            auto& result = results[i];
+                            while (!finished)
+                            {
+                                if (done[i] == 0)
+                                {
+                                    auto const budget = std::min(_quantum, max_cycles - result.budget_used);
+                                    auto const slice  = emulator::run(*core.cpu, core.program, budget);
+                                    result.cycles += slice.cycles;
+                                    result.budget_used += slice.budget_used;
+                                    result.reason = slice.reason;
+
+                                    done[i] = slice.reason != StopReason::Budget || result.budget_used >= max_cycles;
+                                }
+                                sync.arrive_and_wait();
+                            }
+                        });
+                }
+            }
+
+            return results;
+        }
+
+        [[nodiscard]] Cpu& cpu(std::size_t core)
+        {
+            return *_cores.at(core).cpu;
+        }
+
+        [[nodiscard]] std::size_t size() const
+        {
+            return _cores.size();
+        }
+
+        /// @brief the published contents of a shared address, i.e. what
+        /// every core sees at the start of the next quantum
+        [[nodiscard]] std::uint8_t shared(std::uint16_t addr) const
+        {
+            auto const page = std::ranges::find(_shared_pages, static_cast<std::uint8_t>(addr >> 8));
+            if (page == _shared_pages.end())
+            {
+                throw std::out_of_range("address is not in a shared region");
+            }
+            return _shared[static_cast<std::size_t>(page - _shared_pages.begin())][addr & 0xff];
+        }
+
+    private:
+        struct Core
+        {
+            std::unique_ptr<Cpu> cpu;
+            std::span<const std::uint8_t> program;
+
+            /// this core's copy of every shared page, in `_shared_pages` order
+            std::unique_ptr<Page[]> shared;
+        };
+
+        /// @brief publishes the bytes each core changed in its copy of the
+        /// shared pages, then hands every core the merged pages. Runs on
+        /// one thread while all the others wait at the barrier.
+        void merge() noexcept
+        {
+            for (std::size_t i = 0; i < _shared_pages.size(); ++i)
+            {
+                auto const before = _shared[i];
+                auto& merged      = _shared[i];
+                for (auto const& core : _cores)
+                {
+                    auto const& copy = core.shared[i];
+                    if (std::memcmp(copy.data(), before.data(), page_size) == 0)
+                    {
+                        continue;
+                    }
+
+                    for (std::size_t byte = 0; byte < page_size; ++byte)
+                    {
+                        if (copy[byte] != before[byte])
+                        {
+                            merged[byte] = copy[byte];
+                        }
+                    }
+                }
+
+                for (auto& core : _cores)
+                {
+                    core.shared[i] = merged;
+                }
+            }
+        }
+
+        std::size_t _quantum;
+
+        /// every shared page number, in the order their storage is kept in
+        std::vector<std::uint8_t> _shared_pages;
+
+        /// the published contents of the shared pages
+        std::vector<Page> _shared;
+
+        std::vector<Core> _cores;
+    };
+} // namespace emulator
@@ -0,0 +1,787 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+export module emulator:memory;
+
+export namespace emulator
+{
+    /// Number of bytes in a 6502 page, which is also the granularity
+    /// of the memory page table
+    inline constexpr std::size_t page_size = 0x100;
+
+    /// Number of pages needed to cover the 16-bit address space
+    inline constexpr std::size_t page_count = 0x100;
+
+    /// Size in bytes of the whole 6502 address space
+    inline constexpr std::size_t address_space_size = page_size * page_count;
+
+    /// @brief One 6502 page worth of bytes
+    using Page = std::array<std::uint8_t, page_size>;
+
+    /// @brief An immutable 64 KiB memory image, e.g. a ROM plus the
+    /// initial contents of RAM. A single image can back the memory of
+    /// any number of cpus at once, see `Memory(std::shared_ptr<Image const>)`.
+    class Image
+    {
+    public:
+        Image() = default;
+
+        /// @brief creates an image holding `contents` at `load_address`,
+        /// with every other byte set to zero.
+        explicit Image(std::span<const std::uint8_t> contents, std::uint16_t load_address = 0)
+        {
+            if (load_address + contents.size() > address_space_size)
+            {
+                throw std::invalid_argument("image contents do not fit in the address space");
+            }
+            std::ranges::copy(contents, _data.begin() + load_address);
+        }
+
+        [[nodiscard]] std::uint8_t const* page(std::size_t page) const
+        {
+            return _data.data() + (page * page_size);
+        }
+
+        /// @brief never zero, and never the same for two images constructed
+        /// separately, even at the same address. Copies share the id along
+        /// with the contents.
+        [[nodiscard]] std::uint64_t id() const
+        {
+            return _id;
+        }
+
+    private:
+        static std::uint64_t next_id()
+        {
+            static std::atomic<std::uint64_t> ids{0};
+            return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        std::uint64_t _id{next_id()};
+        std::array<std::uint8_t, address_space_size> _data{};
+    };
+
+    /// @brief A free list of pages shared by many `Memory` objects.
+    ///
+    /// Pages are carved out of larger chunks so that the private pages
+    /// of sparse and copy-on-write memories stay close together, and
+    /// pages given back by a memory are reused instead of freed. The
+    /// pool is not thread safe, use one pool per thread.
+    class PagePool
+    {
+    public:
+        explicit PagePool(std::size_t pages_per_chunk = 64) : _pages_per_chunk{pages_per_chunk}
+        {
+            if (_pages_per_chunk == 0)
+            {
+                throw std::invalid_argument("page pool chunks cannot be empty");
+            }
+        }
+
+        PagePool(PagePool const&)            = delete;
+        PagePool& operator=(PagePool const&) = delete;
+
+        /// @brief takes a page out of the pool. The page contents are
+        /// whatever its previous user left in it.
+        [[nodiscard]] Page* acquire()
+        {
+            if (_free.empty())
+            {
+                auto& chunk = _chunks.emplace_back(std::make_unique<Page[]>(_pages_per_chunk));
+                for (std::size_t i = _pages_per_chunk; i > 0; --i)
+                {
+                    _free.push_back(&chunk[i - 1]);
+                }
+            }
+
+            auto* const page = _free.back();
+            _free.pop_back();
+            return page;
+        }
+
+        void release(Page* page)
+        {
+            _free.push_back(page);
+        }
+
+        /// @brief total number of pages allocated by the pool
+        [[nodiscard]] std::size_t capacity() const
+        {
+            return _chunks.size() * _pages_per_chunk;
+        }
+
+        /// @brief number of pages ready to be acquired
+        [[nodiscard]] std::size_t available() const
+        {
+            return _free.size();
+        }
+
+    private:
+        std::size_t _pages_per_chunk;
+        std::vector<std::unique_ptr<Page[]>> _chunks;
+        std::vector<Page*> _free;
+    };
+
+    class Memory;
+    class Mapper;
+
+    /// @brief Function called instead of storing a value when the
+    /// guest writes to a trapped address (e.g. a mapper control register).
+    using WriteHandler = std::function<void(Memory&, std::uint16_t, std::uint8_t)>;
+
+    /// @brief The 64 KiB address space seen by the cpu.
+    ///
+    /// Every access goes through a 256 entry page table, so any 6502
+    /// page can be pointed at a different backing buffer (e.g. a bank
+    /// of a larger ROM) by swapping a single pointer.
+    ///
+    /// A default constructed memory owns a flat, zero initialised RAM
+    /// block. A memory built from an `Image` instead reads straight from
+    /// the shared image and only allocates a private copy of a page the
+    /// first time the guest writes to it. A sparse memory works the same
+    /// way, except that pages nobody wrote to read as zero.
+    ///
+    /// Pages written since the last `reset()` are tracked in a dirty
+    /// bitmap, so resetting only has to restore those pages (the first
+    /// reset to a different `Image` restores every page once). The first
+    /// write to a clean page takes the slow path to mark it dirty, every
+    /// later write to it is a plain store.
+    class Memory
+    {
+    public:
+        /// @brief Proxy returned by the non-const subscript operator so
+        /// that `mem[addr] = value` goes through the page table write path.
+        class Reference
+        {
+        public:
+            Reference(Memory& memory, std::uint16_t addr) : _memory{memory}, _addr{addr} {}
+
+            operator std::uint8_t() const
+            {
+                return _memory.read(_addr);
+            }
+
+            Reference& operator=(std::uint8_t value)
+            {
+                _memory.write(_addr, value);
+                return *this;
+            }
+
+            Reference& operator=(Reference const& other)
+            {
+                return *this = static_cast<std::uint8_t>(other);
+            }
+
+            Reference& operator++()
+            {
+                return *this = static_cast<std::uint8_t>(_memory.read(_addr) + 1);
+            }
+
+            std::uint8_t operator++(int)
+            {
+                auto const old = _memory.read(_addr);
+                ++(*this);
+                return old;
+            }
+
+            Reference& operator--()
+            {
+                return *this = static_cast<std::uint8_t>(_memory.read(_addr) - 1);
+            }
+
+            std::uint8_t operator--(int)
+            {
+                auto const old = _memory.read(_addr);
+                --(*this);
+                return old;
+            }
+
+        private:
+            Memory& _memory;
+            std::uint16_t _addr;
+        };
+
+        Memory() : _ram{std::make_unique<Ram>()}
+        {
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                _home[page] = &(*_ram)[page];
+                unmap(static_cast<std::uint8_t>(page));
+            }
+        }
+
+        /// @brief creates a flat memory on top of caller owned `storage`,
+        /// which must outlive the memory. The storage contents are used
+        /// as they are, they are not cleared.
+        explicit Memory(std::span<Page, page_count> storage)
+        {
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                _home[page] = &storage[page];
+                unmap(static_cast<std::uint8_t>(page));
+            }
+        }
+
+        /// @brief creates a memory backed by the shared `image`. Pages are
+        /// copied out of the image lazily, on the first guest write, and
+        /// taken from `pool`. Without one the memory owns a pool that
+        /// allocates a page at a time, so it only pays for the pages the
+        /// guest writes rather than a whole chunk up front.
+        explicit Memory(std::shared_ptr<Image const> image, std::shared_ptr<PagePool> pool = nullptr)
+            : _image{std::move(image)}, _pool{pool ? std::move(pool) : std::make_shared<PagePool>(1)}
+        {
+            if (!_image)
+            {
+                throw std::invalid_argument("memory image cannot be null");
+            }
+
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                unmap(static_cast<std::uint8_t>(page));
+            }
+        }
+
+        /// @brief creates a sparse memory. No page is backed until the
+        /// guest writes to it, at which point a zeroed page is taken from
+        /// `pool`. Constructing a sparse memory does not allocate.
+        explicit Memory(std::shared_ptr<PagePool> pool) : _pool{std::move(pool)}
+        {
+            if (!_pool)
+            {
+                throw std::invalid_argument("memory page pool cannot be null");
+            }
+
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                unmap(static_cast<std::uint8_t>(page));
+            }
+        }
+
+        /// @brief copies the contents and page mappings of `other`. Its
+        /// mappers are copied too, with the same bank selected, so the copy
+        /// never writes to nor switches the banks of `other`. Write traps
+        /// set with `trap_writes` are copied as they are.
+        Memory(Memory const& other);
+
+        Memory(Memory&& other) noexcept
+            : _read{other._read}, _write{other._write}, _home{std::exchange(other._home, {})}, _cow{other._cow},
+              _dirty{other._dirty}, _slow{other._slow}, _trapped{other._trapped}, _handlers{std::move(other._handlers)},
+              _mappers{std::move(other._mappers)}, _base{other._base}, _image{std::move(other._image)},
+              _pool{std::move(other._pool)}, _ram{std::move(other._ram)}
+        {
+        }
+
+        Memory& operator=(Memory const& other)
+        {
+            if (this != &other)
+            {
+                *this = Memory{other};
+            }
+            return *this;
+        }
+
+        Memory& operator=(Memory&& other) noexcept
+        {
+            if (this != &other)
+            {
+                release_pages();
+                _read     = other._read;
+                _write    = other._write;
+                _home     = std::exchange(other._home, {});
+                _cow      = other._cow;
+                _dirty    = other._dirty;
+                _slow     = other._slow;
+                _trapped  = other._trapped;
+                _handlers = std::move(other._handlers);
+                _mappers  = std::move(other._mappers);
+                _base     = other._base;
+                _image    = std::move(other._image);
+                _pool     = std::move(other._pool);
+                _ram      = std::move(other._ram);
+            }
+            return *this;
+        }
+
+        ~Memory()
+        {
+            release_pages();
+        }
+
+        [[nodiscard]] std::uint8_t read(std::size_t addr) const
+        {
+            auto const masked = addr & 0xffff;
+            return _read[masked >> 8][masked & 0xff];
+        }
+
+        void write(std::size_t addr, std::uint8_t value)
+        {
+            auto const masked = static_cast<std::uint16_t>(addr & 0xffff);
+            auto const page   = masked >> 8;
+            auto* const data  = _write[page];
+            if (data != nullptr && !_slow.test(page)) [[likely]]
+            {
+                data[masked & 0xff] = value;
+                return;
+            }
+
+            write_slow(masked, value);
+        }
+
+        std::uint8_t operator[](std::size_t addr) const
+        {
+            return read(addr);
+        }
+
+        Reference operator[](std::size_t addr)
+        {
+            return Reference{*this, static_cast<std::uint16_t>(addr & 0xffff)};
+        }
+
+        /// @brief points the given page at a writable buffer of at least
+        /// `page_size` bytes. The buffer must outlive the mapping.
+        void map(std::uint8_t page, std::uint8_t* data)
+        {
+            _read[page]  = data;
+            _write[page] = data;
+            _cow.reset(page);
+        }
+
+        /// @brief points the given page at a read-only buffer of at least
+        /// `page_size` bytes. Guest writes to the page are dropped.
+        void map_read_only(std::uint8_t page, std::uint8_t const* data)
+        {
+            _read[page]  = data;
+            _write[page] = nullptr;
+            _cow.reset(page);
+        }
+
+        /// @brief points the given page back at this memory's own storage,
+        /// i.e. its private copy if it has one, or the shared image.
+        void unmap(std::uint8_t page)
+        {
+            if (_home[page] != nullptr)
+            {
+                map(page, _home[page]->data());
+                return;
+            }
+
+            _read[page]  = _image ? _image->page(page) : _zero_page.data();
+            _write[page] = nullptr;
+            _cow.set(page);
+        }
+
+        /// @brief calls `handler` instead of storing the value whenever
+        /// the guest writes to `addr`. Other addresses in the same page
+        /// keep working as normal memory, but take the slow write path.
+        void trap_writes(std::uint16_t addr, WriteHandler handler)
+        {
+            _handlers.emplace_back(addr, std::move(handler));
+            _trapped.set(addr >> 8);
+            _slow.set(addr >> 8);
+        }
+
+        /// @brief installs `mapper` on this memory, see `attach_mapper`
+        void attach(std::shared_ptr<Mapper> mapper);
+
+        /// @brief removes every write trap and points every page back at
+        /// this memory's own storage, undoing any mapper
+        void unmap_all()
+        {
+            _handlers.clear();
+            _mappers.clear();
+            _trapped.reset();
+            _slow = ~_dirty;
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                unmap(static_cast<std::uint8_t>(page));
+            }
+        }
+
+        /// @brief restores every page written since the last reset to
+        /// its initial contents: the shared image for image backed
+        /// memories, zeros otherwise. Image backed and sparse memories
+        /// hand the written pages back to the pool. Page mappings and
+        /// write traps are kept.
+        void reset()
+        {
+            restore(nullptr);
+        }
+
+        /// @brief restores the memory to the contents of `base`, e.g. the
+        /// program image a job starts from. Only the pages written since
+        /// the last reset are restored when the last reset was to the same
+        /// `base`, otherwise every page that differs from it is. Pages that
+        /// match the initial contents go back to the pool, like `reset()`.
+        void reset(Image const& base)
+        {
+            restore(&base);
+        }
+
+        /// @brief number of pages written to since the last reset
+        [[nodiscard]] std::size_t dirty_pages() const
+        {
+            return _dirty.count();
+        }
+
+        /// @brief whether the given page was written to since the last reset
+        [[nodiscard]] bool is_dirty(std::size_t page) const
+        {
+            return _dirty.test(page);
+        }
+
+        /// @brief the bytes the guest currently reads from the given page
+        [[nodiscard]] std::span<const std::uint8_t, page_size> page(std::size_t page) const
+        {
+            return std::span<const std::uint8_t, page_size>{_read[page], page_size};
+        }
+
+        /// @brief number of pages this memory holds a private copy of.
+        /// For a flat memory this is always `page_count`.
+        [[nodiscard]] std::size_t private_pages() const
+        {
+            return static_cast<std::size_t>(std::ranges::count_if(_home, [](auto* home) { return home != nullptr; }));
+        }
+
+    private:
+        using Ram = std::array<Page, page_count>;
+
+        void write_slow(std::uint16_t addr, std::uint8_t value)
+        {
+            auto const page = addr >> 8;
+            if (_trapped.test(page))
+            {
+                for (auto& [trapped_addr, handler] : _handlers)
+                {
+                    if (trapped_addr == addr)
+                    {
+                        handler(*this, addr, value);
+                        return;
+                    }
+                }
+
+                if (write_mapper(addr, value))
+                {
+                    return;
+                }
+            }
+
+            if (_cow.test(page))
+            {
+                make_private(page);
+            }
+
+            // Read-only pages silently ignore writes, like a real ROM
+            if (auto* const data = _write[page]; data != nullptr)
+            {
+                data[addr & 0xff] = value;
+                _dirty.set(page);
+                if (!_trapped.test(page))
+                {
+                    _slow.reset(page);
+                }
+            }
+        }
+
+        /// @brief switches the bank of the mapper whose control register
+        /// is `addr`, if there is one
+        bool write_mapper(std::uint16_t addr, std::uint8_t value);
+
+        /// @brief brings the memory back to `base`, or to its initial
+        /// contents for a null `base`. Clean pages already hold the
+        /// contents of the last reset, so only the dirty ones are restored
+        /// unless `base` changed since.
+        void restore(Image const* base)
+        {
+            auto const base_id    = base ? base->id() : 0;
+            auto const every_page = base_id != _base;
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                if (!every_page && (!_dirty.test(page) || _home[page] == nullptr))
+                {
+                    continue;
+                }
+
+                auto const* const initial = _image ? _image->page(page) : _zero_page.data();
+                auto const* const wanted  = base ? base->page(page) : initial;
+                if (paged() && (wanted == initial || std::equal(wanted, wanted + page_size, initial)))
+                {
+                    release_page(page);
+                    continue;
+                }
+
+                if (_home[page] == nullptr)
+                {
+                    _home[page] = _pool->acquire();
+                    if (_cow.test(page))
+                    {
+                        map(static_cast<std::uint8_t>(page), _home[page]->data());
+                    }
+                }
+                std::copy_n(wanted, page_size, _home[page]->data());
+            }
+            _base = base_id;
+            clear_dirty();
+        }
+
+        /// @brief hands the private copy of a page back to the pool, the
+        /// page then reads from the shared image or zeros again
+        void release_page(std::size_t page)
+        {
+            auto* const home = std::exchange(_home[page], nullptr);
+            if (home == nullptr)
+            {
+                return;
+            }
+
+            if (_read[page] == home->data())
+            {
+                unmap(static_cast<std::uint8_t>(page));
+            }
+            _pool->release(home);
+        }
+
+        void clear_dirty()
+        {
+            _dirty.reset();
+            _slow.set();
+        }
+
+        /// @brief whether pages are private copies taken from the pool,
+        /// rather than slices of one flat block
+        [[nodiscard]] bool paged() const
+        {
+            return !_ram && _pool;
+        }
+
+        /// @brief gives the page its own copy of what it currently reads,
+        /// i.e. the shared image contents or zeros
+        void make_private(std::size_t page)
+        {
+            auto* const data = _pool->acquire();
+            std::copy_n(_read[page], page_size, data->data());
+            _home[page] = data;
+            map(static_cast<std::uint8_t>(page), data->data());
+        }
+
+        /// @brief hands the private pages back to the pool, the flat RAM
+        /// block is simply freed with the object and caller owned storage
+        /// is left alone
+        void release_pages()
+        {
+            if (!paged())
+            {
+                return;
+            }
+
+            for (auto* home : _home)
+            {
+                if (home != nullptr)
+                {
+                    _pool->release(home);
+                }
+            }
+            _home = {};
+        }
+
+        /// backing of every page a sparse memory has not written to yet
+        static constexpr Page _zero_page{};
+
+        std::array<std::uint8_t const*, page_count> _read{};
+        std::array<std::uint8_t*, page_count> _write{};
+
+        /// private storage of each page, null while it still reads from the image
+        std::array<Page*, page_count> _home{};
+
+        /// pages that read from the shared image and must be copied on write
+        std::bitset<page_count> _cow{};
+
+        /// pages written to since the last reset
+        std::bitset<page_count> _dirty{};
+
+        /// pages whose writes must take the slow path, i.e. clean or trapped pages
+        std::bitset<page_count> _slow{~std::bitset<page_count>{}};
+
+        std::bitset<page_count> _trapped{};
+        std::vector<std::pair<std::uint16_t, WriteHandler>> _handlers{};
+        std::vector<std::shared_ptr<Mapper>> _mappers{};
+        /// id of the image the last reset restored to, zero for the
+        /// initial contents. An id, not a pointer, since another image may
+        /// later be built where that one was.
+        std::uint64_t _base{0};
+
+        std::shared_ptr<Image const> _image;
+        std::shared_ptr<PagePool> _pool;
+        std::unique_ptr<Ram> _ram;
+    };
+
+    /// @brief Size of the address space window a mapper swaps banks into
+    enum class BankSize : std::size_t
+    {
+        KiB4 = 0x1000,
+        KiB8 = 0x2000,
+    };
+
+    /// @brief Configuration for a bank switched window
+    struct BankConfig
+    {
+        /// first address of the window, must be aligned to the bank size
+        std::uint16_t window;
+
+        /// size of the window and of each bank in the backing store
+        BankSize size;
+
+        /// writing a bank number to this address switches banks
+        std::uint16_t control;
+
+        /// whether the banks are RAM (true) or ROM (false)
+        bool writable;
+    };
+
+    /// @brief Maps banks of a backing store larger than 64 KiB into
+    /// a window of the cpu address space. Selecting a bank only
+    /// rewrites the page table entries covering the window, the
+    /// bank contents are never copied.
+    class Mapper
+    {
+    public:
+        Mapper(BankConfig config, std::vector<std::uint8_t> store) : _config{config}, _store{std::move(store)}
+        {
+            auto const size = static_cast<std::size_t>(_config.size);
+            if (_config.window % size != 0 || _config.window + size > address_space_size)
+            {
+                throw std::invalid_argument("mapper window is not aligned to the bank size");
+            }
+
+            if (_store.empty() || _store.size() % size != 0)
+            {
+                throw std::invalid_argument("mapper store is not a whole number of banks");
+            }
+        }
+
+        [[nodiscard]] std::size_t bank_count() const
+        {
+            return _store.size() / static_cast<std::size_t>(_config.size);
+        }
+
+        [[nodiscard]] std::size_t current_bank() const
+        {
+            return _bank;
+        }
+
+        [[nodiscard]] BankConfig const& config() const
+        {
+            return _config;
+        }
+
+        /// @brief switches the window to the given bank, wrapping around
+        /// the number of banks available.
+        void select(Memory& memory, std::size_t bank)
+        {
+            auto const size = static_cast<std::size_t>(_config.size);
+            _bank           = bank % bank_count();
+
+            auto* const base       = _store.data() + (_bank * size);
+            auto const first_page  = _config.window >> 8;
+            auto const pages_count = size / page_size;
+            for (std::size_t i = 0; i < pages_count; ++i)
+            {
+                auto const page = static_cast<std::uint8_t>(first_page + i);
+                if (_config.writable)
+                {
+                    memory.map(page, base + (i * page_size));
+                }
+                else
+                {
+                    memory.map_read_only(page, base + (i * page_size));
+                }
+            }
+        }
+
+    private:
+        BankConfig _config;
+        std::vector<std::uint8_t> _store;
+        std::size_t _bank{0};
+    };
+
+    Memory::Memory(Memory const& other)
+        : _read{other._read}, _write{other._write}, _cow{other._cow}, _dirty{other._dirty}, _slow{other._slow},
+          _trapped{other._trapped},
+          _handlers{other._handlers}, _base{other._base}, _image{other._image}, _pool{other._pool}
+    {
+        // A copy of a flat memory always owns its RAM, even if the
+        // original lives on caller owned storage
+        if (other._ram || !other._pool)
+        {
+            _ram = std::make_unique<Ram>();
+        }
+
+        for (std::size_t page = 0; page < page_count; ++page)
+        {
+            auto const* const theirs = other._home[page];
+            if (theirs == nullptr)
+            {
+                continue;
+            }
+
+            _home[page]  = _ram ? &(*_ram)[page] : _pool->acquire();
+            *_home[page] = *theirs;
+
+            // Pages mapped onto the other object's storage must point at our copy
+            if (_read[page] == theirs->data())
+            {
+                _read[page] = _home[page]->data();
+            }
+            if (_write[page] == theirs->data())
+            {
+                _write[page] = _home[page]->data();
+            }
+        }
+
+        for (auto const& mapper : other._mappers)
+        {
+            attach(std::make_shared<Mapper>(*mapper));
+        }
+    }
+
+    void Memory::attach(std::shared_ptr<Mapper> mapper)
+    {
+        auto const control = mapper->config().control;
+        mapper->select(*this, mapper->current_bank());
+        _trapped.set(control >> 8);
+        _slow.set(control >> 8);
+        _mappers.push_back(std::move(mapper));
+    }
+
+    bool Memory::write_mapper(std::uint16_t addr, std::uint8_t value)
+    {
+        for (auto const& mapper : _mappers)
+        {
+            if (mapper->config().control == addr)
+            {
+                mapper->select(*this, value);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief installs the mapper on the given memory. Its current bank
+    /// (bank 0 for a new mapper) is mapped straight away and the control
+    /// register is trapped so that guest writes to it switch banks.
+    void attach_mapper(Memory& memory, std::shared_ptr<Mapper> mapper)
+    {
+        memory.attach(std::move(mapper));
+    }
+} // namespace emulator
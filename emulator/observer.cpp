@@ -0,0 +1,374 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+export module emulator:observer;
+
+import :opcodes;
+import profiler;
+
+export namespace emulator
+{
+    /// @brief Instrumentation plugged into `run(cpu, program, max_cycles,
+    /// observer)` at compile time. For every instruction the hooks are
+    /// called in this order:
+    ///
+    ///  - `on_mem_read(addr, value)` before it runs, for each byte it reads
+    ///  - `on_fetch(pc, opcode)` right before it runs, if the observer has
+    ///    that hook (see `FetchObserver`)
+    ///  - `on_mem_write(addr, value)` after it ran, for each byte it wrote
+    ///  - `on_branch(from, to, taken)` after a branch or jump
+    ///  - `on_instruction(pc, opcode, cycles)` last
+    ///
+    /// Only operands and stack bytes are reported as memory accesses, not
+    /// the pointers the indirect modes fetch on the way to the operand.
+    /// The value given to `on_mem_write` is what the address holds once
+    /// the instruction ran: for a read-only or trapped address (e.g. a
+    /// mapper control register) that is not the byte the guest stored.
+    template <typename T>
+    concept Observer = requires(T observer, std::uint16_t addr, std::uint8_t value, std::size_t cycles, bool taken) {
+        observer.on_instruction(addr, value, cycles);
+        observer.on_mem_read(addr, value);
+        observer.on_mem_write(addr, value);
+        observer.on_branch(addr, addr, taken);
+    };
+
+    /// @brief Observes nothing, and costs nothing: runs with it compile
+    /// to the same loop as a plain `run`. Observers derive from it to
+    /// only write the hooks they need.
+    struct NullObserver
+    {
+        void on_instruction(std::uint16_t /* pc */, std::uint8_t /* opcode */, std::size_t /* cycles */) {}
+        void on_mem_read(std::uint16_t /* addr */, std::uint8_t /* value */) {}
+        void on_mem_write(std::uint16_t /* addr */, std::uint8_t /* value */) {}
+        void on_branch(std::uint16_t /* from */, std::uint16_t /* to */, bool /* taken */) {}
+    };
+
+    /// @brief observers with their own memory hooks, i.e. that need the
+    /// memory accesses of each instruction worked out
+    template <typename T>
+    concept MemoryObserver = Observer<T>
+                             && !(std::same_as<decltype(&T::on_mem_read), decltype(&NullObserver::on_mem_read)>
+                                  && std::same_as<decltype(&T::on_mem_write), decltype(&NullObserver::on_mem_write)>);
+
+    /// @brief observers with their own branch hook
+    template <typename T>
+    concept BranchObserver =
+        Observer<T> && !std::same_as<decltype(&T::on_branch), decltype(&NullObserver::on_branch)>;
+
+    /// @brief observers told about each instruction right before it runs,
+    /// e.g. to time it
+    template <typename T>
+    concept FetchObserver = Observer<T> && requires(T observer, std::uint16_t pc, std::uint8_t opcode) {
+        observer.on_fetch(pc, opcode);
+    };
+
+    /// @brief Which guest addresses were executed, and which branches
+    /// went both ways
+    class Coverage : public NullObserver
+    {
+    public:
+        void on_instruction(std::uint16_t pc, std::uint8_t /* opcode */, std::size_t /* cycles */)
+        {
+            _executed.set(pc);
+        }
+
+        void on_branch(std::uint16_t from, std::uint16_t /* to */, bool taken)
+        {
+            (taken ? _taken : _not_taken).set(from);
+        }
+
+        [[nodiscard]] bool executed(std::uint16_t addr) const
+        {
+            return _executed.test(addr);
+        }
+
+        /// @brief number of distinct instruction addresses executed
+        [[nodiscard]] std::size_t instructions() const
+        {
+            return _executed.count();
+        }
+
+        /// @brief whether the branch at `addr` was both taken and not taken
+        [[nodiscard]] bool both_ways(std::uint16_t addr) const
+        {
+            return _taken.test(addr) && _not_taken.test(addr);
+        }
+
+    private:
+        std::bitset<0x10000> _executed;
+        std::bitset<0x10000> _taken;
+        std::bitset<0x10000> _not_taken;
+    };
+
+    /// @brief an opcode or address, and how many times it was executed
+    struct HotCount
+    {
+        std::uint16_t key;
+        std::uint64_t count;
+    };
+
+    /// @brief Exact counts of the instructions executed, per opcode and
+    /// per address. Counting is a couple of increments per instruction,
+    /// and the hottest entries are written to a fixed size array the
+    /// caller owns, so a UI can watch them live without allocating.
+    class ExecutionCounts : public NullObserver
+    {
+    public:
+        ExecutionCounts() : _addresses(0x10000, 0) {}
+
+        void on_instruction(std::uint16_t pc, std::uint8_t opcode, std::size_t cycles)
+        {
+            ++_opcodes[opcode];
+            ++_addresses[pc];
+            ++_instructions;
+            _cycles += cycles;
+        }
+
+        [[nodiscard]] std::uint64_t instructions() const
+        {
+            return _instructions;
+        }
+
+        /// @brief cycles charged to the run budget
+        [[nodiscard]] std::uint64_t cycles() const
+        {
+            return _cycles;
+        }
+
+        /// @brief fills `hottest` with the most executed opcodes, hottest
+        /// first, and returns how many entries it filled
+        template <std::size_t N>
+        std::size_t hottest_opcodes(std::array<HotCount, N>& hottest) const
+        {
+            return keep_hottest(_opcodes, hottest);
+        }
+
+        /// @brief same as `hottest_opcodes`, for instruction addresses
+        template <std::size_t N>
+        std::size_t hottest_addresses(std::array<HotCount, N>& hottest) const
+        {
+            return keep_hottest(_addresses, hottest);
+        }
+
+        void reset()
+        {
+            _opcodes.fill(0);
+            std::ranges::fill(_addresses, 0);
+            _instructions = 0;
+            _cycles       = 0;
+        }
+
+    private:
+        /// a single pass keeping the top `N` in order, by insertion
+        template <std::size_t N>
+        static std::size_t keep_hottest(std::span<std::uint64_t const> counts, std::array<HotCount, N>& hottest)
+        {
+            std::size_t filled = 0;
+            for (std::size_t key = 0; key < counts.size(); ++key)
+            {
+                auto const count = counts[key];
+                if (count == 0 || (filled == N && count <= hottest[N - 1].count))
+                {
+                    continue;
+                }
+
+                auto slot = filled < N ? filled++ : N - 1;
+                for (; slot > 0 && hottest[slot - 1].count < count; --slot)
+                {
+                    hottest[slot] = hottest[slot - 1];
+                }
+                hottest[slot] = HotCount{.key = static_cast<std::uint16_t>(key), .count = count};
+            }
+            return filled;
+        }
+
+        std::array<std::uint64_t, 256> _opcodes{};
+        std::vector<std::uint64_t> _addresses;
+        std::uint64_t _instructions{0};
+        std::uint64_t _cycles{0};
+    };
+
+    /// @brief What an opcode profiler measured for one opcode, in host
+    /// ticks (the TSC on x86-64, see `profiler::ticks`)
+    struct OpcodeProfile
+    {
+        std::uint8_t opcode;
+        std::string name;
+        std::uint64_t count;
+        std::uint64_t ticks;
+        std::uint64_t min_ticks;
+        std::uint64_t max_ticks;
+    };
+
+    /// @brief the opcodes `counters` saw, most expensive first. The
+    /// opcode names are only looked up here, never while running.
+    std::vector<OpcodeProfile> opcode_report(profiler::OpcodeCounters const& counters)
+    {
+        std::vector<OpcodeProfile> profile;
+        for (std::size_t opcode = 0; opcode < counters.size(); ++opcode)
+        {
+            auto const& stats = counters[static_cast<std::uint8_t>(opcode)];
+            if (stats.count == 0)
+            {
+                continue;
+            }
+
+            profile.push_back(OpcodeProfile{
+                .opcode    = static_cast<std::uint8_t>(opcode),
+                .name      = opcode_name(static_cast<std::uint8_t>(opcode)),
+                .count     = stats.count,
+                .ticks     = stats.total,
+                .min_ticks = stats.min,
+                .max_ticks = stats.max,
+            });
+        }
+
+        std::ranges::sort(profile, std::ranges::greater{}, &OpcodeProfile::ticks);
+        return profile;
+    }
+
+    /// @brief Host ticks spent in each opcode, read with `profiler::ticks`
+    /// around every instruction and counted in a fixed 256 entry array
+    class OpcodeProfiler : public NullObserver
+    {
+    public:
+        void on_fetch(std::uint16_t /* pc */, std::uint8_t /* opcode */)
+        {
+            _start = profiler::ticks();
+        }
+
+        void on_instruction(std::uint16_t /* pc */, std::uint8_t opcode, std::size_t /* cycles */)
+        {
+            _counters.record(opcode, profiler::ticks() - _start);
+        }
+
+        [[nodiscard]] profiler::OpcodeCounters const& counters() const
+        {
+            return _counters;
+        }
+
+        /// @brief the opcodes executed so far, most expensive first
+        [[nodiscard]] std::vector<OpcodeProfile> report() const
+        {
+            return opcode_report(_counters);
+        }
+
+    private:
+        profiler::OpcodeCounters _counters;
+        std::uint64_t _start{0};
+    };
+
+    /// @brief Same as `OpcodeProfiler`, recording into per thread books
+    /// shared with the profilers of other cpus, to report on all of them
+    /// together (see `profiler::ProfileBooks`)
+    class SharedOpcodeProfiler : public NullObserver
+    {
+    public:
+        explicit SharedOpcodeProfiler(profiler::ProfileBooks& books) : _books{&books} {}
+
+        void on_fetch(std::uint16_t /* pc */, std::uint8_t /* opcode */)
+        {
+            _start = profiler::ticks();
+        }
+
+        void on_instruction(std::uint16_t /* pc */, std::uint8_t opcode, std::size_t /* cycles */)
+        {
+            _books->record(opcode, profiler::ticks() - _start);
+        }
+
+    private:
+        profiler::ProfileBooks* _books;
+        std::uint64_t _start{0};
+    };
+
+#ifdef __linux__
+    /// @brief Attributes host performance counters to each opcode, see
+    /// `profiler::PerfOpcodeCounters`
+    class PerfOpcodeProfiler : public NullObserver
+    {
+    public:
+        explicit PerfOpcodeProfiler(profiler::PerfOpcodeCounters& counters) : _counters{&counters} {}
+
+        void on_fetch(std::uint16_t /* pc */, std::uint8_t /* opcode */)
+        {
+            _start = _counters->start();
+        }
+
+        void on_instruction(std::uint16_t /* pc */, std::uint8_t opcode, std::size_t /* cycles */)
+        {
+            _counters->record(opcode, _start);
+        }
+
+    private:
+        profiler::PerfOpcodeCounters* _counters;
+        profiler::PerfCounters::Values _start{};
+    };
+#endif // __linux__
+
+    struct WatchHit
+    {
+        /// address of the instruction that made the access
+        std::uint16_t pc;
+        std::uint16_t addr;
+        std::uint8_t value;
+        bool write;
+    };
+
+    /// @brief Records every read and write of the watched addresses
+    class Watchpoints : public NullObserver
+    {
+    public:
+        void watch(std::uint16_t addr)
+        {
+            _watched.set(addr);
+        }
+
+        void on_mem_read(std::uint16_t addr, std::uint8_t value)
+        {
+            hit(addr, value, false);
+        }
+
+        void on_mem_write(std::uint16_t addr, std::uint8_t value)
+        {
+            hit(addr, value, true);
+        }
+
+        /// The access hooks come before the instruction hook, so the hits
+        /// are only given their instruction address here
+        void on_instruction(std::uint16_t pc, std::uint8_t /* opcode */, std::size_t /* cycles */)
+        {
+            for (; _pending < _hits.size(); ++_pending)
+            {
+                _hits[_pending].pc = pc;
+            }
+        }
+
+        [[nodiscard]] std::vector<WatchHit> const& hits() const
+        {
+            return _hits;
+        }
+
+    private:
+        void hit(std::uint16_t addr, std::uint8_t value, bool write)
+        {
+            if (_watched.test(addr))
+            {
+                _hits.push_back(WatchHit{.pc = 0, .addr = addr, .value = value, .write = write});
+            }
+        }
+
+        std::bitset<0x10000> _watched;
+        std::vector<WatchHit> _hits;
+        std::size_t _pending{0};
+    };
+} // namespace emulator
@@ -0,0 +1,414 @@
+module;
+
+#include <fmt/format.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+export module emulator:opcodes;
+
+export namespace emulator
+{
+    enum class AddressingMode : std::uint8_t
+    {
+        Implied,
+        Accumulator,
+        Immediate,
+        ZeroPage,
+        ZeroPageX,
+        ZeroPageY,
+        Absolute,
+        AbsoluteX,
+        AbsoluteY,
+        Indirect,
+        IndexedIndirect,
+        IndirectIndexed,
+        Relative,
+    };
+
+    /// @brief What a 6502 opcode is, regardless of whether the emulator
+    /// supports it yet. Used to name opcodes in reports and traces, never
+    /// on the execution path.
+    struct OpcodeInfo
+    {
+        std::string_view mnemonic{"???"};
+        AddressingMode mode{AddressingMode::Implied};
+    };
+
+    /// @brief size in bytes of an instruction using the given addressing
+    /// mode, opcode included
+    constexpr std::size_t instruction_size(AddressingMode mode)
+    {
+        switch (mode)
+        {
+        case AddressingMode::Implied:
+        case AddressingMode::Accumulator:
+            return 1;
+        case AddressingMode::Absolute:
+        case AddressingMode::AbsoluteX:
+        case AddressingMode::AbsoluteY:
+        case AddressingMode::Indirect:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
+    /// @brief the documented NMOS 6502 opcodes, undocumented ones are "???"
+    constexpr std::array<OpcodeInfo, 256> make_opcode_table()
+    {
+        std::array<OpcodeInfo, 256> table{};
+
+        table[0x61] = {.mnemonic = "ADC", .mode = AddressingMode::IndexedIndirect};
+        table[0x65] = {.mnemonic = "ADC", .mode = AddressingMode::ZeroPage};
+        table[0x69] = {.mnemonic = "ADC", .mode = AddressingMode::Immediate};
+        table[0x6d] = {.mnemonic = "ADC", .mode = AddressingMode::Absolute};
+        table[0x71] = {.mnemonic = "ADC", .mode = AddressingMode::IndirectIndexed};
+        table[0x75] = {.mnemonic = "ADC", .mode = AddressingMode::ZeroPageX};
+        table[0x79] = {.mnemonic = "ADC", .mode = AddressingMode::AbsoluteY};
+        table[0x7d] = {.mnemonic = "ADC", .mode = AddressingMode::AbsoluteX};
+
+        table[0x21] = {.mnemonic = "AND", .mode = AddressingMode::IndexedIndirect};
+        table[0x25] = {.mnemonic = "AND", .mode = AddressingMode::ZeroPage};
+        table[0x29] = {.mnemonic = "AND", .mode = AddressingMode::Immediate};
+        table[0x2d] = {.mnemonic = "AND", .mode = AddressingMode::Absolute};
+        table[0x31] = {.mnemonic = "AND", .mode = AddressingMode::IndirectIndexed};
+        table[0x35] = {.mnemonic = "AND", .mode = AddressingMode::ZeroPageX};
+        table[0x39] = {.mnemonic = "AND", .mode = AddressingMode::AbsoluteY};
+        table[0x3d] = {.mnemonic = "AND", .mode = AddressingMode::AbsoluteX};
+
+        table[0x06] = {.mnemonic = "ASL", .mode = AddressingMode::ZeroPage};
+        table[0x0a] = {.mnemonic = "ASL", .mode = AddressingMode::Accumulator};
+        table[0x0e] = {.mnemonic = "ASL", .mode = AddressingMode::Absolute};
+        table[0x16] = {.mnemonic = "ASL", .mode = AddressingMode::ZeroPageX};
+        table[0x1e] = {.mnemonic = "ASL", .mode = AddressingMode::AbsoluteX};
+
+        table[0x90] = {.mnemonic = "BCC", .mode = AddressingMode::Relative};
+
+        table[0xb0] = {.mnemonic = "BCS", .mode = AddressingMode::Relative};
+
+        table[0xf0] = {.mnemonic = "BEQ", .mode = AddressingMode::Relative};
+
+        table[0x24] = {.mnemonic = "BIT", .mode = AddressingMode::ZeroPage};
+        table[0x2c] = {.mnemonic = "BIT", .mode = AddressingMode::Absolute};
+
+        table[0x30] = {.mnemonic = "BMI", .mode = AddressingMode::Relative};
+
+        table[0xd0] = {.mnemonic = "BNE", .mode = AddressingMode::Relative};
+
+        table[0x10] = {.mnemonic = "BPL", .mode = AddressingMode::Relative};
+
+        table[0x00] = {.mnemonic = "BRK", .mode = AddressingMode::Implied};
+
+        table[0x50] = {.mnemonic = "BVC", .mode = AddressingMode::Relative};
+
+        table[0x70] = {.mnemonic = "BVS", .mode = AddressingMode::Relative};
+
+        table[0x18] = {.mnemonic = "CLC", .mode = AddressingMode::Implied};
+
+        table[0xd8] = {.mnemonic = "CLD", .mode = AddressingMode::Implied};
+
+        table[0x58] = {.mnemonic = "CLI", .mode = AddressingMode::Implied};
+
+        table[0xb8] = {.mnemonic = "CLV", .mode = AddressingMode::Implied};
+
+        table[0xc1] = {.mnemonic = "CMP", .mode = AddressingMode::IndexedIndirect};
+        table[0xc5] = {.mnemonic = "CMP", .mode = AddressingMode::ZeroPage};
+        table[0xc9] = {.mnemonic = "CMP", .mode = AddressingMode::Immediate};
+        table[0xcd] = {.mnemonic = "CMP", .mode = AddressingMode::Absolute};
+        table[0xd1] = {.mnemonic = "CMP", .mode = AddressingMode::IndirectIndexed};
+        table[0xd5] = {.mnemonic = "CMP", .mode = AddressingMode::ZeroPageX};
+        table[0xd9] = {.mnemonic = "CMP", .mode = AddressingMode::AbsoluteY};
+        table[0xdd] = {.mnemonic = "CMP", .mode = AddressingMode::AbsoluteX};
+
+        table[0xe0] = {.mnemonic = "CPX", .mode = AddressingMode::Immediate};
+        table[0xe4] = {.mnemonic = "CPX", .mode = AddressingMode::ZeroPage};
+        table[0xec] = {.mnemonic = "CPX", .mode = AddressingMode::Absolute};
+
+        table[0xc0] = {.mnemonic = "CPY", .mode = AddressingMode::Immediate};
+        table[0xc4] = {.mnemonic = "CPY", .mode = AddressingMode::ZeroPage};
+        table[0xcc] = {.mnemonic = "CPY", .mode = AddressingMode::Absolute};
+
+        table[0xc6] = {.mnemonic = "DEC", .mode = AddressingMode::ZeroPage};
+        table[0xce] = {.mnemonic = "DEC", .mode = AddressingMode::Absolute};
+        table[0xd6] = {.mnemonic = "DEC", .mode = AddressingMode::ZeroPageX};
+        table[0xde] = {.mnemonic = "DEC", .mode = AddressingMode::AbsoluteX};
+
+        table[0xca] = {.mnemonic = "DEX", .mode = AddressingMode::Implied};
+
+        table[0x88] = {.mnemonic = "DEY", .mode = AddressingMode::Implied};
+
+        table[0x41] = {.mnemonic = "EOR", .mode = AddressingMode::IndexedIndirect};
+        table[0x45] = {.mnemonic = "EOR", .mode = AddressingMode::ZeroPage};
+        table[0x49] = {.mnemonic = "EOR", .mode = AddressingMode::Immediate};
+        table[0x4d] = {.mnemonic = "EOR", .mode = AddressingMode::Absolute};
+        table[0x51] = {.mnemonic = "EOR", .mode = AddressingMode::IndirectIndexed};
+        table[0x55] = {.mnemonic = "EOR", .mode = AddressingMode::ZeroPageX};
+        table[0x59] = {.mnemonic = "EOR", .mode = AddressingMode::AbsoluteY};
+        table[0x5d] = {.mnemonic = "EOR", .mode = AddressingMode::AbsoluteX};
+
+        table[0xe6] = {.mnemonic = "INC", .mode = AddressingMode::ZeroPage};
+        table[0xee] = {.mnemonic = "INC", .mode = AddressingMode::Absolute};
+        table[0xf6] = {.mnemonic = "INC", .mode = AddressingMode::ZeroPageX};
+        table[0xfe] = {.mnemonic = "INC", .mode = AddressingMode::AbsoluteX};
+
+        table[0xe8] = {.mnemonic = "INX", .mode = AddressingMode::Implied};
+
+        table[0xc8] = {.mnemonic = "INY", .mode = AddressingMode::Implied};
+
+        table[0x4c] = {.mnemonic = "JMP", .mode = AddressingMode::Absolute};
+        table[0x6c] = {.mnemonic = "JMP", .mode = AddressingMode::Indirect};
+
+        table[0x20] = {.mnemonic = "JSR", .mode = AddressingMode::Absolute};
+
+        table[0xa1] = {.mnemonic = "LDA", .mode = AddressingMode::IndexedIndirect};
+        table[0xa5] = {.mnemonic = "LDA", .mode = AddressingMode::ZeroPage};
+        table[0xa9] = {.mnemonic = "LDA", .mode = AddressingMode::Immediate};
+        table[0xad] = {.mnemonic = "LDA", .mode = AddressingMode::Absolute};
+        table[0xb1] = {.mnemonic = "LDA", .mode = AddressingMode::IndirectIndexed};
+        table[0xb5] = {.mnemonic = "LDA", .mode = AddressingMode::ZeroPageX};
+        table[0xb9] = {.mnemonic = "LDA", .mode = AddressingMode::AbsoluteY};
+        table[0xbd] = {.mnemonic = "LDA", .mode = AddressingMode::AbsoluteX};
+
+        table[0xa2] = {.mnemonic = "LDX", .mode = AddressingMode::Immediate};
+        table[0xa6] = {.mnemonic = "LDX", .mode = AddressingMode::ZeroPage};
+        table[0xae] = {.mnemonic = "LDX", .mode = AddressingMode::Absolute};
+        table[0xb6] = {.mnemonic = "LDX", .mode = AddressingMode::ZeroPageY};
+        table[0xbe] = {.mnemonic = "LDX", .mode = AddressingMode::AbsoluteY};
+
+        table[0xa0] = {.mnemonic = "LDY", .mode = AddressingMode::Immediate};
+        table[0xa4] = {.mnemonic = "LDY", .mode = AddressingMode::ZeroPage};
+        table[0xac] = {.mnemonic = "LDY", .mode = AddressingMode::Absolute};
+        table[0xb4] = {.mnemonic = "LDY", .mode = AddressingMode::ZeroPageX};
+        table[0xbc] = {.mnemonic = "LDY", .mode = AddressingMode::AbsoluteX};
+
+        table[0x46] = {.mnemonic = "LSR", .mode = AddressingMode::ZeroPage};
+        table[0x4a] = {.mnemonic = "LSR", .mode = AddressingMode::Accumulator};
+        table[0x4e] = {.mnemonic = "LSR", .mode = AddressingMode::Absolute};
+        table[0x56] = {.mnemonic = "LSR", .mode = AddressingMode::ZeroPageX};
+        table[0x5e] = {.mnemonic = "LSR", .mode = AddressingMode::AbsoluteX};
+
+        table[0xea] = {.mnemonic = "NOP", .mode = AddressingMode::Implied};
+
+        table[0x01] = {.mnemonic = "ORA", .mode = AddressingMode::IndexedIndirect};
+        table[0x05] = {.mnemonic = "ORA", .mode = AddressingMode::ZeroPage};
+        table[0x09] = {.mnemonic = "ORA", .mode = AddressingMode::Immediate};
+        table[0x0d] = {.mnemonic = "ORA", .mode = AddressingMode::Absolute};
+        table[0x11] = {.mnemonic = "ORA", .mode = AddressingMode::IndirectIndexed};
+        table[0x15] = {.mnemonic = "ORA", .mode = AddressingMode::ZeroPageX};
+        table[0x19] = {.mnemonic = "ORA", .mode = AddressingMode::AbsoluteY};
+        table[0x1d] = {.mnemonic = "ORA", .mode = AddressingMode::AbsoluteX};
+
+        table[0x48] = {.mnemonic = "PHA", .mode = AddressingMode::Implied};
+
+        table[0x08] = {.mnemonic = "PHP", .mode = AddressingMode::Implied};
+
+        table[0x68] = {.mnemonic = "PLA", .mode = AddressingMode::Implied};
+
+        table[0x28] = {.mnemonic = "PLP", .mode = AddressingMode::Implied};
+
+        table[0x26] = {.mnemonic = "ROL", .mode = AddressingMode::ZeroPage};
+        table[0x2a] = {.mnemonic = "ROL", .mode = AddressingMode::Accumulator};
+        table[0x2e] = {.mnemonic = "ROL", .mode = AddressingMode::Absolute};
+        table[0x36] = {.mnemonic = "ROL", .mode = AddressingMode::ZeroPageX};
+        table[0x3e] = {.mnemonic = "ROL", .mode = AddressingMode::AbsoluteX};
+
+        table[0x66] = {.mnemonic = "ROR", .mode = AddressingMode::ZeroPage};
+        table[0x6a] = {.mnemonic = "ROR", .mode = AddressingMode::Accumulator};
+        table[0x6e] = {.mnemonic = "ROR", .mode = AddressingMode::Absolute};
+        table[0x76] = {.mnemonic = "ROR", .mode = AddressingMode::ZeroPageX};
+        table[0x7e] = {.mnemonic = "ROR", .mode = AddressingMode::AbsoluteX};
+
+        table[0x40] = {.mnemonic = "RTI", .mode = AddressingMode::Implied};
+
+        table[0x60] = {.mnemonic = "RTS", .mode = AddressingMode::Implied};
+
+        table[0xe1] = {.mnemonic = "SBC", .mode = AddressingMode::IndexedIndirect};
+        table[0xe5] = {.mnemonic = "SBC", .mode = AddressingMode::ZeroPage};
+        table[0xe9] = {.mnemonic = "SBC", .mode = AddressingMode::Immediate};
+        table[0xed] = {.mnemonic = "SBC", .mode = AddressingMode::Absolute};
+        table[0xf1] = {.mnemonic = "SBC", .mode = AddressingMode::IndirectIndexed};
+        table[0xf5] = {.mnemonic = "SBC", .mode = AddressingMode::ZeroPageX};
+        table[0xf9] = {.mnemonic = "SBC", .mode = AddressingMode::AbsoluteY};
+        table[0xfd] = {.mnemonic = "SBC", .mode = AddressingMode::AbsoluteX};
+
+        table[0x38] = {.mnemonic = "SEC", .mode = AddressingMode::Implied};
+
+        table[0xf8] = {.mnemonic = "SED", .mode = AddressingMode::Implied};
+
+        table[0x78] = {.mnemonic = "SEI", .mode = AddressingMode::Implied};
+
+        table[0x81] = {.mnemonic = "STA", .mode = AddressingMode::IndexedIndirect};
+        table[0x85] = {.mnemonic = "STA", .mode = AddressingMode::ZeroPage};
+        table[0x8d] = {.mnemonic = "STA", .mode = AddressingMode::Absolute};
+        table[0x91] = {.mnemonic = "STA", .mode = AddressingMode::IndirectIndexed};
+        table[0x95] = {.mnemonic = "STA", .mode = AddressingMode::ZeroPageX};
+        table[0x99] = {.mnemonic = "STA", .mode = AddressingMode::AbsoluteY};
+        table[0x9d] = {.mnemonic = "STA", .mode = AddressingMode::AbsoluteX};
+
+        table[0x86] = {.mnemonic = "STX", .mode = AddressingMode::ZeroPage};
+        table[0x8e] = {.mnemonic = "STX", .mode = AddressingMode::Absolute};
+        table[0x96] = {.mnemonic = "STX", .mode = AddressingMode::ZeroPageY};
+
+        table[0x84] = {.mnemonic = "STY", .mode = AddressingMode::ZeroPage};
+        table[0x8c] = {.mnemonic = "STY", .mode = AddressingMode::Absolute};
+        table[0x94] = {.mnemonic = "STY", .mode = AddressingMode::ZeroPageX};
+
+        table[0xaa] = {.mnemonic = "TAX", .mode = AddressingMode::Implied};
+
+        table[0xa8] = {.mnemonic = "TAY", .mode = AddressingMode::Implied};
+
+        table[0xba] = {.mnemonic = "TSX", .mode = AddressingMode::Implied};
+
+        table[0x8a] = {.mnemonic = "TXA", .mode = AddressingMode::Implied};
+
+        table[0x9a] = {.mnemonic = "TXS", .mode = AddressingMode::Implied};
+
+        table[0x98] = {.mnemonic = "TYA", .mode = AddressingMode::Implied};
+
+        return table;
+    }
+
+    inline constexpr std::array<OpcodeInfo, 256> opcode_table = make_opcode_table();
+
+    /// @brief How an instruction uses the memory its addressing mode
+    /// points at
+    enum class OperandAccess : std::uint8_t
+    {
+        None,
+        Read,
+        Write,
+        ReadModifyWrite,
+    };
+
+    /// @brief What an opcode does besides computing, derived from its
+    /// mnemonic: the operand access, the bytes it pushes to or pulls from
+    /// the stack, and whether it may move the program counter elsewhere
+    struct OpcodeEffects
+    {
+        OperandAccess access{OperandAccess::None};
+        std::uint8_t pushes{0};
+        std::uint8_t pulls{0};
+        bool jumps{false};
+    };
+
+    constexpr std::array<OpcodeEffects, 256> make_opcode_effects()
+    {
+        using namespace std::string_view_literals;
+
+        std::array<OpcodeEffects, 256> effects{};
+        for (std::size_t opcode = 0; opcode < effects.size(); ++opcode)
+        {
+            auto const& [mnemonic, mode] = opcode_table[opcode];
+            auto& effect                 = effects[opcode];
+
+            auto const is_any = [mnemonic](auto... names) { return ((mnemonic == names) || ...); };
+            bool const in_memory = mode != AddressingMode::Implied && mode != AddressingMode::Accumulator
+                                   && mode != AddressingMode::Immediate && mode != AddressingMode::Relative;
+            if (in_memory && is_any("STA"sv, "STX"sv, "STY"sv))
+            {
+                effect.access = OperandAccess::Write;
+            }
+            else if (in_memory && is_any("ASL"sv, "LSR"sv, "ROL"sv, "ROR"sv, "INC"sv, "DEC"sv))
+            {
+                effect.access = OperandAccess::ReadModifyWrite;
+            }
+            else if (in_memory && !is_any("JMP"sv, "JSR"sv))
+            {
+                effect.access = OperandAccess::Read;
+            }
+
+            effect.pushes = is_any("PHA"sv, "PHP"sv) ? 1 : is_any("JSR"sv) ? 2 : is_any("BRK"sv) ? 3 : 0;
+            effect.pulls  = is_any("PLA"sv, "PLP"sv) ? 1 : is_any("RTS"sv) ? 2 : is_any("RTI"sv) ? 3 : 0;
+            effect.jumps  = mode == AddressingMode::Relative || is_any("JMP"sv, "JSR"sv, "RTS"sv, "RTI"sv, "BRK"sv);
+        }
+        return effects;
+    }
+
+    inline constexpr std::array<OpcodeEffects, 256> opcode_effects = make_opcode_effects();
+
+    /// @brief the opcode's mnemonic and addressing mode, e.g. "LDA abs,X"
+    inline std::string opcode_name(std::uint8_t opcode)
+    {
+        auto const& info = opcode_table[opcode];
+
+        std::string name{info.mnemonic};
+        switch (info.mode)
+        {
+        case AddressingMode::Implied:
+            return name;
+        case AddressingMode::Accumulator:
+            return name + " A";
+        case AddressingMode::Immediate:
+            return name + " #";
+        case AddressingMode::ZeroPage:
+            return name + " zp";
+        case AddressingMode::ZeroPageX:
+            return name + " zp,X";
+        case AddressingMode::ZeroPageY:
+            return name + " zp,Y";
+        case AddressingMode::Absolute:
+            return name + " abs";
+        case AddressingMode::AbsoluteX:
+            return name + " abs,X";
+        case AddressingMode::AbsoluteY:
+            return name + " abs,Y";
+        case AddressingMode::Indirect:
+            return name + " (abs)";
+        case AddressingMode::IndexedIndirect:
+            return name + " (zp,X)";
+        case AddressingMode::IndirectIndexed:
+            return name + " (zp),Y";
+        case AddressingMode::Relative:
+            return name + " rel";
+        }
+        return name;
+    }
+
+    /// @brief the instruction `opcode` followed by its `operands` in
+    /// assembler syntax, e.g. "LDA $1234,X". Branch targets are resolved
+    /// against `pc`, the address of the opcode.
+    inline std::string disassemble(std::uint8_t opcode, std::array<std::uint8_t, 2> operands, std::uint16_t pc)
+    {
+        auto const& info    = opcode_table[opcode];
+        auto const zero     = operands[0];
+        auto const absolute = static_cast<std::uint16_t>(operands[0] | (operands[1] << 8));
+
+        switch (info.mode)
+        {
+        case AddressingMode::Implied:
+            return std::string{info.mnemonic};
+        case AddressingMode::Accumulator:
+            return fmt::format("{} A", info.mnemonic);
+        case AddressingMode::Immediate:
+            return fmt::format("{} #${:02X}", info.mnemonic, zero);
+        case AddressingMode::ZeroPage:
+            return fmt::format("{} ${:02X}", info.mnemonic, zero);
+        case AddressingMode::ZeroPageX:
+            return fmt::format("{} ${:02X},X", info.mnemonic, zero);
+        case AddressingMode::ZeroPageY:
+            return fmt::format("{} ${:02X},Y", info.mnemonic, zero);
+        case AddressingMode::Absolute:
+            return fmt::format("{} ${:04X}", info.mnemonic, absolute);
+        case AddressingMode::AbsoluteX:
+            return fmt::format("{} ${:04X},X", info.mnemonic, absolute);
+        case AddressingMode::AbsoluteY:
+            return fmt::format("{} ${:04X},Y", info.mnemonic, absolute);
+        case AddressingMode::Indirect:
+            return fmt::format("{} (${:04X})", info.mnemonic, absolute);
+        case AddressingMode::IndexedIndirect:
+            return fmt::format("{} (${:02X},X)", info.mnemonic, zero);
+        case AddressingMode::IndirectIndexed:
+            return fmt::format("{} (${:02X}),Y", info.mnemonic, zero);
+        case AddressingMode::Relative:
+        {
+            auto const target = static_cast<std::uint16_t>(pc + 2 + static_cast<std::int8_t>(zero));
+            return fmt::format("{} ${:04X}", info.mnemonic, target);
+        }
+        }
+        return std::string{info.mnemonic};
+    }
+} // namespace emulator
@@ -0,0 +1,278 @@
+module;
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+export module emulator:sampler;
+
+export namespace emulator
+{
+    /// @brief Names of guest addresses, e.g. the labels of the program
+    /// being profiled, so reports can say where the time went.
+    class Symbols
+    {
+    public:
+        Symbols() = default;
+
+        /// @brief reads one symbol per line, either in the VICE label
+        /// format that ld65 writes with `-Ln` ("al C000 .name"), or as a
+        /// plain "C000 name". Addresses are hex, with an optional `$` or
+        /// `0x` prefix. Blank lines and lines starting with `;` or `#` are
+        /// skipped.
+        /// @throws std::invalid_argument on an address that is not a 16
+        /// bit hex number
+        static Symbols parse(std::istream& in)
+        {
+            Symbols symbols;
+            std::string line;
+            for (std::size_t line_number = 1; std::getline(in, line); ++line_number)
+            {
+                std::istringstream fields{line};
+                std::string address;
+                std::string name;
+                if (!(fields >> address) || address.starts_with(';') || address.starts_with('#'))
+                {
+                    continue;
+                }
+                if (address == "al" && !(fields >> address))
+                {
+                    continue;
+                }
+                if (!(fields >> name))
+                {
+                    continue;
+                }
+
+                if (address.starts_with('$'))
+                {
+                    address.erase(0, 1);
+                }
+                if (name.starts_with('.'))
+                {
+                    name.erase(0, 1);
+                }
+                symbols.add(parse_address(address, line_number), name);
+            }
+            return symbols;
+        }
+
+        void add(std::uint16_t address, std::string name)
+        {
+            _names[address] = std::move(name);
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return _names.empty();
+        }
+
+        /// @brief the closest symbol at or before `address`, plus the
+        /// offset from it, e.g. "draw_loop+0x4". Empty if there is none.
+        [[nodiscard]] std::string name(std::uint16_t address) const
+        {
+            auto found = _names.upper_bound(address);
+            if (found == _names.begin())
+            {
+                return {};
+            }
+
+            --found;
+            if (found->first == address)
+            {
+                return found->second;
+            }
+            return fmt::format("{}+{:#x}", found->second, address - found->first);
+        }
+
+    private:
+        static std::uint16_t parse_address(std::string const& address, std::size_t line_number)
+        {
+            std::size_t parsed  = 0;
+            unsigned long value = 0;
+            try
+            {
+                value = std::stoul(address, &parsed, 16);
+            }
+            catch (std::logic_error const&)
+            {
+                parsed = 0;
+            }
+
+            if (parsed != address.size() || value > 0xffff)
+            {
+                throw std::invalid_argument(
+                    fmt::format("line {}: \"{}\" is not a 16 bit hex address", line_number, address));
+            }
+            return static_cast<std::uint16_t>(value);
+        }
+
+        std::map<std::uint16_t, std::string> _names;
+    };
+
+    struct HotSpot
+    {
+        /// first and last address of the spot, the same for a single address
+        std::uint16_t first;
+        std::uint16_t last;
+        std::uint64_t samples;
+    };
+
+    /// @brief Statistical profile of where the guest program spends its
+    /// cycles.
+    ///
+    /// Every `period` emulated cycles the program counter of the
+    /// instruction being executed is counted in a 64K entry histogram,
+    /// one entry per guest address (see `run(cpu, program, max_cycles,
+    /// sampler)`). Taking a sample is an array increment and counting
+    /// down to the next one is a subtraction per instruction, so the
+    /// emulator runs at close to full speed while sampling. Sampling on
+    /// emulated cycles rather than on a host timer also makes the
+    /// profile the same on every run.
+    class PcSampler
+    {
+    public:
+        explicit PcSampler(std::size_t period = 97) : _period{period}, _countdown{period}, _histogram(0x10000, 0)
+        {
+            if (_period == 0)
+            {
+                throw std::invalid_argument("sampling period cannot be zero");
+            }
+        }
+
+        /// @brief accounts for an instruction at `pc` that took `cycles`
+        /// cycles, taking a sample if the period ran out during it
+        void advance(std::uint16_t pc, std::size_t cycles)
+        {
+            if (cycles < _countdown) [[likely]]
+            {
+                _countdown -= cycles;
+                return;
+            }
+
+            // A long instruction may span more than one period
+            auto const samples = 1 + ((cycles - _countdown) / _period);
+            _histogram[pc] += samples;
+            _total += samples;
+            _countdown = _period - ((cycles - _countdown) % _period);
+        }
+
+        [[nodiscard]] std::size_t period() const
+        {
+            return _period;
+        }
+
+        [[nodiscard]] std::uint64_t total() const
+        {
+            return _total;
+        }
+
+        [[nodiscard]] std::uint64_t samples(std::uint16_t pc) const
+        {
+            return _histogram[pc];
+        }
+
+        void reset()
+        {
+            std::ranges::fill(_histogram, 0);
+            _total     = 0;
+            _countdown = _period;
+        }
+
+        /// @brief the `count` addresses with the most samples, hottest first
+        [[nodiscard]] std::vector<HotSpot> hottest(std::size_t count) const
+        {
+            std::vector<HotSpot> spots;
+            for (std::size_t pc = 0; pc < _histogram.size(); ++pc)
+            {
+                if (_histogram[pc] != 0)
+                {
+                    auto const address = static_cast<std::uint16_t>(pc);
+                    spots.push_back(HotSpot{.first = address, .last = address, .samples = _histogram[pc]});
+                }
+            }
+            return keep_hottest(std::move(spots), count);
+        }
+
+        /// @brief the `count` hottest address ranges, hottest first. Sampled
+        /// addresses at most `max_gap` bytes apart, e.g. the instructions
+        /// of one loop, are merged into a single range.
+        [[nodiscard]] std::vector<HotSpot> hot_ranges(std::size_t count, std::size_t max_gap = 3) const
+        {
+            std::vector<HotSpot> ranges;
+            for (std::size_t pc = 0; pc < _histogram.size(); ++pc)
+            {
+                if (_histogram[pc] == 0)
+                {
+                    continue;
+                }
+
+                auto const address = static_cast<std::uint16_t>(pc);
+                if (!ranges.empty() && pc - ranges.back().last <= max_gap)
+                {
+                    ranges.back().last = address;
+                    ranges.back().samples += _histogram[pc];
+                    continue;
+                }
+                ranges.push_back(HotSpot{.first = address, .last = address, .samples = _histogram[pc]});
+            }
+            return keep_hottest(std::move(ranges), count);
+        }
+
+        /// @brief a human readable report of the `count` hottest addresses
+        /// and ranges, named after `symbols` when there are any
+        [[nodiscard]] std::string report(std::size_t count, Symbols const& symbols = {}) const
+        {
+            auto out = fmt::format("{} samples, one every {} cycles\n", _total, _period);
+
+            auto const total = static_cast<double>(std::max<std::uint64_t>(_total, 1));
+            auto line        = [&](HotSpot const& spot)
+            {
+                auto const where = spot.first == spot.last ? fmt::format("{:04x}", spot.first)
+                                                           : fmt::format("{:04x}-{:04x}", spot.first, spot.last);
+                auto const name  = symbols.name(spot.first);
+                fmt::format_to(std::back_inserter(out), "  {:<10} {:>10} {:6.2f}%{}{}\n", where, spot.samples,
+                    100.0 * static_cast<double>(spot.samples) / total, name.empty() ? "" : "  ", name);
+            };
+
+            out += "hottest addresses:\n";
+            for (auto const& spot : hottest(count))
+            {
+                line(spot);
+            }
+            out += "hottest ranges:\n";
+            for (auto const& spot : hot_ranges(count))
+            {
+                line(spot);
+            }
+            return out;
+        }
+
+    private:
+        static std::vector<HotSpot> keep_hottest(std::vector<HotSpot> spots, std::size_t count)
+        {
+            auto const kept = std::min(count, spots.size());
+            std::ranges::partial_sort(spots, spots.begin() + static_cast<std::ptrdiff_t>(kept),
+                [](HotSpot const& lhs, HotSpot const& rhs) { return lhs.samples > rhs.samples; });
+            spots.resize(kept);
+            return spots;
+        }
+
+        std::size_t _period;
+
+        /// cycles left until the next sample
+        std::size_t _countdown;
+
+        std::vector<std::uint64_t> _histogram;
+        std::uint64_t _total{0};
+    };
+} // namespace emulator
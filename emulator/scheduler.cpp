@@ -0,0 +1,282 @@
+module;
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+export module scheduler;
+
+import emulator;
+
+export namespace emulator
+{
+    /// @brief Interactive sessions are always picked before batch ones,
+    /// except for the occasional batch quantum so batch never starves.
+    enum class Priority : std::uint8_t
+    {
+        Interactive,
+        Batch,
+    };
+
+    enum class SessionState : std::uint8_t
+    {
+        /// waiting for, or in the middle of, a quantum
+        Runnable,
+
+        /// the program stopped, see `SessionStatus::reason`
+        Finished,
+
+        /// the session used up its cycle quota before the program stopped
+        QuotaExhausted,
+    };
+
+    struct SessionConfig
+    {
+        Priority priority{Priority::Batch};
+
+        /// total cycles the session may run for, over all its quanta
+        std::size_t quota{std::numeric_limits<std::size_t>::max()};
+    };
+
+    struct SessionStatus
+    {
+        SessionState state{SessionState::Runnable};
+
+        /// why the program stopped, once the session is finished
+        std::optional<StopReason> reason{};
+
+        /// cycles run so far
+        std::size_t cycles{0};
+
+        /// quanta the session was scheduled for
+        std::size_t quanta{0};
+
+        /// position of this session among all the ones that completed,
+        /// i.e. finished or ran out of quota
+        std::optional<std::size_t> completion{};
+    };
+
+    using SessionId = std::size_t;
+
+    /// @brief Multiplexes any number of cpu sessions onto a fixed pool of
+    /// worker threads.
+    ///
+    /// Sessions are run one quantum (a fixed cycle budget, see
+    /// `emulator::run`) at a time and go back to the end of their
+    /// priority's queue after each quantum, so sessions of the same
+    /// priority share the workers round-robin. Interactive sessions are
+    /// picked first, but every `interactive_burst` interactive quanta in a
+    /// row one batch quantum runs if there is one waiting. Sessions run
+    /// unthrottled: pacing a session to its clock speed is up to the
+    /// caller, e.g. by adding it again once its time comes.
+    class Scheduler
+    {
+    public:
+        /// Interactive quanta that can run in a row while batch sessions wait
+        static constexpr std::size_t interactive_burst = 8;
+
+        /// @param workers number of worker threads, at least one.
+        /// @param quantum cycles a session runs for before it goes back
+        /// in the queue.
+        explicit Scheduler(std::size_t workers = std::thread::hardware_concurrency(), std::size_t quantum = 10'000)
+            : _worker_count{std::max<std::size_t>(workers, 1)}, _quantum{quantum}
+        {
+            if (_quantum == 0)
+            {
+                throw std::invalid_argument("scheduler quantum cannot be zero");
+            }
+        }
+
+        Scheduler(Scheduler const&)            = delete;
+        Scheduler& operator=(Scheduler const&) = delete;
+
+        ~Scheduler()
+        {
+            {
+                std::scoped_lock const lock{_mutex};
+                _stopping = true;
+            }
+            _work_ready.notify_all();
+            _workers.clear();
+        }
+
+        /// @brief adds a session running `program` on `cpu`. The program
+        /// must outlive the session.
+        SessionId add(std::unique_ptr<Cpu> cpu, std::span<const std::uint8_t> program, SessionConfig config = {})
+        {
+            cpu->clock_speed = 0;
+
+            SessionId id{};
+            {
+                std::scoped_lock const lock{_mutex};
+                id = _sessions.size();
+                _sessions.push_back(Session{.cpu = std::move(cpu), .program = program, .config = config});
+                queue(config.priority).push_back(id);
+                ++_pending;
+            }
+            _work_ready.notify_one();
+            return id;
+        }
+
+        /// @brief starts the worker threads, sessions added before this
+        /// call are all queued up by then
+        void start()
+        {
+            std::scoped_lock const lock{_mutex};
+            while (_workers.size() < _worker_count)
+            {
+                _workers.emplace_back([this] { work(); });
+            }
+        }
+
+        /// @brief blocks until every session added so far has completed
+        void wait()
+        {
+            std::unique_lock lock{_mutex};
+            _all_done.wait(lock, [this] { return _pending == 0; });
+        }
+
+        [[nodiscard]] SessionStatus status(SessionId id) const
+        {
+            std::scoped_lock const lock{_mutex};
+            return _sessions.at(id).status;
+        }
+
+        /// @brief the cpu of a completed session. The cpu of a session
+        /// that is still runnable may be in the middle of a quantum.
+        [[nodiscard]] Cpu const& cpu(SessionId id) const
+        {
+            std::scoped_lock const lock{_mutex};
+            return *_sessions.at(id).cpu;
+        }
+
+        [[nodiscard]] std::size_t size() const
+        {
+            std::scoped_lock const lock{_mutex};
+            return _sessions.size();
+        }
+
+    private:
+        struct Session
+        {
+            std::unique_ptr<Cpu> cpu;
+            std::span<const std::uint8_t> program;
+            SessionConfig config;
+            SessionStatus status{};
+
+            /// budget charged against the quota so far
+            std::size_t budget_used{0};
+        };
+
+        std::deque<SessionId>& queue(Priority priority)
+        {
+            return priority == Priority::Interactive ? _interactive : _batch;
+        }
+
+        /// @brief takes the next session to run, the lock must be held
+        std::optional<SessionId> next()
+        {
+            bool const batch_turn = _batch_waiting_for >= interactive_burst && !_batch.empty();
+            if (!_interactive.empty() && !batch_turn)
+            {
+                if (!_batch.empty())
+                {
+                    ++_batch_waiting_for;
+                }
+                auto const id = _interactive.front();
+                _interactive.pop_front();
+                return id;
+            }
+
+            if (!_batch.empty())
+            {
+                _batch_waiting_for = 0;
+                auto const id      = _batch.front();
+                _batch.pop_front();
+                return id;
+            }
+            return std::nullopt;
+        }
+
+        void work()
+        {
+            std::unique_lock lock{_mutex};
+            while (true)
+            {
+                _work_ready.wait(lock, [this] { return _stopping || !_interactive.empty() || !_batch.empty(); });
+                if (_stopping)
+                {
+                    return;
+                }
+
+                auto const id = next();
+                if (!id)
+                {
+                    continue;
+                }
+
+                // Nobody else touches a session while it is out of the
+                // queues, and deque elements do not move on push_back
+                auto& session     = _sessions[*id];
+                auto const budget = std::min(_quantum, session.config.quota - session.budget_used);
+                lock.unlock();
+
+                auto const result = emulator::run(*session.cpu, session.program, budget);
+
+                lock.lock();
+                session.budget_used += result.budget_used;
+                session.status.cycles += result.cycles;
+                ++session.status.quanta;
+
+                if (result.reason != StopReason::Budget)
+                {
+                    session.status.state  = SessionState::Finished;
+                    session.status.reason = result.reason;
+                }
+                else if (session.budget_used >= session.config.quota)
+                {
+                    session.status.state = SessionState::QuotaExhausted;
+                }
+                else
+                {
+                    queue(session.config.priority).push_back(*id);
+                    continue;
+                }
+
+                session.status.completion = _completed++;
+                if (--_pending == 0)
+                {
+                    _all_done.notify_all();
+                }
+            }
+        }
+
+        std::size_t _worker_count;
+        std::size_t _quantum;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _work_ready;
+        std::condition_variable _all_done;
+
+        std::deque<Session> _sessions;
+        std::deque<SessionId> _interactive;
+        std::deque<SessionId> _batch;
+        std::size_t _batch_waiting_for{0};
+        std::size_t _pending{0};
+        std::size_t _completed{0};
+        bool _stopping{false};
+
+        // Last member, so the workers are joined before anything they use goes away
+        std::vector<std::jthread> _workers;
+    };
+} // namespace emulator
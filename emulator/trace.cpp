@@ -0,0 +1,275 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+export module emulator:trace;
+
+/*
+    A trace file is a `TraceHeader` followed by `TraceRecord`s, one per
+    executed instruction, in execution order. Both are written as they
+    are laid out in memory, so a trace is only meant to be decoded on a
+    host with the same byte order as the one that wrote it.
+*/
+
+export namespace emulator
+{
+    /// @brief One executed instruction, with the registers as the
+    /// instruction left them
+    struct TraceRecord
+    {
+        /// cycles charged to the run budget since tracing started, this
+        /// instruction included
+        std::uint64_t cycle;
+        std::uint16_t pc;
+        std::uint8_t opcode;
+        std::array<std::uint8_t, 2> operands;
+        std::uint8_t a;
+        std::uint8_t x;
+        std::uint8_t y;
+        std::uint8_t sp;
+        std::uint8_t sr;
+    };
+
+    static_assert(sizeof(TraceRecord) == 24);
+
+    struct TraceHeader
+    {
+        std::array<char, 8> magic{'6', '5', 'k', 't', 'r', 'a', 'c', 'e'};
+        std::uint32_t version{1};
+        std::uint32_t record_size{sizeof(TraceRecord)};
+    };
+
+    /// @brief Lock-free single producer single consumer ring of trace
+    /// records.
+    ///
+    /// The consumer reads records in place, as contiguous spans, so they
+    /// can go straight to a file without being copied out first. When
+    /// the ring is full the producer waits for the consumer: a trace
+    /// never silently loses instructions.
+    class TraceRing
+    {
+    public:
+        explicit TraceRing(std::size_t capacity)
+            : _capacity{capacity}, _records{std::make_unique<TraceRecord[]>(capacity)}
+        {
+            if (_capacity == 0 || (_capacity & (_capacity - 1)) != 0)
+            {
+                throw std::invalid_argument("trace ring capacity must be a power of two");
+            }
+        }
+
+        /// @brief adds a record, waiting for room if the ring is full
+        void push(TraceRecord const& record)
+        {
+            auto const tail = _tail.load(std::memory_order_relaxed);
+            while (tail - _cached_head == _capacity) [[unlikely]]
+            {
+                _cached_head = _head.load(std::memory_order_acquire);
+                if (tail - _cached_head == _capacity)
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            _records[tail & (_capacity - 1)] = record;
+            _tail.store(tail + 1, std::memory_order_release);
+        }
+
+        /// @brief the oldest records not consumed yet that sit next to each
+        /// other in the ring, consumer side only. Empty if there are none.
+        std::span<TraceRecord const> peek()
+        {
+            auto const head  = _head.load(std::memory_order_relaxed);
+            auto const tail  = _tail.load(std::memory_order_acquire);
+            auto const first = head & (_capacity - 1);
+            auto const count = std::min(tail - head, _capacity - first);
+            return {_records.get() + first, count};
+        }
+
+        /// @brief releases the first `count` records returned by `peek`
+        void consume(std::size_t count)
+        {
+            _head.store(_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        }
+
+    private:
+        std::size_t _capacity;
+        std::unique_ptr<TraceRecord[]> _records;
+
+        // consumer side
+        alignas(64) std::atomic<std::size_t> _head{0};
+
+        // producer side
+        alignas(64) std::atomic<std::size_t> _tail{0};
+        std::size_t _cached_head{0};
+    };
+
+    /// @brief Writes a trace file from a background thread.
+    ///
+    /// The emulation thread only copies 24 bytes into a `TraceRing` per
+    /// instruction (see `run(cpu, program, max_cycles, trace)`), and the
+    /// writer thread drains the ring into the file in large blocks. A
+    /// failed write (e.g. a full disk) does not stop the run, the writer
+    /// keeps draining the ring and `close()` reports the failure.
+    class TraceWriter
+    {
+    public:
+        explicit TraceWriter(std::filesystem::path const& path, std::size_t capacity = std::size_t{1} << 16)
+            : _ring{capacity}, _path{path.string()}, _file{std::fopen(_path.c_str(), "wb")}
+        {
+            if (_file == nullptr)
+            {
+                throw std::runtime_error("could not open trace file " + _path);
+            }
+
+            TraceHeader const header{};
+            if (std::fwrite(&header, sizeof(header), 1, _file) != 1)
+            {
+                std::fclose(_file);
+                throw std::runtime_error("could not write trace file " + _path);
+            }
+            _writer = std::jthread{[this](std::stop_token const& stop) { drain(stop); }};
+        }
+
+        TraceWriter(TraceWriter const&)            = delete;
+        TraceWriter& operator=(TraceWriter const&) = delete;
+
+        /// @brief closes the file like `close()`, but cannot report a
+        /// failed write. Call `close()` to find out.
+        ~TraceWriter()
+        {
+            finish();
+        }
+
+        /// @brief traces an instruction that took `cycles` cycles, producer
+        /// side only. The record's cycle stamp is filled in here.
+        void push(TraceRecord record, std::size_t cycles)
+        {
+            _cycles += cycles;
+            record.cycle = _cycles;
+            _ring.push(record);
+        }
+
+        /// @brief writes out every record pushed so far and closes the file
+        /// @throws std::runtime_error if any of the records could not be
+        /// written
+        void close()
+        {
+            if (!finish())
+            {
+                throw std::runtime_error("could not write trace file " + _path);
+            }
+        }
+
+    private:
+        /// @return false if a write failed, now or while running
+        bool finish()
+        {
+            if (_file == nullptr)
+            {
+                return !_failed;
+            }
+
+            _writer.request_stop();
+            _writer.join();
+            _failed = std::fclose(_file) != 0 || _failed;
+            _file   = nullptr;
+            return !_failed;
+        }
+
+        void drain(std::stop_token const& stop)
+        {
+            while (true)
+            {
+                // Check for a stop before looking at the ring, so the records
+                // pushed before `close` are all written out
+                auto const stopping = stop.stop_requested();
+                auto const records  = _ring.peek();
+                if (!records.empty())
+                {
+                    // Keep consuming after a failure, so the emulation never blocks on a full ring
+                    if (std::fwrite(records.data(), sizeof(TraceRecord), records.size(), _file) != records.size())
+                    {
+                        _failed = true;
+                    }
+                    _ring.consume(records.size());
+                    continue;
+                }
+
+                if (stopping)
+                {
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+        }
+
+        TraceRing _ring;
+        std::string _path;
+        std::FILE* _file;
+        std::uint64_t _cycles{0};
+
+        /// set by the writer thread, only read once it has been joined
+        bool _failed{false};
+        std::jthread _writer;
+    };
+
+    /// @brief Reads a trace file written by `TraceWriter`, one record at
+    /// a time
+    class TraceReader
+    {
+    public:
+        explicit TraceReader(std::filesystem::path const& path) : _file{std::fopen(path.string().c_str(), "rb")}
+        {
+            if (_file == nullptr)
+            {
+                throw std::runtime_error("could not open trace file " + path.string());
+            }
+
+            TraceHeader header{};
+            TraceHeader const expected{};
+            if (std::fread(&header, sizeof(header), 1, _file) != 1 || header.magic != expected.magic
+                || header.version != expected.version || header.record_size != expected.record_size)
+            {
+                std::fclose(_file);
+                throw std::runtime_error(path.string() + " is not a trace file");
+            }
+        }
+
+        TraceReader(TraceReader const&)            = delete;
+        TraceReader& operator=(TraceReader const&) = delete;
+
+        ~TraceReader()
+        {
+            std::fclose(_file);
+        }
+
+        /// @brief the next record, or nothing at the end of the trace
+        std::optional<TraceRecord> next()
+        {
+            TraceRecord record{};
+            if (std::fread(&record, sizeof(record), 1, _file) != 1)
+            {
+                return std::nullopt;
+            }
+            return record;
+        }
+
+    private:
+        std::FILE* _file;
+    };
+} // namespace emulator
@@ -0,0 +1,152 @@
+module;
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+export module command_channel;
+
+export namespace emulator::app
+{
+    /// @brief Wait-free, bounded, single producer single consumer queue.
+    ///
+    /// The producer only ever writes `_tail` and the consumer only ever
+    /// writes `_head`, so both `try_push` and `try_pop` finish in a fixed
+    /// number of steps. Each side keeps a cached copy of the other side's
+    /// index and only reloads it when the queue looks full (or empty), so
+    /// the shared cache lines are rarely touched.
+    template <typename T, std::size_t Capacity>
+    class SpscQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        /// @brief adds a value to the queue
+        /// @return false if the queue is full
+        bool try_push(T const& value)
+        {
+            auto const tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _cached_head == Capacity)
+            {
+                _cached_head = _head.load(std::memory_order_acquire);
+                if (tail - _cached_head == Capacity)
+                {
+                    return false;
+                }
+            }
+
+            _slots[tail & mask] = value;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// @brief takes the oldest value out of the queue, if there is one
+        std::optional<T> try_pop()
+        {
+            auto const head = _head.load(std::memory_order_relaxed);
+            if (head == _cached_tail)
+            {
+                _cached_tail = _tail.load(std::memory_order_acquire);
+                if (head == _cached_tail)
+                {
+                    return std::nullopt;
+                }
+            }
+
+            auto value = _slots[head & mask];
+            _head.store(head + 1, std::memory_order_release);
+            return value;
+        }
+
+        /// @brief whether there is nothing to pop, consumer side only
+        bool empty()
+        {
+            auto const head = _head.load(std::memory_order_relaxed);
+            if (head == _cached_tail)
+            {
+                _cached_tail = _tail.load(std::memory_order_acquire);
+            }
+            return head == _cached_tail;
+        }
+
+    private:
+        static constexpr std::size_t mask = Capacity - 1;
+
+        std::array<T, Capacity> _slots{};
+
+        // consumer side
+        alignas(64) std::atomic<std::size_t> _head{0};
+        std::size_t _cached_tail{0};
+
+        // producer side
+        alignas(64) std::atomic<std::size_t> _tail{0};
+        std::size_t _cached_head{0};
+    };
+
+    /// @brief Commands the UI sends to the emulation thread
+    enum class Command : std::uint8_t
+    {
+        Pause,
+        Step,
+        Continue,
+    };
+
+    /// @brief An SPSC queue of commands with a doorbell the consumer can
+    /// sleep on.
+    ///
+    /// The emulation thread polls the channel once per slice, which is a
+    /// couple of relaxed loads while nothing was sent. When paused it
+    /// parks in `wait` (a futex wait on Linux) until the UI sends a new
+    /// command or `wake` is called, so it neither spins nor sleeps for a
+    /// fixed amount of time.
+    class CommandChannel
+    {
+    public:
+        /// @brief sends a command and wakes the consumer if it is parked
+        /// @return false if the queue is full and the command was dropped
+        bool send(Command command)
+        {
+            if (!_queue.try_push(command))
+            {
+                return false;
+            }
+
+            wake();
+            return true;
+        }
+
+        /// @brief takes the next command sent, if there is one
+        std::optional<Command> poll()
+        {
+            return _queue.try_pop();
+        }
+
+        /// @brief parks the calling (consumer) thread until a command is
+        /// available, or someone calls `wake`
+        void wait()
+        {
+            // Read the doorbell before checking the queue: a command sent
+            // after the check rings it, and the wait returns straight away
+            auto const rung = _doorbell.load(std::memory_order_acquire);
+            if (!_queue.empty())
+            {
+                return;
+            }
+
+            _doorbell.wait(rung, std::memory_order_acquire);
+        }
+
+        /// @brief wakes the consumer up if it is parked in `wait`
+        void wake()
+        {
+            _doorbell.fetch_add(1, std::memory_order_release);
+            _doorbell.notify_one();
+        }
+
+    private:
+        SpscQueue<Command, 64> _queue{};
+        alignas(64) std::atomic<std::uint32_t> _doorbell{0};
+    };
+} // namespace emulator::app
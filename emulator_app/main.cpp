@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <span>
+#include <stop_token>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -16,9 +21,61 @@ import emulator;
 import register_table_ui; // make these names better
 import flag_table_ui;
 import common_ui;
+import profiler_panel_ui;
+import command_channel;
+import triple_buffer;
+
+#ifdef BUILD_PROFILER
+import profiler;
+#endif // BUILD_PROFILER
 
 namespace
 {
+#ifdef BUILD_PROFILER
+    /// Execute slices, frames, render time and pacing sleeps of both
+    /// threads, written out as a Chrome trace with `--timeline FILE`
+    profiler::Timeline timeline;
+
+    auto timed(std::string_view name, std::string_view category) -> profiler::ScopedEvent
+    {
+        return profiler::ScopedEvent{timeline, name, category};
+    }
+
+    using Histogram = profiler::LatencyHistogram;
+#else
+    /// Stands in for a timeline event when the profiler is not built
+    struct NoEvent
+    {
+        void stop() {}
+    };
+
+    auto timed(std::string_view /* name */, std::string_view /* category */) -> NoEvent
+    {
+        return {};
+    }
+
+    /// Stands in for a latency histogram when the profiler is not built
+    struct Histogram
+    {
+        void record(std::chrono::nanoseconds /* duration */) {}
+    };
+#endif // BUILD_PROFILER
+
+    /// Tail latencies of both threads, each histogram only written by one
+    /// of them, reported when the app closes (profiler builds only)
+    struct Latencies
+    {
+        /// host time of each execute slice
+        Histogram execute;
+
+        /// how far each slice's host time was from the time it emulates
+        Histogram pacing_error;
+
+        /// host time of each render loop iteration
+        Histogram frame;
+    };
+
+    Latencies latencies;
 
     constexpr std::array<Color, 16> colour_table{{
         {.r = 0, .g = 0, .b = 0, .a = 255}, // Black
@@ -45,8 +102,240 @@ namespace
         Right
     };
 
+    /// First address of the memory mapped display
+    constexpr std::uint16_t display_start = 0x0200;
+
+    /// Number of bytes (i.e. 32x32 pixels) in the memory mapped display
+    constexpr std::size_t display_size = 0x0400;
+
+    /// @brief Everything the render loop needs from the cpu, copied out
+    /// by the emulation thread after each slice
+    struct Frame
+    {
+        emulator::Registers reg{};
+        emulator::Flags flags{};
+        std::uint8_t sr{0};
+        std::array<std::uint8_t, emulator::page_size> zero_page{};
+        std::array<std::uint8_t, display_size> display{};
+        emulator::ui::PerformanceSnapshot performance{};
+    };
+
+    using FrameBuffer = emulator::app::TripleBuffer<Frame>;
+
+    /// Cycles run between two published frames, i.e. one frame at 30 FPS,
+    /// but at least one so that a tiny clock speed still makes progress
+    std::size_t cycles_per_frame(emulator::Cpu const& cpu)
+    {
+        return std::max<std::size_t>(static_cast<std::size_t>(cpu.clock_speed * 1'000'000 / 30), 1);
+    }
+
+    /// @brief What the emulation thread runs the cpu with: the counts
+    /// behind the profiler panel and, in profiler builds, the host ticks
+    /// spent in each opcode
+    struct AppObserver : emulator::ExecutionCounts
+    {
+#ifdef BUILD_PROFILER
+        emulator::OpcodeProfiler opcodes;
+
+        void on_fetch(std::uint16_t pc, std::uint8_t opcode)
+        {
+            opcodes.on_fetch(pc, opcode);
+        }
+
+        void on_instruction(std::uint16_t pc, std::uint8_t opcode, std::size_t cycles)
+        {
+            ExecutionCounts::on_instruction(pc, opcode, cycles);
+            opcodes.on_instruction(pc, opcode, cycles);
+        }
+#endif // BUILD_PROFILER
+    };
+
+    /// @brief Turns the emulation thread's counters into the snapshots
+    /// the profiler panel shows, one per published frame
+    class PerformanceTracker
+    {
+    public:
+        /// @brief the observer to run the cpu with
+        AppObserver& observer()
+        {
+            return _counts;
+        }
+
+        /// @brief fills `snapshot` with the rates since the last call, the
+        /// drift and the hottest opcodes and addresses so far
+        void snapshot(emulator::ui::PerformanceSnapshot& snapshot,
+                      std::chrono::nanoseconds pacing_error,
+                      emulator::PacingStats const& pacing)
+        {
+            using seconds = std::chrono::duration<double>;
+
+            auto const now          = std::chrono::steady_clock::now();
+            auto const elapsed      = std::max(seconds{now - _last_time}.count(), 1e-9);
+            auto const cycles       = static_cast<double>(_counts.cycles() - _last_cycles);
+            auto const instructions = static_cast<double>(_counts.instructions() - _last_instructions);
+
+            snapshot.emulated_mhz            = cycles / elapsed / 1'000'000;
+            snapshot.instructions_per_second = instructions / elapsed;
+            snapshot.pacing_error_ms         = std::chrono::duration<double, std::milli>{pacing_error}.count();
+            snapshot.drift_ms                = std::chrono::duration<double, std::milli>{pacing.drift()}.count();
+            snapshot.instructions            = _counts.instructions();
+            snapshot.opcode_count            = _counts.hottest_opcodes(snapshot.opcodes);
+            snapshot.address_count           = _counts.hottest_addresses(snapshot.addresses);
+
+            _last_time         = now;
+            _last_cycles       = _counts.cycles();
+            _last_instructions = _counts.instructions();
+        }
+
+    private:
+        AppObserver _counts;
+        std::chrono::steady_clock::time_point _last_time{std::chrono::steady_clock::now()};
+        std::uint64_t _last_cycles{0};
+        std::uint64_t _last_instructions{0};
+    };
 
-    void draw_memory_view(emulator::Cpu& cpu)
+    void publish_frame(emulator::Cpu const& cpu,
+                       FrameBuffer& frames,
+                       PerformanceTracker& performance,
+                       std::chrono::nanoseconds pacing_error)
+    {
+        auto& frame = frames.back();
+        performance.snapshot(frame.performance, pacing_error, cpu.pacing);
+        frame.reg   = cpu.reg;
+        frame.flags = cpu.flags;
+        frame.sr    = cpu.sr();
+        for (std::size_t i = 0; i < frame.zero_page.size(); ++i)
+        {
+            frame.zero_page[i] = cpu.mem[i];
+        }
+        for (std::size_t i = 0; i < frame.display.size(); ++i)
+        {
+            frame.display[i] = cpu.mem[display_start + i];
+        }
+        frames.publish();
+    }
+
+    /// @brief prints how closely the run kept to the clock speed
+    void print_pacing(emulator::PacingStats const& pacing, double clock_speed)
+    {
+        using milliseconds = std::chrono::duration<double, std::milli>;
+        if (pacing.host_time.count() == 0)
+        {
+            return;
+        }
+
+        std::cout << fmt::format("pacing: {} cycles in {:.3f} ms, {:.3f} ms emulated ({:.3f} MHz for {:.3f} MHz)\n",
+            pacing.cycles,
+            milliseconds{pacing.host_time}.count(),
+            milliseconds{pacing.emulated_time}.count(),
+            pacing.effective_mhz(),
+            clock_speed);
+        std::cout << fmt::format("pacing: slept {:.3f} ms for {:.3f} ms requested\n",
+            milliseconds{pacing.actual_sleep}.count(),
+            milliseconds{pacing.requested_sleep}.count());
+        std::cout << fmt::format("pacing: overshoot {:.3f} ms, undershoot {:.3f} ms, drift {:+.3f} ms\n",
+            milliseconds{pacing.overshoot}.count(),
+            milliseconds{pacing.undershoot}.count(),
+            milliseconds{pacing.drift()}.count());
+    }
+
+    /// @brief runs the program one frame worth of cycles at a time,
+    /// publishing the cpu state after every slice, until the program
+    /// stops or the render loop asks us to. Commands from the UI are
+    /// picked up between slices, and while paused the thread sleeps
+    /// until the next command comes in.
+    void emulate(std::stop_token stop,
+                 emulator::Cpu& cpu,
+                 std::span<const std::uint8_t> program,
+                 FrameBuffer& frames,
+                 emulator::app::CommandChannel& commands)
+    {
+        // Make sure a paused thread notices the stop request
+        std::stop_callback const wake_on_stop{stop, [&commands] { commands.wake(); }};
+#ifdef BUILD_PROFILER
+        timeline.name_thread("emulation");
+#endif // BUILD_PROFILER
+
+        auto const budget = cycles_per_frame(cpu);
+        bool paused       = false;
+        std::size_t steps = 0;
+        PerformanceTracker performance;
+        while (!stop.stop_requested())
+        {
+            while (auto const command = commands.poll())
+            {
+                switch (*command)
+                {
+                case emulator::app::Command::Pause:
+                    paused = true;
+                    break;
+                case emulator::app::Command::Step:
+                    paused = true;
+                    ++steps;
+                    break;
+                case emulator::app::Command::Continue:
+                    paused = false;
+                    steps  = 0;
+                    break;
+                }
+            }
+
+            if (paused && steps == 0)
+            {
+                [[maybe_unused]] auto const idle = timed("paused", "emulation");
+                commands.wait();
+                continue;
+            }
+
+            // A budget of a single cycle runs exactly one instruction.
+            // The slice includes the pacing to the cpu clock speed.
+            auto const slice_start = std::chrono::steady_clock::now();
+            auto const result      = [&]
+            {
+                [[maybe_unused]] auto const slice = timed("execute", "emulation");
+                return emulator::run(cpu, program, paused ? 1 : budget, performance.observer());
+            }();
+            auto const slice_time = std::chrono::steady_clock::now() - slice_start;
+            latencies.execute.record(slice_time);
+
+            std::chrono::nanoseconds pacing_error{0};
+            if (!paused && cpu.clock_speed > 0)
+            {
+                auto const emulated = std::chrono::nanoseconds{
+                    static_cast<std::int64_t>(static_cast<double>(result.cycles) * 1'000 / cpu.clock_speed)};
+                pacing_error = slice_time - emulated;
+                latencies.pacing_error.record(std::chrono::abs(pacing_error));
+            }
+            if (paused)
+            {
+                --steps;
+            }
+            {
+                [[maybe_unused]] auto const publish = timed("publish", "emulation");
+                publish_frame(cpu, frames, performance, pacing_error);
+            }
+            if (result.reason != emulator::StopReason::Budget)
+            {
+                break;
+            }
+        }
+
+#ifdef BUILD_PROFILER
+        for (auto const& opcode : performance.observer().opcodes.report())
+        {
+            std::cout << fmt::format("{:#04x} {:<12} {:>10} calls {:>14} ticks (min {}, max {})\n",
+                opcode.opcode,
+                opcode.name,
+                opcode.count,
+                opcode.ticks,
+                opcode.min_ticks,
+                opcode.max_ticks);
+        }
+#endif // BUILD_PROFILER
+        print_pacing(cpu.pacing, cpu.clock_speed);
+    }
+
+    void draw_memory_view(Frame const& frame)
     {
         static constexpr float offset_view_width  = 75.0f;
         static constexpr float offset_view_height = 200.0f;
@@ -133,7 +422,7 @@ namespace
                 for (int col = 0; col < num_columns; col++)
                 {
                     ImGui::TableSetColumnIndex(col);
-                    auto const data = fmt::format("0x{:02x}", cpu.mem[(row * num_columns) + col]);
+                    auto const data = fmt::format("0x{:02x}", frame.zero_page[(row * num_columns) + col]);
                     ImGui::Text("%s", data.c_str());
                 }
             }
@@ -165,7 +454,7 @@ namespace
     }
 
 
-    void draw_control_buttons(emulator::Cpu& cpu)
+    void draw_control_buttons(emulator::app::CommandChannel& commands)
     {
         auto const button_box_height = 100.0f;
 
@@ -180,17 +469,17 @@ namespace
         auto const button_size = ImVec2(70, 20);
         if (ImGui::Button("Pause", button_size))
         {
-            // TODO : pause the running emulation
+            commands.send(emulator::app::Command::Pause);
         }
         ImGui::SameLine();
         if (ImGui::Button("Step", button_size))
         {
-            // TODO : step through an instruction
+            commands.send(emulator::app::Command::Step);
         }
         ImGui::SameLine();
         if (ImGui::Button("Continue", button_size))
         {
-            // TODO : continue running the program
+            commands.send(emulator::app::Command::Continue);
         }
 
         ImGui::EndChild();
@@ -198,18 +487,29 @@ namespace
 } // namespace
 
 
-// TODO mutex to protect memory
-auto draw(emulator::Cpu& cpu) -> bool
+// The render loop only ever reads the frames published by the
+// emulation thread, it never touches the cpu itself
+auto draw(FrameBuffer& frames, emulator::app::CommandChannel& commands) -> bool
 {
     // before your game loop
     InitWindow(512, 512, "6502 Graphics");
     SetTargetFPS(30);
     rlImGuiSetup(true); // sets up ImGui with ether a dark or light default theme
+#ifdef BUILD_PROFILER
+    timeline.name_thread("render");
+#endif // BUILD_PROFILER
 
     bool window_open = true;
+    float frame_ms   = 0.0f;
 
     while (!WindowShouldClose())
     {
+        [[maybe_unused]] auto const frame_event = timed("frame", "render");
+        auto render_event                       = timed("render", "render");
+        auto const frame_start                  = std::chrono::steady_clock::now();
+        frames.update();
+        auto const& frame = frames.front();
+
         BeginDrawing();
         ClearBackground(BLACK);
         rlImGuiBegin();
@@ -235,7 +535,7 @@ auto draw(emulator::Cpu& cpu) -> bool
 
         { // table one
             ImGui::BeginChild("LeftTable", ImVec2(table_width, table_height), true);
-            emulator::ui::draw_flag_table(cpu);
+            emulator::ui::draw_flag_table(frame.flags);
             ImGui::EndChild();
         }
 
@@ -247,7 +547,7 @@ auto draw(emulator::Cpu& cpu) -> bool
 
         { // table two
             ImGui::BeginChild("RightTable", ImVec2(table_width, table_height), true);
-            emulator::ui::draw_register_table(cpu);
+            emulator::ui::draw_register_table(frame.reg, frame.sr);
             ImGui::EndChild();
         }
         ImGui::PopStyleVar(6);
@@ -256,12 +556,12 @@ auto draw(emulator::Cpu& cpu) -> bool
         /***************************************************
          * Drawing the scrollable memory view               *
          ***************************************************/
-        draw_memory_view(cpu);
+        draw_memory_view(frame);
 
         /***************************************************
          * Drawing the control buttons at the bottom       *
          ***************************************************/
-        draw_control_buttons(cpu);
+        draw_control_buttons(commands);
 
         ImGui::BeginChild("LeftTable", ImVec2(table_width, table_height), true);
         ImGui::BeginGroup();
@@ -272,24 +572,31 @@ auto draw(emulator::Cpu& cpu) -> bool
 
         ImGui::End();
 
+        emulator::ui::draw_profiler_panel(frame.performance, frame_ms);
 
         // 0200 - 05FF :
-        for (int i = 0x0200; i < 0x0600; ++i)
+        for (int rel_pos = 0; rel_pos < static_cast<int>(display_size); ++rel_pos)
         {
-            auto const colour_id = cpu.mem[i] % 16;
+            auto const colour_id = frame.display[rel_pos] % 16;
             auto const& colour   = colour_table[colour_id];
 
             // Draw this colour rectangle
-            auto const rel_pos = i - 0x0200;
             auto const row     = rel_pos / 32;
             auto const col     = rel_pos % 32;
             DrawRectangle(col * 16, row * 16, 16, 16, colour);
         }
         rlImGuiEnd();
         EndDrawing();
+        render_event.stop();
 
         // Make sure we only draw at most 30 times per second
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 30));
+        {
+            [[maybe_unused]] auto const pacing = timed("pacing", "render");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 30));
+        }
+        auto const frame_time = std::chrono::steady_clock::now() - frame_start;
+        latencies.frame.record(frame_time);
+        frame_ms = std::chrono::duration<float, std::milli>{frame_time}.count();
     }
     rlImGuiShutdown();
     CloseWindow();
@@ -313,12 +620,28 @@ auto main(int argc, char** argv) -> int
 
     std::vector<char> program_contents{(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()};
 
-    emulator::execute(easy65k, {reinterpret_cast<std::uint8_t*>(program_contents.data()), program_contents.size()});
+    std::span<const std::uint8_t> const program{
+        reinterpret_cast<std::uint8_t*>(program_contents.data()), program_contents.size()};
 
-    for (auto const& [function, profile] : easy65k.current_profile())
+    // The window shows whatever the emulation thread last published,
+    // and asks it to stop (jthread) when the window closes
+    FrameBuffer frames;
+    emulator::app::CommandChannel commands;
     {
-        std::cout << fmt::format("{}: {:.6f}\n", function, profile);
+        std::jthread emulation{emulate, std::ref(easy65k), program, std::ref(frames), std::ref(commands)};
+        draw(frames, commands);
     }
 
-    draw(easy65k);
+#ifdef BUILD_PROFILER
+    latencies.execute.report(std::cout, "execute slice");
+    latencies.pacing_error.report(std::cout, "pacing error");
+    latencies.frame.report(std::cout, "frame");
+
+    if (argc >= 4 && std::string_view{argv[2]} == "--timeline")
+    {
+        std::ofstream timeline_file{argv[3]};
+        timeline.write_chrome_trace(timeline_file);
+        std::cout << fmt::format("wrote the timeline to {}\n", argv[3]);
+    }
+#endif // BUILD_PROFILER
 }
@@ -0,0 +1,72 @@
+module;
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+export module triple_buffer;
+
+export namespace emulator::app
+{
+    /// @brief Lock-free single producer, single consumer triple buffer.
+    ///
+    /// The producer fills in `back()` and calls `publish()`, the consumer
+    /// calls `update()` and reads `front()`. Both sides own one buffer each
+    /// and swap it with the shared middle buffer through a single atomic
+    /// exchange, so neither side ever waits for the other and the consumer
+    /// never sees a half written value.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        /// @brief buffer owned by the producer, to be filled in before publishing
+        T& back()
+        {
+            return _buffers[_back].value;
+        }
+
+        /// @brief makes the back buffer the latest value
+        void publish()
+        {
+            auto const previous = _middle.exchange(_back | fresh_bit, std::memory_order_acq_rel);
+            _back               = previous & index_mask;
+        }
+
+        /// @brief grabs the latest published value, if there is one
+        /// @return true if `front()` changed
+        bool update()
+        {
+            if ((_middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+            {
+                return false;
+            }
+
+            auto const previous = _middle.exchange(_front, std::memory_order_acq_rel);
+            _front              = previous & index_mask;
+            return true;
+        }
+
+        /// @brief buffer owned by the consumer, the latest value as of `update()`
+        T const& front() const
+        {
+            return _buffers[_front].value;
+        }
+
+    private:
+        static constexpr std::uint8_t index_mask = 0b011;
+        static constexpr std::uint8_t fresh_bit  = 0b100;
+
+        // Keep each buffer on its own cache lines so the two
+        // threads do not false share
+        struct alignas(64) Slot
+        {
+            T value{};
+        };
+
+        std::array<Slot, 3> _buffers{};
+        alignas(64) std::atomic<std::uint8_t> _middle{1};
+        alignas(64) std::uint8_t _back{0};
+        alignas(64) std::uint8_t _front{2};
+    };
+} // namespace emulator::app
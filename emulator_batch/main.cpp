@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+import emulator;
+import work_stealing;
+import profiler;
+
+namespace
+{
+    /// Cycles a single run may take before it is cut short
+    constexpr std::size_t default_max_cycles = 10'000'000;
+
+    struct Options
+    {
+        std::vector<std::filesystem::path> images{};
+        std::size_t threads{std::max<std::size_t>(std::thread::hardware_concurrency(), 1)};
+        std::size_t max_cycles{default_max_cycles};
+        bool profile{false};
+    };
+
+    struct Image
+    {
+        std::filesystem::path path;
+
+        /// nothing if the image could not be read, it is reported as an error
+        std::optional<std::vector<std::uint8_t>> program;
+    };
+
+    struct Result
+    {
+        emulator::StopReason reason{emulator::StopReason::Budget};
+        std::size_t cycles{0};
+        std::uint64_t hash{0};
+    };
+
+    auto to_string(emulator::StopReason reason) -> std::string_view
+    {
+        switch (reason)
+        {
+        case emulator::StopReason::Budget:
+            return "budget";
+        case emulator::StopReason::EndOfProgram:
+            return "end";
+        case emulator::StopReason::Halted:
+            return "halted";
+        }
+        return "unknown";
+    }
+
+    void print_usage()
+    {
+        std::cerr << "usage: emulator_batch [--threads N] [--max-cycles N] [--profile] [--list FILE] "
+                     "IMAGE|DIRECTORY...\n"
+                     "  --profile  time every opcode of every run and print them together\n"
+                     "Images that cannot be read are reported with an \"error\" reason and fail the batch.\n";
+    }
+
+    /// @brief adds `path` to the images to run, or every regular file in
+    /// it (sorted, so the output order is stable) if it is a directory
+    void add_images(std::filesystem::path const& path, std::vector<std::filesystem::path>& images)
+    {
+        if (!std::filesystem::is_directory(path))
+        {
+            images.push_back(path);
+            return;
+        }
+
+        std::vector<std::filesystem::path> entries;
+        for (auto const& entry : std::filesystem::directory_iterator{path})
+        {
+            if (entry.is_regular_file())
+            {
+                entries.push_back(entry.path());
+            }
+        }
+        std::ranges::sort(entries);
+        images.insert(images.end(), entries.begin(), entries.end());
+    }
+
+    /// @brief parses a whole decimal count, throwing std::logic_error
+    /// like std::stoull does on anything else
+    auto parse_count(std::string const& value) -> std::size_t
+    {
+        std::size_t parsed = 0;
+        auto const count   = std::stoull(value, &parsed);
+        if (parsed != value.size() || value.starts_with('-'))
+        {
+            throw std::invalid_argument("not a count");
+        }
+        return count;
+    }
+
+    auto parse_options(std::span<char*> args) -> std::optional<Options>
+    {
+        Options options;
+        std::size_t i = 0;
+        try
+        {
+            for (; i < args.size(); ++i)
+            {
+                std::string_view const arg{args[i]};
+                bool const has_value = i + 1 < args.size();
+                if (arg == "--threads" && has_value)
+                {
+                    options.threads = std::max<std::size_t>(parse_count(args[++i]), 1);
+                }
+                else if (arg == "--max-cycles" && has_value)
+                {
+                    options.max_cycles = parse_count(args[++i]);
+                }
+                else if (arg == "--profile")
+                {
+                    options.profile = true;
+                }
+                else if (arg == "--list" && has_value)
+                {
+                    std::ifstream list{args[++i]};
+                    if (!list)
+                    {
+                        std::cerr << fmt::format("could not open {}\n", args[i]);
+                        return std::nullopt;
+                    }
+                    for (std::string line; std::getline(list, line);)
+                    {
+                        if (!line.empty())
+                        {
+                            add_images(line, options.images);
+                        }
+                    }
+                }
+                else if (arg.starts_with("--"))
+                {
+                    return std::nullopt;
+                }
+                else
+                {
+                    add_images(arg, options.images);
+                }
+            }
+        }
+        catch (std::logic_error const&)
+        {
+            // std::stoull throws on values that are not numbers or out of range,
+            // by then `i` has moved on to the value
+            std::cerr << fmt::format("invalid value for {}: {}\n", args[i - 1], args[i]);
+            return std::nullopt;
+        }
+
+        if (options.images.empty())
+        {
+            return std::nullopt;
+        }
+        return options;
+    }
+
+    auto load_image(std::filesystem::path const& path) -> Image
+    {
+        std::ifstream file{path, std::ios::binary};
+        if (!file)
+        {
+            return {.path = path, .program = std::nullopt};
+        }
+
+        std::vector<std::uint8_t> program{
+            (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()};
+        if (file.bad())
+        {
+            return {.path = path, .program = std::nullopt};
+        }
+        return {.path = path, .program = std::move(program)};
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    auto const options = parse_options({argv + 1, static_cast<std::size_t>(argc - 1)});
+    if (!options)
+    {
+        print_usage();
+        return -1;
+    }
+
+    std::vector<Image> images;
+    images.reserve(options->images.size());
+    std::size_t unreadable = 0;
+    for (auto const& path : options->images)
+    {
+        auto& image = images.emplace_back(load_image(path));
+        if (!image.program)
+        {
+            std::cerr << fmt::format("could not read {}\n", path.string());
+            ++unreadable;
+        }
+    }
+
+    // Every worker gets its own pool, so acquiring a cpu for a job never
+    // allocates nor synchronises with the other workers
+    auto const workers = std::min(options->threads, std::max<std::size_t>(images.size(), 1));
+    std::vector<emulator::CpuPool> pools(workers);
+    std::vector<Result> results(images.size());
+
+    // Each worker thread records into its own book, merged once at the end
+    profiler::ProfileBooks books;
+
+    auto const start = std::chrono::steady_clock::now();
+    emulator::batch::parallel_for(images.size(),
+        workers,
+        [&](std::size_t worker, std::size_t index)
+        {
+            if (!images[index].program)
+            {
+                return;
+            }
+            auto const& program = *images[index].program;
+
+            auto cpu         = pools[worker].acquire();
+            cpu->clock_speed = 0; // unthrottled
+
+            emulator::SharedOpcodeProfiler opcode_profiler{books};
+            auto const run = options->profile ? emulator::run(*cpu, program, options->max_cycles, opcode_profiler)
+                                              : emulator::run(*cpu, program, options->max_cycles);
+
+            results[index] = {.reason = run.reason, .cycles = run.cycles, .hash = emulator::state_hash(*cpu)};
+        });
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "image,reason,cycles,hash\n";
+    for (std::size_t i = 0; i < images.size(); ++i)
+    {
+        auto const& result = results[i];
+        auto const reason  = images[i].program ? to_string(result.reason) : "error";
+        std::cout << fmt::format("{},{},{},{:016x}\n", images[i].path.string(), reason, result.cycles, result.hash);
+    }
+
+    std::cerr << fmt::format("ran {} images on {} threads in {:.3f}s ({:.0f} runs/s)\n",
+        images.size(),
+        workers,
+        elapsed,
+        elapsed > 0 ? static_cast<double>(images.size()) / elapsed : 0.0);
+
+    if (options->profile)
+    {
+        std::cerr << fmt::format("opcode profile of {} threads:\n", books.threads());
+        for (auto const& opcode : emulator::opcode_report(books.merged()))
+        {
+            std::cerr << fmt::format("{:#04x} {:<12} {:>10} calls {:>14} ticks (min {}, max {})\n",
+                opcode.opcode,
+                opcode.name,
+                opcode.count,
+                opcode.ticks,
+                opcode.min_ticks,
+                opcode.max_ticks);
+        }
+    }
+
+    return unreadable == 0 ? 0 : 1;
+}
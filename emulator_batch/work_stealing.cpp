@@ -0,0 +1,208 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+export module work_stealing;
+
+export namespace emulator::batch
+{
+    /// @brief Bounded Chase-Lev work-stealing deque.
+    ///
+    /// The owning worker pushes and pops at the bottom without contention,
+    /// other workers steal from the top. Only the last item left ever
+    /// needs a compare-and-swap on the owner's side. This follows the C11
+    /// formulation from "Correct and Efficient Work-Stealing for Weak
+    /// Memory Models" (Lê et al., 2013), minus the buffer growth: the
+    /// capacity is fixed up front.
+    template <typename T>
+    class WorkStealingDeque
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "items are copied in and out of atomics");
+
+    public:
+        explicit WorkStealingDeque(std::size_t capacity)
+            : _capacity{std::bit_ceil(std::max<std::size_t>(capacity, 1))},
+              _items{std::make_unique<std::atomic<T>[]>(_capacity)}
+        {
+        }
+
+        /// @brief adds an item at the bottom, owner only
+        /// @return false if the deque is full
+        bool push(T item)
+        {
+            auto const bottom = _bottom.load(std::memory_order_relaxed);
+            auto const top    = _top.load(std::memory_order_acquire);
+            if (bottom - top >= static_cast<std::int64_t>(_capacity))
+            {
+                return false;
+            }
+
+            slot(bottom).store(item, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /// @brief takes the most recently pushed item, owner only
+        std::optional<T> pop()
+        {
+            auto const bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = _top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                // Empty, put the bottom back where it was
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+
+            auto item = slot(bottom).load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // Last item, race the thieves for it
+                bool const won =
+                    _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                if (!won)
+                {
+                    return std::nullopt;
+                }
+            }
+            return item;
+        }
+
+        /// @brief takes the oldest item, any thread
+        /// @return nothing if the deque is empty, or if another thread
+        /// took the item first
+        std::optional<T> steal()
+        {
+            auto top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto const bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+            {
+                return std::nullopt;
+            }
+
+            auto item = slot(top).load(std::memory_order_relaxed);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return std::nullopt;
+            }
+            return item;
+        }
+
+        /// @brief whether the deque looked empty at the time of the call
+        [[nodiscard]] bool empty() const
+        {
+            return _top.load(std::memory_order_acquire) >= _bottom.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<T>& slot(std::int64_t index)
+        {
+            return _items[static_cast<std::size_t>(index) & (_capacity - 1)];
+        }
+
+        std::size_t _capacity;
+        std::unique_ptr<std::atomic<T>[]> _items;
+
+        // Thieves hammer the top, the owner the bottom
+        alignas(64) std::atomic<std::int64_t> _top{0};
+        alignas(64) std::atomic<std::int64_t> _bottom{0};
+    };
+
+    /// @brief calls `job(worker, index)` for every index in `[0, jobs)`
+    /// across `workers` threads, and returns once all of them are done.
+    ///
+    /// The indices are dealt out in contiguous blocks, one per worker, so
+    /// neighbouring jobs run on the same thread. A worker that runs out
+    /// steals single jobs from the top of a random victim, which keeps all
+    /// threads busy when job lengths vary wildly. Claiming a job costs an
+    /// uncontended pop in the common case, with no shared counter.
+    template <typename Job>
+    void parallel_for(std::size_t jobs, std::size_t workers, Job&& job)
+    {
+        workers = std::clamp<std::size_t>(workers, 1, std::max<std::size_t>(jobs, 1));
+
+        std::vector<std::unique_ptr<WorkStealingDeque<std::size_t>>> deques;
+        deques.reserve(workers);
+        for (std::size_t worker = 0; worker < workers; ++worker)
+        {
+            auto const begin = jobs * worker / workers;
+            auto const end   = jobs * (worker + 1) / workers;
+
+            auto& deque = deques.emplace_back(std::make_unique<WorkStealingDeque<std::size_t>>(end - begin));
+            // Pushed backwards, so the owner pops its block in order
+            // and thieves take from the far end
+            for (auto index = end; index > begin; --index)
+            {
+                deque->push(index - 1);
+            }
+        }
+
+        auto const work = [&](std::size_t worker)
+        {
+            auto& own = *deques[worker];
+
+            // xorshift, only used to pick victims
+            std::uint64_t seed = 0x9e37'79b9'7f4a'7c15 ^ (worker + 1);
+            auto const random  = [&seed]
+            {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                return seed;
+            };
+
+            while (true)
+            {
+                if (auto const index = own.pop())
+                {
+                    job(worker, *index);
+                    continue;
+                }
+
+                // No new jobs are ever pushed, so once every deque is seen
+                // empty there is nothing left to steal
+                bool all_empty    = true;
+                auto const offset = static_cast<std::size_t>(random() % workers);
+                for (std::size_t i = 0; i < workers; ++i)
+                {
+                    auto& victim = *deques[(offset + i) % workers];
+                    if (auto const index = victim.steal())
+                    {
+                        job(worker, *index);
+                        all_empty = false;
+                        break;
+                    }
+                    all_empty = all_empty && victim.empty();
+                }
+
+                if (all_empty)
+                {
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::jthread> threads;
+        threads.reserve(workers - 1);
+        for (std::size_t worker = 1; worker < workers; ++worker)
+        {
+            threads.emplace_back(work, worker);
+        }
+        work(0);
+    }
+} // namespace emulator::batch
@@ -0,0 +1,477 @@
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+import emulator;
+
+#ifdef EMULATOR_LIVE_EXPORT
+import live_export;
+#endif
+
+#ifdef EMULATOR_PERF_COUNTERS
+import profiler;
+#endif
+
+namespace
+{
+    /// First address of the memory mapped display
+    constexpr std::uint16_t display_start = 0x0200;
+
+    /// Width and height of the memory mapped display, in pixels (bytes)
+    constexpr std::size_t display_side = 32;
+
+    struct Options
+    {
+        std::string rom{};
+        std::size_t max_cycles{std::numeric_limits<std::size_t>::max()};
+        double clock_speed{0};
+        std::optional<std::string> display{};
+        bool registers{false};
+        bool profile{false};
+        std::size_t sample_period{0};
+        std::optional<std::string> symbols{};
+        std::optional<std::string> trace{};
+        std::optional<std::string> live_export{};
+        bool perf{false};
+        bool perf_opcodes{false};
+    };
+
+    /// Number of hot addresses and ranges the pc sampling report lists
+    constexpr std::size_t hot_spots = 10;
+
+    /// Cycles run between two updates of a live export
+    constexpr std::size_t live_export_slice = 10'000;
+
+    void print_usage()
+    {
+        std::cerr << "usage: emulator_headless [--max-cycles N] [--clock MHZ] [--display FILE|-] [--registers] "
+                     "[--profile | --sample-pc N [--symbols FILE] | --trace FILE] [--export NAME] ROM\n"
+                     "  --max-cycles N  stop after N cycles (default: run until the program stops)\n"
+                     "  --clock MHZ     pace the cpu to MHZ (default: as fast as possible)\n"
+                     "  --display FILE  write the 32x32 display memory to FILE, or as hex to stdout for -\n"
+                     "  --registers     print the registers and flags when done\n"
+                     "  --profile       time every opcode with the host tick counter and print the profile\n"
+                     "  --sample-pc N   sample the guest program counter every N cycles and print the hot spots\n"
+                     "  --symbols FILE  name the hot spots after the labels in FILE (\"al C000 .label\" per line)\n"
+                     "  --trace FILE    write every instruction executed to FILE, to decode with emulator_trace\n";
+#ifdef EMULATOR_PERF_COUNTERS
+        std::cerr << "  --perf          count host cycles, instructions, branch and L1d misses over the run\n"
+                     "  --perf-opcodes  same, per opcode handler (much slower, reads the counters per instruction)\n";
+#endif
+#ifdef EMULATOR_LIVE_EXPORT
+        std::cerr << "  --export NAME   publish the registers and memory in shared memory object NAME while running\n";
+#endif
+    }
+
+    auto parse_options(std::span<char*> args) -> std::optional<Options>
+    {
+        Options options;
+        std::size_t i = 0;
+        try
+        {
+            for (; i < args.size(); ++i)
+            {
+                std::string_view const arg{args[i]};
+                bool const has_value = i + 1 < args.size();
+                if (arg == "--max-cycles" && has_value)
+                {
+                    options.max_cycles = std::stoull(args[++i]);
+                }
+                else if (arg == "--clock" && has_value)
+                {
+                    options.clock_speed = std::stod(args[++i]);
+                }
+                else if (arg == "--display" && has_value)
+                {
+                    options.display = args[++i];
+                }
+                else if (arg == "--registers")
+                {
+                    options.registers = true;
+                }
+                else if (arg == "--profile")
+                {
+                    options.profile = true;
+                }
+                else if (arg == "--sample-pc" && has_value)
+                {
+                    options.sample_period = std::stoull(args[++i]);
+                }
+                else if (arg == "--symbols" && has_value)
+                {
+                    options.symbols = args[++i];
+                }
+                else if (arg == "--trace" && has_value)
+                {
+                    options.trace = args[++i];
+                }
+#ifdef EMULATOR_PERF_COUNTERS
+                else if (arg == "--perf")
+                {
+                    options.perf = true;
+                }
+                else if (arg == "--perf-opcodes")
+                {
+                    options.perf_opcodes = true;
+                }
+#endif
+#ifdef EMULATOR_LIVE_EXPORT
+                else if (arg == "--export" && has_value)
+                {
+                    options.live_export = args[++i];
+                }
+#endif
+                else if (arg.starts_with("--") || !options.rom.empty())
+                {
+                    return std::nullopt;
+                }
+                else
+                {
+                    options.rom = arg;
+                }
+            }
+        }
+        catch (std::logic_error const&)
+        {
+            // std::stoull and std::stod throw on values that are not numbers or out of range,
+            // by then `i` has moved on to the value
+            std::cerr << fmt::format("invalid value for {}: {}\n", args[i - 1], args[i]);
+            return std::nullopt;
+        }
+
+        // A run feeds a single observer: the profiler, the sampler or the trace
+        auto const observers = static_cast<int>(options.profile) + static_cast<int>(options.perf_opcodes)
+                               + static_cast<int>(options.sample_period > 0)
+                               + static_cast<int>(options.trace.has_value());
+        if (options.rom.empty() || observers > 1)
+        {
+            return std::nullopt;
+        }
+        return options;
+    }
+
+    auto to_string(emulator::StopReason reason) -> std::string_view
+    {
+        switch (reason)
+        {
+        case emulator::StopReason::Budget:
+            return "cycle budget used up";
+        case emulator::StopReason::EndOfProgram:
+            return "end of program";
+        case emulator::StopReason::Halted:
+            return "halted";
+        }
+        return "unknown";
+    }
+
+    /// @return false if the display could not be written to `destination`
+    bool dump_display(emulator::Cpu const& cpu, std::string const& destination)
+    {
+        if (destination == "-")
+        {
+            for (std::size_t row = 0; row < display_side; ++row)
+            {
+                std::string line;
+                for (std::size_t col = 0; col < display_side; ++col)
+                {
+                    line += fmt::format("{:02x}", cpu.mem[display_start + (row * display_side) + col]);
+                }
+                std::cout << line << '\n';
+            }
+            return true;
+        }
+
+        std::ofstream file{destination, std::ios::binary};
+        for (std::size_t i = 0; i < display_side * display_side; ++i)
+        {
+            file.put(static_cast<char>(cpu.mem[display_start + i]));
+        }
+        file.flush();
+        return file.good();
+    }
+
+    void dump_registers(emulator::Cpu const& cpu)
+    {
+        std::cout << fmt::format("A={:02x} X={:02x} Y={:02x} SP={:02x} PC={:04x} SR={:08b} (NV-BDIZC)\n",
+            cpu.reg.a,
+            cpu.reg.x,
+            cpu.reg.y,
+            cpu.reg.sp,
+            cpu.reg.pc,
+            cpu.sr());
+    }
+
+#ifdef EMULATOR_LIVE_EXPORT
+    /// @brief runs the program to the end or for `max_cycles`, one
+    /// `run_slice(budget)` call at a time, publishing the cpu state in the
+    /// shared memory object `name` after every slice for viewers such as
+    /// emulator_live_view. The cpu memory lives in the shared object
+    /// itself for the duration of the run.
+    template <typename RunSlice>
+    auto run_exported(emulator::Cpu& cpu, std::size_t max_cycles, std::string const& name, RunSlice&& run_slice)
+        -> emulator::RunResult
+    {
+        emulator::live::LiveExport live{name};
+        cpu.mem = emulator::Memory{live.memory()};
+
+        emulator::RunResult total{.cycles = 0, .reason = emulator::StopReason::Budget};
+        while (total.budget_used < max_cycles)
+        {
+            auto const slice = run_slice(std::min(live_export_slice, max_cycles - total.budget_used));
+            live.publish(cpu, slice.cycles);
+
+            total.cycles += slice.cycles;
+            total.budget_used += slice.budget_used;
+            total.reason = slice.reason;
+            if (slice.reason != emulator::StopReason::Budget)
+            {
+                break;
+            }
+        }
+
+        // Take the memory back out of the shared object before it goes away
+        cpu.mem = emulator::Memory{cpu.mem};
+        return total;
+    }
+#endif
+
+#ifdef EMULATOR_PERF_COUNTERS
+    /// @brief one line per event: the count over the run and per guest cycle
+    void print_perf(profiler::PerfCounters const& counters, profiler::PerfCounters::Values const& counted,
+        std::size_t guest_cycles)
+    {
+        auto const events = counters.events();
+        for (std::size_t i = 0; i < events.size(); ++i)
+        {
+            if (!counters.available(i))
+            {
+                std::cout << fmt::format("{:<24} {:>16}\n", profiler::perf_event_name(events[i]), "not supported");
+                continue;
+            }
+            std::cout << fmt::format("{:<24} {:>16} {:>10.2f} per guest cycle\n",
+                profiler::perf_event_name(events[i]),
+                counted[i],
+                static_cast<double>(counted[i]) / static_cast<double>(std::max<std::size_t>(guest_cycles, 1)));
+        }
+    }
+
+    /// @brief one line per executed opcode: the calls and the average
+    /// count of each event per call
+    void print_perf_opcodes(profiler::PerfOpcodeCounters const& profile)
+    {
+        auto const events = profile.counters().events();
+        std::string header = fmt::format("{:<4} {:<12} {:>10}", "op", "", "calls");
+        for (auto const event : events)
+        {
+            header += fmt::format(" {:>22}", profiler::perf_event_name(event));
+        }
+        std::cout << header << '\n';
+
+        for (std::size_t opcode = 0; opcode < profile.size(); ++opcode)
+        {
+            auto const& stats = profile[static_cast<std::uint8_t>(opcode)];
+            if (stats.count == 0)
+            {
+                continue;
+            }
+
+            auto line = fmt::format(
+                "{:#04x} {:<12} {:>10}", opcode, emulator::opcode_name(static_cast<std::uint8_t>(opcode)), stats.count);
+            for (std::size_t i = 0; i < events.size(); ++i)
+            {
+                if (!profile.counters().available(i))
+                {
+                    line += fmt::format(" {:>22}", "n/a");
+                    continue;
+                }
+                line += fmt::format(
+                    " {:>22.2f}", static_cast<double>(stats.totals[i]) / static_cast<double>(stats.count));
+            }
+            std::cout << line << '\n';
+        }
+    }
+#endif
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    auto const options = parse_options({argv + 1, static_cast<std::size_t>(argc - 1)});
+    if (!options)
+    {
+        print_usage();
+        return -1;
+    }
+
+    std::ifstream file{options->rom, std::ios::binary};
+    if (!file)
+    {
+        std::cerr << fmt::format("could not open {}\n", options->rom);
+        return -1;
+    }
+    std::vector<std::uint8_t> const program{(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()};
+
+    // Read the symbols before running, so a bad file does not waste the run
+    emulator::Symbols symbols;
+    if (options->symbols)
+    {
+        std::ifstream symbols_file{*options->symbols};
+        if (!symbols_file)
+        {
+            std::cerr << fmt::format("could not open {}\n", *options->symbols);
+            return -1;
+        }
+
+        try
+        {
+            symbols = emulator::Symbols::parse(symbols_file);
+        }
+        catch (std::exception const& e)
+        {
+            std::cerr << fmt::format("{}: {}\n", *options->symbols, e.what());
+            return -1;
+        }
+    }
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = options->clock_speed;
+
+    std::optional<emulator::PcSampler> sampler;
+    if (options->sample_period > 0)
+    {
+        sampler.emplace(options->sample_period);
+    }
+    std::optional<emulator::TraceWriter> trace;
+    if (options->trace)
+    {
+        try
+        {
+            trace.emplace(*options->trace);
+        }
+        catch (std::exception const& e)
+        {
+            std::cerr << e.what() << '\n';
+            return -1;
+        }
+    }
+    std::optional<emulator::OpcodeProfiler> opcode_profiler;
+    if (options->profile)
+    {
+        opcode_profiler.emplace();
+    }
+#ifdef EMULATOR_PERF_COUNTERS
+    std::optional<profiler::PerfOpcodeCounters> perf_opcodes;
+    std::optional<emulator::PerfOpcodeProfiler> perf_opcode_profiler;
+    if (options->perf_opcodes)
+    {
+        perf_opcode_profiler.emplace(perf_opcodes.emplace());
+    }
+    std::optional<profiler::PerfCounters> perf;
+    profiler::PerfCounters::Values perf_start{};
+    if (options->perf)
+    {
+        perf_start = perf.emplace().read();
+    }
+#endif
+
+    auto run_slice = [&](std::size_t budget)
+    {
+        if (trace)
+        {
+            return emulator::run(cpu, program, budget, *trace);
+        }
+        if (opcode_profiler)
+        {
+            return emulator::run(cpu, program, budget, *opcode_profiler);
+        }
+#ifdef EMULATOR_PERF_COUNTERS
+        if (perf_opcode_profiler)
+        {
+            return emulator::run(cpu, program, budget, *perf_opcode_profiler);
+        }
+#endif
+        return sampler ? emulator::run(cpu, program, budget, *sampler) : emulator::run(cpu, program, budget);
+    };
+
+#ifdef EMULATOR_LIVE_EXPORT
+    auto const result = options->live_export ? run_exported(cpu, options->max_cycles, *options->live_export, run_slice)
+                                             : run_slice(options->max_cycles);
+#else
+    auto const result = run_slice(options->max_cycles);
+#endif
+
+    std::cerr << fmt::format("{} after {} cycles\n", to_string(result.reason), result.cycles);
+
+#ifdef EMULATOR_PERF_COUNTERS
+    if (perf)
+    {
+        auto const perf_end = perf->read();
+        profiler::PerfCounters::Values counted{};
+        for (std::size_t i = 0; i < counted.size(); ++i)
+        {
+            counted[i] = perf_end[i] - perf_start[i];
+        }
+        print_perf(*perf, counted, result.budget_used);
+    }
+    if (perf_opcodes)
+    {
+        print_perf_opcodes(*perf_opcodes);
+    }
+#endif
+
+    auto status = 0;
+    if (trace)
+    {
+        try
+        {
+            trace->close();
+        }
+        catch (std::exception const& e)
+        {
+            std::cerr << e.what() << '\n';
+            status = -1;
+        }
+    }
+
+    if (options->display && !dump_display(cpu, *options->display))
+    {
+        std::cerr << fmt::format("could not write the display to {}\n", *options->display);
+        status = -1;
+    }
+
+    if (options->registers)
+    {
+        dump_registers(cpu);
+    }
+
+    if (opcode_profiler)
+    {
+        for (auto const& opcode : opcode_profiler->report())
+        {
+            std::cout << fmt::format("{:#04x} {:<12} {:>10} calls {:>14} ticks (min {}, max {})\n",
+                opcode.opcode,
+                opcode.name,
+                opcode.count,
+                opcode.ticks,
+                opcode.min_ticks,
+                opcode.max_ticks);
+        }
+    }
+
+    if (sampler)
+    {
+        std::cout << sampler->report(hot_spots, symbols);
+    }
+    return status;
+}
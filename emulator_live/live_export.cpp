@@ -0,0 +1,277 @@
+module;
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+export module live_export;
+
+import emulator;
+
+/*
+    A live export is a POSIX shared memory object laid out as a `Layout`:
+    a one page header holding a sequence counter and the registers,
+    followed by the guest's 64 KiB address space. The exporting cpu's
+    memory *is* that address space, so guest writes land in the shared
+    object directly and nothing is copied to publish them.
+
+    The sequence counter is a seqlock guarding the registers only. The
+    emulator makes it odd just while it stores the registers at the end
+    of a slice, so the window a viewer has to retry in is a few stores
+    long, however little the emulator yields between slices. A viewer
+    keeps its copy of the registers if the counter was even and did not
+    change meanwhile.
+
+    Memory is not covered by the seqlock: it is read live, while the
+    guest may be writing to it, so a copy can mix bytes from before and
+    after a write and need not match the registers it comes with.
+*/
+
+namespace emulator::live
+{
+    [[noreturn]] void throw_errno(char const* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+} // namespace emulator::live
+
+export namespace emulator::live
+{
+    /// Identifies a live export, "65k\x02" read as little endian
+    inline constexpr std::uint32_t magic = 0x02'6b'35'36;
+
+    inline constexpr std::uint32_t version = 1;
+
+    struct ExportedRegisters
+    {
+        /// cycles run since the export was created
+        std::uint64_t cycles;
+        std::uint16_t pc;
+        std::uint8_t a;
+        std::uint8_t x;
+        std::uint8_t y;
+        std::uint8_t sp;
+        std::uint8_t sr;
+        std::uint8_t reserved;
+    };
+
+    struct Layout
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+
+        /// odd while the emulator is storing the registers
+        std::atomic<std::uint32_t> sequence;
+        std::uint32_t reserved;
+
+        ExportedRegisters registers;
+
+        /// Page aligned, so viewers can map it on its own if they wish
+        alignas(4096) std::array<Page, page_count> memory;
+    };
+
+    // The sequence counter is shared between processes, so it must not
+    // fall back to a lock living in either of them
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+    static_assert(offsetof(Layout, memory) == 4096);
+
+    /// @brief A copy of an export, as seen by a viewer. The registers
+    /// are consistent, the memory is as the viewer found it while copying.
+    struct Snapshot
+    {
+        std::uint32_t sequence;
+        ExportedRegisters registers;
+        std::array<Page, page_count> memory;
+    };
+
+    /// @brief Publishes a cpu's registers and memory in a named shared
+    /// memory object that other processes can map read-only.
+    ///
+    /// Point the cpu at `memory()` and publish the registers after every
+    /// slice it runs:
+    ///
+    ///     emulator::live::LiveExport live{"/my-emulator"};
+    ///     cpu.mem = emulator::Memory{live.memory()};
+    ///     auto const result = emulator::run(cpu, program, 10'000);
+    ///     live.publish(cpu, result.cycles);
+    ///
+    /// Guest writes show up in the shared memory as they happen, only
+    /// the registers wait for `publish`.
+    ///
+    /// The shared memory object is removed when the export goes away.
+    class LiveExport
+    {
+    public:
+        /// @brief creates the shared memory object `name` (e.g. "/emu"),
+        /// replacing any previous object with the same name
+        explicit LiveExport(std::string name) : _name{std::move(name)}
+        {
+            auto const fd = ::shm_open(_name.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                throw_errno("shm_open");
+            }
+
+            // The mapping keeps the object alive, the descriptor is not needed past this point
+            bool const sized = ::ftruncate(fd, sizeof(Layout)) == 0;
+            void* const mapping =
+                sized ? ::mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+            auto const error = errno;
+            ::close(fd);
+            if (mapping == MAP_FAILED)
+            {
+                ::shm_unlink(_name.c_str());
+                errno = error;
+                throw_errno(sized ? "mmap" : "ftruncate");
+            }
+
+            // A fresh object reads as zeros, which is what the memory starts as
+            _layout          = static_cast<Layout*>(mapping);
+            _layout->magic   = magic;
+            _layout->version = version;
+            std::construct_at(&_layout->sequence, 0U);
+        }
+
+        LiveExport(LiveExport const&)            = delete;
+        LiveExport& operator=(LiveExport const&) = delete;
+
+        ~LiveExport()
+        {
+            ::munmap(_layout, sizeof(Layout));
+            ::shm_unlink(_name.c_str());
+        }
+
+        /// @brief the shared address space, meant to back a `Memory`
+        [[nodiscard]] std::span<Page, page_count> memory()
+        {
+            return _layout->memory;
+        }
+
+        [[nodiscard]] std::string const& name() const
+        {
+            return _name;
+        }
+
+        /// @brief publishes the registers of `cpu` and `cycles` more cycles
+        /// run. Viewers only retry while this runs, not for a whole slice.
+        void publish(Cpu const& cpu, std::size_t cycles)
+        {
+            auto const sequence = _layout->sequence.load(std::memory_order_relaxed);
+            _layout->sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            auto& registers = _layout->registers;
+            registers.cycles += cycles;
+            registers.pc = cpu.reg.pc;
+            registers.a  = cpu.reg.a;
+            registers.x  = cpu.reg.x;
+            registers.y  = cpu.reg.y;
+            registers.sp = cpu.reg.sp;
+            registers.sr = cpu.sr();
+
+            _layout->sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+    private:
+        std::string _name;
+        Layout* _layout{nullptr};
+    };
+
+    /// @brief Read-only view of a `LiveExport`, normally in another process
+    class LiveView
+    {
+    public:
+        explicit LiveView(std::string const& name)
+        {
+            auto const fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                throw_errno("shm_open");
+            }
+
+            struct stat info{};
+            bool const sized    = ::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= sizeof(Layout);
+            void* const mapping = sized ? ::mmap(nullptr, sizeof(Layout), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (mapping == MAP_FAILED)
+            {
+                throw std::runtime_error("could not map live export " + name);
+            }
+
+            _layout = static_cast<Layout const*>(mapping);
+            if (_layout->magic != magic || _layout->version != version)
+            {
+                ::munmap(const_cast<Layout*>(_layout), sizeof(Layout));
+                throw std::runtime_error(name + " is not a live export");
+            }
+        }
+
+        LiveView(LiveView const&)            = delete;
+        LiveView& operator=(LiveView const&) = delete;
+
+        ~LiveView()
+        {
+            ::munmap(const_cast<Layout*>(_layout), sizeof(Layout));
+        }
+
+        /// @brief the current sequence number, unchanged sequence numbers
+        /// mean nothing was published in between
+        [[nodiscard]] std::uint32_t sequence() const
+        {
+            return _layout->sequence.load(std::memory_order_acquire);
+        }
+
+        /// @brief copies the export into `out`, unless the registers are
+        /// being published right now
+        /// @return false if the registers copied may be torn, `out` is then
+        /// unspecified
+        bool try_read(Snapshot& out) const
+        {
+            auto const before = _layout->sequence.load(std::memory_order_acquire);
+            if (before % 2 != 0)
+            {
+                return false;
+            }
+
+            std::memcpy(&out.registers, &_layout->registers, sizeof(out.registers));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_layout->sequence.load(std::memory_order_relaxed) != before)
+            {
+                return false;
+            }
+
+            // Live, see the note at the top
+            std::memcpy(out.memory.data(), _layout->memory.data(), sizeof(out.memory));
+            out.sequence = before;
+            return true;
+        }
+
+        /// @brief copies the export into `out`, retrying while the
+        /// registers are being published
+        void read(Snapshot& out) const
+        {
+            while (!try_read(out))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        Layout const* _layout{nullptr};
+    };
+} // namespace emulator::live
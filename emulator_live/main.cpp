@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <fmt/format.h>
+
+import live_export;
+
+namespace
+{
+    /// First address of the memory mapped display
+    constexpr std::uint16_t display_start = 0x0200;
+
+    /// Width and height of the memory mapped display, in pixels (bytes)
+    constexpr std::size_t display_side = 32;
+
+    void print(emulator::live::Snapshot const& snapshot, bool display)
+    {
+        auto const& registers = snapshot.registers;
+        std::cout << fmt::format("cycles={} A={:02x} X={:02x} Y={:02x} SP={:02x} PC={:04x} SR={:08b}\n",
+            registers.cycles,
+            registers.a,
+            registers.x,
+            registers.y,
+            registers.sp,
+            registers.pc,
+            registers.sr);
+
+        if (!display)
+        {
+            return;
+        }
+
+        for (std::size_t row = 0; row < display_side; ++row)
+        {
+            std::string line;
+            for (std::size_t col = 0; col < display_side; ++col)
+            {
+                auto const addr = display_start + (row * display_side) + col;
+                line += fmt::format("{:02x}", snapshot.memory[addr >> 8][addr & 0xff]);
+            }
+            std::cout << line << '\n';
+        }
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    std::string name;
+    bool follow  = false;
+    bool display = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view const arg{argv[i]};
+        if (arg == "--follow")
+        {
+            follow = true;
+        }
+        else if (arg == "--display")
+        {
+            display = true;
+        }
+        else if (name.empty() && !arg.starts_with("--"))
+        {
+            name = arg;
+        }
+        else
+        {
+            name.clear();
+            break;
+        }
+    }
+
+    if (name.empty())
+    {
+        std::cerr << "usage: emulator_live_view [--follow] [--display] NAME\n"
+                     "  --follow   keep printing the state whenever it changes\n"
+                     "  --display  also print the 32x32 display memory as hex\n";
+        return -1;
+    }
+
+    emulator::live::LiveView const view{name};
+
+    // Too big for the stack
+    auto snapshot = std::make_unique<emulator::live::Snapshot>();
+    view.read(*snapshot);
+    print(*snapshot, display);
+
+    while (follow)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        if (view.sequence() != snapshot->sequence)
+        {
+            view.read(*snapshot);
+            print(*snapshot, display);
+        }
+    }
+}
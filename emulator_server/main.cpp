@@ -0,0 +1,67 @@
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <fmt/format.h>
+
+import service;
+
+namespace
+{
+    emulator::service::Server* running_server = nullptr;
+
+    void print_usage()
+    {
+        std::cerr << "usage: emulator_server SOCKET_PATH [MAX_CYCLES_PER_REQUEST]\n";
+    }
+
+    void stop_server(int /* signal */)
+    {
+        if (running_server != nullptr)
+        {
+            running_server->stop();
+        }
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return -1;
+    }
+
+    emulator::service::ServerConfig config{.path = argv[1]};
+    if (argc > 2)
+    {
+        try
+        {
+            std::string const value{argv[2]};
+            std::size_t parsed            = 0;
+            config.max_cycles_per_request = std::stoull(value, &parsed);
+            if (parsed != value.size())
+            {
+                throw std::invalid_argument("trailing characters");
+            }
+        }
+        catch (std::logic_error const&)
+        {
+            // std::stoull throws on values that are not numbers or out of range
+            std::cerr << fmt::format("invalid value for MAX_CYCLES_PER_REQUEST: {}\n", argv[2]);
+            print_usage();
+            return -1;
+        }
+    }
+
+    emulator::service::Server server{config};
+    running_server = &server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+
+    std::cout << fmt::format("listening on {}\n", config.path.string());
+    server.run();
+}
@@ -0,0 +1,223 @@
+module;
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+export module service_protocol;
+
+/*
+    Every message, in both directions, is a fixed 12 byte `Header`
+    followed by `Header::size` bytes of payload. Integers are in host
+    byte order: the protocol only ever runs over a Unix domain socket,
+    so both ends are on the same machine.
+
+    client -> server                      server -> client
+    Create   payload: program bytes       Created   header.session is the new id
+    Run      payload: RunRequest          Ran       payload: RunReply
+    Step     no payload                   Ran       payload: RunReply
+    Snapshot no payload                   State     payload: SnapshotHeader + 64KiB memory
+    Watch    no payload                   Display   payload: DisplayRun headers + bytes
+    Unwatch  no payload                   Done      no payload
+    Destroy  no payload                   Done      no payload
+                                          Error     payload: ErrorCode
+*/
+
+export namespace emulator::service
+{
+    enum class MessageType : std::uint16_t
+    {
+        // Requests
+        Create   = 0x01,
+        Run      = 0x02,
+        Step     = 0x03,
+        Snapshot = 0x04,
+        Watch    = 0x05,
+        Unwatch  = 0x06,
+        Destroy  = 0x07,
+
+        // Replies
+        Created = 0x81,
+        Ran     = 0x82,
+        State   = 0x83,
+        Display = 0x84,
+        Done    = 0x85,
+        Error   = 0x86,
+    };
+
+    enum class ErrorCode : std::uint16_t
+    {
+        BadMessage      = 1,
+        UnknownSession  = 2,
+        MessageTooLarge = 3,
+    };
+
+    struct Header
+    {
+        /// payload bytes following the header
+        std::uint32_t size;
+        MessageType type;
+        std::uint16_t reserved;
+        std::uint32_t session;
+    };
+
+    struct RunRequest
+    {
+        std::uint64_t max_cycles;
+    };
+
+    struct RunReply
+    {
+        std::uint64_t cycles;
+        std::uint8_t reason; // emulator::StopReason
+        std::uint8_t a;
+        std::uint8_t x;
+        std::uint8_t y;
+        std::uint8_t sp;
+        std::uint8_t sr;
+        std::uint16_t pc;
+    };
+
+    /// Followed by the whole 64KiB address space
+    struct SnapshotHeader
+    {
+        std::uint8_t a;
+        std::uint8_t x;
+        std::uint8_t y;
+        std::uint8_t sp;
+        std::uint8_t sr;
+        std::uint8_t reserved;
+        std::uint16_t pc;
+    };
+
+    /// Followed by `size` display bytes starting at display `offset`
+    struct DisplayRun
+    {
+        std::uint16_t offset;
+        std::uint16_t size;
+    };
+
+    static_assert(sizeof(Header) == 12);
+    static_assert(sizeof(RunRequest) == 8);
+    static_assert(sizeof(RunReply) == 16);
+    static_assert(sizeof(SnapshotHeader) == 8);
+    static_assert(sizeof(DisplayRun) == 4);
+
+    /// Largest payload either side accepts, comfortably above a 64KiB program
+    inline constexpr std::uint32_t max_payload = 1 << 20;
+
+    /// First address and size of the memory mapped display
+    inline constexpr std::uint16_t display_start = 0x0200;
+    inline constexpr std::size_t display_size    = 0x0400;
+
+    /// @brief appends the raw bytes of `value` to `out`
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    void put(std::vector<std::uint8_t>& out, T const& value)
+    {
+        auto const* bytes = reinterpret_cast<std::uint8_t const*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    /// @brief reads a `T` from the front of `in`, if there are enough bytes
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    std::optional<T> get(std::span<const std::uint8_t> in)
+    {
+        if (in.size() < sizeof(T))
+        {
+            return std::nullopt;
+        }
+
+        T value;
+        std::memcpy(&value, in.data(), sizeof(T));
+        return value;
+    }
+
+    /// @brief a whole message with a payload, ready to be sent
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    std::vector<std::uint8_t> message(MessageType type, std::uint32_t session, T const& payload)
+    {
+        std::vector<std::uint8_t> out;
+        out.reserve(sizeof(Header) + sizeof(T));
+        put(out, Header{.size = sizeof(T), .type = type, .reserved = 0, .session = session});
+        put(out, payload);
+        return out;
+    }
+
+    /// @brief a whole message without a payload, or with `payload`
+    /// copied in after the header
+    inline std::vector<std::uint8_t> message(
+        MessageType type, std::uint32_t session, std::span<const std::uint8_t> payload = {})
+    {
+        std::vector<std::uint8_t> out;
+        out.reserve(sizeof(Header) + payload.size());
+        put(out,
+            Header{.size = static_cast<std::uint32_t>(payload.size()), .type = type, .reserved = 0, .session = session});
+        out.insert(out.end(), payload.begin(), payload.end());
+        return out;
+    }
+
+    /// @brief the display bytes that changed between `before` and
+    /// `after`, as `DisplayRun`s. Changes closer than a run header apart
+    /// are merged into one run.
+    /// @return the encoded runs, empty if nothing changed
+    inline std::vector<std::uint8_t> display_delta(
+        std::span<const std::uint8_t, display_size> before, std::span<const std::uint8_t, display_size> after)
+    {
+        std::vector<std::uint8_t> out;
+        std::size_t i = 0;
+        while (i < display_size)
+        {
+            if (before[i] == after[i])
+            {
+                ++i;
+                continue;
+            }
+
+            // Grow the run up to the last change that is no further than
+            // a run header away from the previous one
+            auto const begin = i;
+            auto end         = i + 1;
+            for (auto j = end; j < display_size && j - end <= sizeof(DisplayRun); ++j)
+            {
+                if (before[j] != after[j])
+                {
+                    end = j + 1;
+                }
+            }
+
+            put(out,
+                DisplayRun{.offset = static_cast<std::uint16_t>(begin), .size = static_cast<std::uint16_t>(end - begin)});
+            out.insert(out.end(), after.begin() + static_cast<std::ptrdiff_t>(begin),
+                after.begin() + static_cast<std::ptrdiff_t>(end));
+            i = end;
+        }
+        return out;
+    }
+
+    /// @brief applies display runs produced by `display_delta` to `display`
+    /// @return false if the runs are malformed
+    inline bool apply_display_delta(std::span<const std::uint8_t> runs, std::span<std::uint8_t, display_size> display)
+    {
+        while (!runs.empty())
+        {
+            auto const run = get<DisplayRun>(runs);
+            if (!run || runs.size() < sizeof(DisplayRun) + run->size
+                || std::size_t{run->offset} + run->size > display_size)
+            {
+                return false;
+            }
+
+            std::memcpy(display.data() + run->offset, runs.data() + sizeof(DisplayRun), run->size);
+            runs = runs.subspan(sizeof(DisplayRun) + run->size);
+        }
+        return true;
+    }
+} // namespace emulator::service
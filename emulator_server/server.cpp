@@ -0,0 +1,569 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+export module service;
+
+import emulator;
+import service_protocol;
+
+namespace emulator::service
+{
+    [[noreturn]] void throw_errno(char const* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    /// @brief owns a file descriptor, closing it when it goes away
+    class FileDescriptor
+    {
+    public:
+        FileDescriptor() = default;
+
+        explicit FileDescriptor(int fd) : _fd{fd} {}
+
+        FileDescriptor(FileDescriptor const&)            = delete;
+        FileDescriptor& operator=(FileDescriptor const&) = delete;
+
+        FileDescriptor(FileDescriptor&& other) noexcept : _fd{std::exchange(other._fd, -1)} {}
+
+        FileDescriptor& operator=(FileDescriptor&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                _fd = std::exchange(other._fd, -1);
+            }
+            return *this;
+        }
+
+        ~FileDescriptor()
+        {
+            reset();
+        }
+
+        [[nodiscard]] int get() const
+        {
+            return _fd;
+        }
+
+    private:
+        void reset()
+        {
+            if (_fd >= 0)
+            {
+                ::close(_fd);
+                _fd = -1;
+            }
+        }
+
+        int _fd{-1};
+    };
+} // namespace emulator::service
+
+export namespace emulator::service
+{
+    struct ServerConfig
+    {
+        /// Path of the Unix domain socket to listen on, replaced if it exists
+        std::filesystem::path path;
+
+        /// Most cycles a single Run request may take, longer runs are cut
+        /// short and reported with `StopReason::Budget` so one session
+        /// cannot hold up the event loop
+        std::size_t max_cycles_per_request{1'000'000};
+    };
+
+    /// @brief Single threaded epoll server exposing emulator sessions over
+    /// a Unix domain socket, see the service_protocol module for the wire
+    /// format.
+    ///
+    /// Each connection owns the sessions it creates, and they are
+    /// destroyed when it disconnects. Session memory is sparse and backed
+    /// by one page pool shared by every session, so an idle session only
+    /// costs the pages its program wrote to. Snapshots are sent straight
+    /// out of the session's memory pages with `sendmsg`, without copying
+    /// them into a buffer first; a connection's requests are not read
+    /// while it has replies in flight, so the pages cannot change under a
+    /// partially sent snapshot.
+    class Server
+    {
+    public:
+        explicit Server(ServerConfig config) : _config{std::move(config)}
+        {
+            _epoll = FileDescriptor{::epoll_create1(EPOLL_CLOEXEC)};
+            if (_epoll.get() < 0)
+            {
+                throw_errno("epoll_create1");
+            }
+
+            _wakeup = FileDescriptor{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+            if (_wakeup.get() < 0)
+            {
+                throw_errno("eventfd");
+            }
+            watch(_wakeup.get(), EPOLLIN);
+
+            listen();
+        }
+
+        Server(Server const&)            = delete;
+        Server& operator=(Server const&) = delete;
+
+        ~Server()
+        {
+            std::error_code ignored;
+            std::filesystem::remove(_config.path, ignored);
+        }
+
+        /// @brief handles connections until `stop` is called
+        void run()
+        {
+            std::array<epoll_event, 64> events{};
+            while (!_stopping)
+            {
+                auto const ready = ::epoll_wait(_epoll.get(), events.data(), static_cast<int>(events.size()), -1);
+                if (ready < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    throw_errno("epoll_wait");
+                }
+
+                for (int i = 0; i < ready; ++i)
+                {
+                    auto const fd = events[i].data.fd;
+                    if (fd == _wakeup.get())
+                    {
+                        _stopping = true;
+                    }
+                    else if (fd == _listener.get())
+                    {
+                        accept();
+                    }
+                    else
+                    {
+                        handle(fd, events[i].events);
+                    }
+                }
+            }
+        }
+
+        /// @brief makes `run` return, can be called from any thread
+        void stop()
+        {
+            std::uint64_t const one = 1;
+            [[maybe_unused]] auto const written = ::write(_wakeup.get(), &one, sizeof(one));
+        }
+
+        [[nodiscard]] std::size_t connections() const
+        {
+            return _connections.size();
+        }
+
+    private:
+        struct Session
+        {
+            std::unique_ptr<Cpu> cpu;
+            std::vector<std::uint8_t> program;
+            bool watching{false};
+
+            /// the display as the client last saw it
+            std::array<std::uint8_t, display_size> display{};
+        };
+
+        /// @brief bytes waiting to go out, either owned by the chunk or
+        /// borrowed from session memory
+        struct Chunk
+        {
+            std::vector<std::uint8_t> owned{};
+            std::span<const std::uint8_t> view{};
+        };
+
+        struct Connection
+        {
+            FileDescriptor socket;
+            std::vector<std::uint8_t> input{};
+            std::deque<Chunk> output{};
+
+            /// bytes of the first output chunk already sent
+            std::size_t sent{0};
+
+            std::unordered_map<std::uint32_t, Session> sessions{};
+            std::uint32_t next_session{1};
+        };
+
+        void listen()
+        {
+            _listener = FileDescriptor{::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+            if (_listener.get() < 0)
+            {
+                throw_errno("socket");
+            }
+
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            auto const path    = _config.path.string();
+            if (path.size() >= sizeof(address.sun_path))
+            {
+                throw std::system_error(std::make_error_code(std::errc::filename_too_long), path);
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            std::error_code ignored;
+            std::filesystem::remove(_config.path, ignored);
+            if (::bind(_listener.get(), reinterpret_cast<sockaddr const*>(&address), sizeof(address)) < 0)
+            {
+                throw_errno("bind");
+            }
+            if (::listen(_listener.get(), SOMAXCONN) < 0)
+            {
+                throw_errno("listen");
+            }
+            watch(_listener.get(), EPOLLIN);
+        }
+
+        void watch(int fd, std::uint32_t events)
+        {
+            epoll_event event{.events = events, .data = {.fd = fd}};
+            if (::epoll_ctl(_epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0)
+            {
+                throw_errno("epoll_ctl");
+            }
+        }
+
+        void rewatch(int fd, std::uint32_t events)
+        {
+            epoll_event event{.events = events, .data = {.fd = fd}};
+            ::epoll_ctl(_epoll.get(), EPOLL_CTL_MOD, fd, &event);
+        }
+
+        void accept()
+        {
+            while (true)
+            {
+                FileDescriptor socket{::accept4(_listener.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+                if (socket.get() < 0)
+                {
+                    return;
+                }
+
+                auto const fd = socket.get();
+                watch(fd, EPOLLIN | EPOLLRDHUP);
+                _connections.emplace(fd, Connection{.socket = std::move(socket)});
+            }
+        }
+
+        void handle(int fd, std::uint32_t events)
+        {
+            auto found = _connections.find(fd);
+            if (found == _connections.end())
+            {
+                return;
+            }
+            auto& connection = found->second;
+
+            bool open = (events & (EPOLLERR | EPOLLHUP)) == 0;
+            if (open && (events & EPOLLOUT) != 0)
+            {
+                open = flush(connection);
+            }
+            if (open && (events & (EPOLLIN | EPOLLRDHUP)) != 0)
+            {
+                open = receive(connection);
+            }
+            if (open && connection.output.empty())
+            {
+                open = process(connection);
+            }
+
+            if (!open)
+            {
+                // Closing the socket also takes it out of the epoll set
+                _connections.erase(found);
+                return;
+            }
+            rewatch(fd, connection.output.empty() ? (EPOLLIN | EPOLLRDHUP) : EPOLLOUT);
+        }
+
+        /// @return false if the peer went away
+        bool receive(Connection& connection)
+        {
+            std::array<std::uint8_t, 64 * 1024> buffer{};
+            while (true)
+            {
+                auto const received = ::recv(connection.socket.get(), buffer.data(), buffer.size(), 0);
+                if (received > 0)
+                {
+                    connection.input.insert(connection.input.end(), buffer.begin(), buffer.begin() + received);
+                    continue;
+                }
+                if (received == 0)
+                {
+                    return false;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+        }
+
+        /// @brief handles every complete request received, stopping as
+        /// soon as one of them leaves replies in flight
+        /// @return false if the connection has to be closed
+        bool process(Connection& connection)
+        {
+            std::size_t consumed = 0;
+            bool open            = true;
+            while (open && connection.output.empty())
+            {
+                std::span<const std::uint8_t> const pending{connection.input.begin() + consumed, connection.input.end()};
+                auto const header = get<Header>(pending);
+                if (!header)
+                {
+                    break;
+                }
+                if (header->size > max_payload)
+                {
+                    reply(connection, message(MessageType::Error, header->session, ErrorCode::MessageTooLarge));
+                    flush(connection);
+                    return false;
+                }
+                if (pending.size() < sizeof(Header) + header->size)
+                {
+                    break;
+                }
+
+                consumed += sizeof(Header) + header->size;
+                dispatch(connection, *header, pending.subspan(sizeof(Header), header->size));
+                open = flush(connection);
+            }
+
+            connection.input.erase(connection.input.begin(), connection.input.begin() + consumed);
+            return open;
+        }
+
+        void dispatch(Connection& connection, Header const& header, std::span<const std::uint8_t> payload)
+        {
+            if (header.type == MessageType::Create)
+            {
+                auto const id = connection.next_session++;
+
+                Session session{.cpu = std::make_unique<Cpu>(), .program = {payload.begin(), payload.end()}};
+                session.cpu->mem         = Memory{_pages};
+                session.cpu->clock_speed = 0;
+                connection.sessions.emplace(id, std::move(session));
+
+                reply(connection, message(MessageType::Created, id));
+                return;
+            }
+
+            auto found = connection.sessions.find(header.session);
+            if (found == connection.sessions.end())
+            {
+                reply(connection, message(MessageType::Error, header.session, ErrorCode::UnknownSession));
+                return;
+            }
+            auto& session = found->second;
+
+            switch (header.type)
+            {
+            case MessageType::Run:
+            {
+                auto const request = get<RunRequest>(payload);
+                if (!request)
+                {
+                    reply(connection, message(MessageType::Error, header.session, ErrorCode::BadMessage));
+                    return;
+                }
+                auto const cycles = std::min<std::size_t>(request->max_cycles, _config.max_cycles_per_request);
+                ran(connection, header.session, session, emulator::run(*session.cpu, session.program, cycles));
+                return;
+            }
+            case MessageType::Step:
+                ran(connection, header.session, session, emulator::run(*session.cpu, session.program, 1));
+                return;
+            case MessageType::Snapshot:
+                snapshot(connection, header.session, session);
+                return;
+            case MessageType::Watch:
+                // Send the whole display first, as a delta from nothing
+                session.watching = true;
+                session.display  = {};
+                reply(connection, message(MessageType::Done, header.session));
+                send_display(connection, header.session, session, true);
+                return;
+            case MessageType::Unwatch:
+                session.watching = false;
+                reply(connection, message(MessageType::Done, header.session));
+                return;
+            case MessageType::Destroy:
+                connection.sessions.erase(found);
+                reply(connection, message(MessageType::Done, header.session));
+                return;
+            default:
+                reply(connection, message(MessageType::Error, header.session, ErrorCode::BadMessage));
+                return;
+            }
+        }
+
+        void ran(Connection& connection, std::uint32_t id, Session& session, RunResult const& result)
+        {
+            auto const& cpu = *session.cpu;
+            reply(connection,
+                message(MessageType::Ran,
+                    id,
+                    RunReply{
+                        .cycles = result.cycles,
+                        .reason = static_cast<std::uint8_t>(result.reason),
+                        .a      = cpu.reg.a,
+                        .x      = cpu.reg.x,
+                        .y      = cpu.reg.y,
+                        .sp     = cpu.reg.sp,
+                        .sr     = cpu.sr(),
+                        .pc     = cpu.reg.pc,
+                    }));
+
+            if (session.watching)
+            {
+                send_display(connection, id, session, false);
+            }
+        }
+
+        void send_display(Connection& connection, std::uint32_t id, Session& session, bool always)
+        {
+            std::array<std::uint8_t, display_size> display{};
+            for (std::size_t i = 0; i < display_size; ++i)
+            {
+                display[i] = session.cpu->mem[display_start + i];
+            }
+
+            std::array<std::uint8_t, display_size> before = session.display;
+            if (always)
+            {
+                // Make every byte differ, so the first delta is complete
+                for (std::size_t i = 0; i < display_size; ++i)
+                {
+                    before[i] = static_cast<std::uint8_t>(~display[i]);
+                }
+            }
+
+            auto const delta = display_delta(before, display);
+            session.display  = display;
+            if (!delta.empty())
+            {
+                reply(connection, message(MessageType::Display, id, delta));
+            }
+        }
+
+        void snapshot(Connection& connection, std::uint32_t id, Session& session)
+        {
+            auto const& cpu = *session.cpu;
+
+            std::vector<std::uint8_t> head;
+            put(head,
+                Header{.size       = static_cast<std::uint32_t>(sizeof(SnapshotHeader) + address_space_size),
+                    .type          = MessageType::State,
+                    .reserved      = 0,
+                    .session       = id});
+            put(head,
+                SnapshotHeader{
+                    .a        = cpu.reg.a,
+                    .x        = cpu.reg.x,
+                    .y        = cpu.reg.y,
+                    .sp       = cpu.reg.sp,
+                    .sr       = cpu.sr(),
+                    .reserved = 0,
+                    .pc       = cpu.reg.pc,
+                });
+            reply(connection, std::move(head));
+
+            // The pages go out straight from the session's memory
+            for (std::size_t page = 0; page < page_count; ++page)
+            {
+                connection.output.push_back(Chunk{.view = cpu.mem.page(page)});
+            }
+        }
+
+        static void reply(Connection& connection, std::vector<std::uint8_t> bytes)
+        {
+            auto& chunk = connection.output.emplace_back(Chunk{.owned = std::move(bytes)});
+            chunk.view  = chunk.owned;
+        }
+
+        /// @brief sends as much of the pending output as the socket takes
+        /// @return false if the peer went away
+        static bool flush(Connection& connection)
+        {
+            while (!connection.output.empty())
+            {
+                std::array<iovec, 64> vectors{};
+                std::size_t count = 0;
+                for (auto it = connection.output.begin(); it != connection.output.end() && count < vectors.size();
+                     ++it, ++count)
+                {
+                    auto const skip = count == 0 ? connection.sent : 0;
+                    vectors[count]  = iovec{
+                         .iov_base = const_cast<std::uint8_t*>(it->view.data() + skip),
+                         .iov_len  = it->view.size() - skip,
+                    };
+                }
+
+                // MSG_NOSIGNAL: a peer gone mid-reply must not raise SIGPIPE and take down every session
+                msghdr message{};
+                message.msg_iov    = vectors.data();
+                message.msg_iovlen = count;
+                auto sent          = ::sendmsg(connection.socket.get(), &message, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                }
+
+                // Drop the chunks that went out completely
+                auto remaining = static_cast<std::size_t>(sent);
+                while (remaining > 0)
+                {
+                    auto const left = connection.output.front().view.size() - connection.sent;
+                    if (remaining < left)
+                    {
+                        connection.sent += remaining;
+                        break;
+                    }
+                    remaining -= left;
+                    connection.sent = 0;
+                    connection.output.pop_front();
+                }
+            }
+            return true;
+        }
+
+        ServerConfig _config;
+        FileDescriptor _epoll;
+        FileDescriptor _wakeup;
+        FileDescriptor _listener;
+        std::unordered_map<int, Connection> _connections;
+        std::shared_ptr<PagePool> _pages{std::make_shared<PagePool>()};
+        bool _stopping{false};
+    };
+} // namespace emulator::service
@@ -0,0 +1,118 @@
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+import emulator;
+
+namespace
+{
+    struct Options
+    {
+        std::filesystem::path trace{};
+        std::size_t limit{std::numeric_limits<std::size_t>::max()};
+    };
+
+    void print_usage()
+    {
+        std::cerr << "usage: emulator_trace [--limit N] TRACE\n";
+    }
+
+    auto parse_options(std::span<char*> args) -> std::optional<Options>
+    {
+        Options options;
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            std::string_view const arg{args[i]};
+            bool const has_value = i + 1 < args.size();
+            if (arg == "--limit" && has_value)
+            {
+                try
+                {
+                    std::string const value{args[++i]};
+                    std::size_t parsed = 0;
+                    options.limit      = std::stoull(value, &parsed);
+                    if (parsed != value.size())
+                    {
+                        throw std::invalid_argument("trailing characters");
+                    }
+                }
+                catch (std::logic_error const&)
+                {
+                    // std::stoull throws on values that are not numbers or out of range
+                    std::cerr << fmt::format("invalid value for --limit: {}\n", args[i]);
+                    return std::nullopt;
+                }
+            }
+            else if (arg.starts_with("--") || !options.trace.empty())
+            {
+                return std::nullopt;
+            }
+            else
+            {
+                options.trace = arg;
+            }
+        }
+
+        if (options.trace.empty())
+        {
+            return std::nullopt;
+        }
+        return options;
+    }
+
+    /// @brief one line per record: cycle stamp, address, the instruction
+    /// bytes, the disassembly and the registers after the instruction
+    void print(emulator::TraceRecord const& record)
+    {
+        auto const size = emulator::instruction_size(emulator::opcode_table[record.opcode].mode);
+        auto bytes      = fmt::format("{:02X}", record.opcode);
+        for (std::size_t i = 1; i < size; ++i)
+        {
+            bytes += fmt::format(" {:02X}", record.operands[i - 1]);
+        }
+
+        fmt::print("{:>12} {:04X}  {:<8} {:<14} A:{:02X} X:{:02X} Y:{:02X} SP:{:02X} P:{:02X}\n", record.cycle,
+            record.pc, bytes, emulator::disassemble(record.opcode, record.operands, record.pc), record.a, record.x,
+            record.y, record.sp, record.sr);
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    auto const options = parse_options({argv + 1, static_cast<std::size_t>(argc - 1)});
+    if (!options)
+    {
+        print_usage();
+        return -1;
+    }
+
+    try
+    {
+        emulator::TraceReader reader{options->trace};
+        for (std::size_t decoded = 0; decoded < options->limit; ++decoded)
+        {
+            auto const record = reader.next();
+            if (!record)
+            {
+                break;
+            }
+            print(*record);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+    return 0;
+}
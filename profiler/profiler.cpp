@@ -1,54 +1,840 @@
 module;
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
-#include <concepts>
-#include <iostream>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
 #include <memory>
-#include <source_location>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
 
 export module profiler;
 
 export namespace profiler
 {
+    /// @brief reads the host's cheapest tick counter: the time stamp
+    /// counter on x86-64, the virtual counter on aarch64 and the steady
+    /// clock anywhere else. Ticks are only comparable on the same host.
+    inline std::uint64_t ticks()
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        std::uint64_t value;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+        return value;
+#else
+        return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    struct OpcodeStats
+    {
+        std::uint64_t count{0};
+        std::uint64_t total{0};
+        std::uint64_t min{std::numeric_limits<std::uint64_t>::max()};
+        std::uint64_t max{0};
+    };
+
+    /// @brief Call count and tick totals for each of the 256 opcodes.
+    /// Recording is a few adds into a fixed array, it never allocates
+    /// and never looks up a name.
+    class OpcodeCounters
+    {
+    public:
+        void record(std::uint8_t opcode, std::uint64_t elapsed) noexcept
+        {
+            auto& stats = _stats[opcode];
+            ++stats.count;
+            stats.total += elapsed;
+            stats.min = elapsed < stats.min ? elapsed : stats.min;
+            stats.max = elapsed > stats.max ? elapsed : stats.max;
+        }
+
+        [[nodiscard]] OpcodeStats const& operator[](std::uint8_t opcode) const
+        {
+            return _stats[opcode];
+        }
+
+        [[nodiscard]] static constexpr std::size_t size()
+        {
+            return 256;
+        }
+
+        void reset() noexcept
+        {
+            _stats = {};
+        }
+
+        /// @brief adds the calls and ticks recorded in `other`
+        void merge(OpcodeCounters const& other) noexcept
+        {
+            for (std::size_t opcode = 0; opcode < _stats.size(); ++opcode)
+            {
+                merge(static_cast<std::uint8_t>(opcode), other._stats[opcode]);
+            }
+        }
+
+        /// @brief adds calls and ticks of `opcode` counted elsewhere
+        void merge(std::uint8_t opcode, OpcodeStats const& other) noexcept
+        {
+            auto& stats = _stats[opcode];
+            stats.count += other.count;
+            stats.total += other.total;
+            stats.min = std::min(stats.min, other.min);
+            stats.max = std::max(stats.max, other.max);
+        }
+
+    private:
+        std::array<OpcodeStats, 256> _stats{};
+    };
+
+    /// @brief Opcode counters for any number of cpus running on any
+    /// number of threads, with one book per thread.
+    ///
+    /// Recording only ever writes to the calling thread's book, so threads
+    /// never contend nor wait for each other. `merged()` adds up every
+    /// book on demand, from any thread, while the others keep recording.
+    /// Books are never freed before the `ProfileBooks`, so what a thread
+    /// recorded is still in the merge after it exits.
+    class ProfileBooks
+    {
+    public:
+        ProfileBooks() = default;
+
+        ProfileBooks(ProfileBooks const&)            = delete;
+        ProfileBooks& operator=(ProfileBooks const&) = delete;
+
+        ~ProfileBooks()
+        {
+            for (auto* book = _books.load(std::memory_order_acquire); book != nullptr;)
+            {
+                delete std::exchange(book, book->next);
+            }
+        }
+
+        void record(std::uint8_t opcode, std::uint64_t elapsed) noexcept
+        {
+            local().record(opcode, elapsed);
+        }
+
+        /// @brief the counts of every book added up. Counts a thread is
+        /// recording at the same time may be missing its latest calls.
+        [[nodiscard]] OpcodeCounters merged() const
+        {
+            OpcodeCounters merged;
+            for (auto const* book = _books.load(std::memory_order_acquire); book != nullptr; book = book->next)
+            {
+                book->merge_into(merged);
+            }
+            return merged;
+        }
+
+        /// @brief number of threads that recorded anything
+        [[nodiscard]] std::size_t threads() const
+        {
+            std::size_t threads = 0;
+            for (auto const* book = _books.load(std::memory_order_acquire); book != nullptr; book = book->next)
+            {
+                ++threads;
+            }
+            return threads;
+        }
+
+    private:
+        struct Entry
+        {
+            std::atomic<std::uint64_t> count{0};
+            std::atomic<std::uint64_t> total{0};
+            std::atomic<std::uint64_t> min{std::numeric_limits<std::uint64_t>::max()};
+            std::atomic<std::uint64_t> max{0};
+        };
+
+        /// One thread's counters. Only their owner writes them, so plain
+        /// relaxed loads and stores are enough, no read-modify-writes:
+        /// the atomics are only there for `merged()` to read them.
+        struct Book
+        {
+            std::thread::id owner;
+            Book* next{nullptr};
+            std::array<Entry, 256> stats{};
+
+            void record(std::uint8_t opcode, std::uint64_t elapsed) noexcept
+            {
+                auto& entry = stats[opcode];
+                entry.count.store(entry.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                entry.total.store(entry.total.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+                if (elapsed < entry.min.load(std::memory_order_relaxed))
+                {
+                    entry.min.store(elapsed, std::memory_order_relaxed);
+                }
+                if (elapsed > entry.max.load(std::memory_order_relaxed))
+                {
+                    entry.max.store(elapsed, std::memory_order_relaxed);
+                }
+            }
+
+            void merge_into(OpcodeCounters& counters) const noexcept
+            {
+                for (std::size_t opcode = 0; opcode < stats.size(); ++opcode)
+                {
+                    auto const& entry = stats[opcode];
+                    counters.merge(static_cast<std::uint8_t>(opcode),
+                        OpcodeStats{
+                            .count = entry.count.load(std::memory_order_relaxed),
+                            .total = entry.total.load(std::memory_order_relaxed),
+                            .min   = entry.min.load(std::memory_order_relaxed),
+                            .max   = entry.max.load(std::memory_order_relaxed),
+                        });
+                }
+            }
+        };
+
+        /// @brief the calling thread's book, added on its first call
+        Book& local()
+        {
+            // Remembers the last book this thread used, tagged with the id
+            // of its `ProfileBooks` rather than its address, which a later
+            // one could reuse
+            thread_local std::uint64_t cached_id = 0;
+            thread_local Book* cached_book       = nullptr;
+            if (cached_id == _id) [[likely]]
+            {
+                return *cached_book;
+            }
 
-    // Constrait for collections that can be used to store
-    // a profile result
-    template <typename T, typename FuncName, typename Measure>
-    concept Bookeper = std::convertible_to<FuncName, std::string> && std::convertible_to<Measure, double>
-                       && requires(T v, FuncName func_name, Measure measure) {
-                              { v.update(func_name, measure) } -> std::same_as<bool>;
-                          };
+            auto const owner = std::this_thread::get_id();
+            auto* book       = _books.load(std::memory_order_acquire);
+            while (book != nullptr && book->owner != owner)
+            {
+                book = book->next;
+            }
 
-    template <typename T, typename FuncName, typename Measure>
-        requires Bookeper<T, FuncName, Measure>
-    class FunctionProfiler
+            // A thread id is only reused once its thread has exited, so a
+            // book found here has no other writer left
+            if (book == nullptr)
+            {
+                book        = new Book{};
+                book->owner = owner;
+                book->next  = _books.load(std::memory_order_relaxed);
+                while (!_books.compare_exchange_weak(
+                    book->next, book, std::memory_order_release, std::memory_order_relaxed))
+                {
+                }
+            }
+
+            cached_id   = _id;
+            cached_book = book;
+            return *book;
+        }
+
+        static std::uint64_t next_id()
+        {
+            static std::atomic<std::uint64_t> ids{0};
+            return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        std::uint64_t _id{next_id()};
+        std::atomic<Book*> _books{nullptr};
+    };
+
+    /// @brief Fixed memory histogram of latencies (or any unsigned
+    /// values), in the log-linear layout of HdrHistogram: values below
+    /// 64 get a bucket each, and every power of two above is split in 32
+    /// buckets. Any value is then known to within 1/32 (about 3%), in 15
+    /// KiB, without allocating and whatever the range of the values.
+    class LatencyHistogram
     {
     public:
-        FunctionProfiler(std::shared_ptr<T> books, const std::source_location& sl = std::source_location::current())
-            : _unit_name{sl.function_name()}, _start{std::chrono::high_resolution_clock::now()}, _books{books}
+        void record(std::uint64_t value) noexcept
         {
+            ++_counts[bucket(value)];
+            ++_count;
+            _sum += value;
+            _min = std::min(_min, value);
+            _max = std::max(_max, value);
         }
 
-        ~FunctionProfiler()
+        void record(std::chrono::nanoseconds duration) noexcept
         {
-            using namespace std::chrono;
-            auto const now       = std::chrono::high_resolution_clock::now();
-            auto const time_diff = duration_cast<duration<double>>(now - _start);
+            record(static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0)));
+        }
 
-            // TODO : Save the info in a map or something
-            if (!_books)
+        /// @brief adds the values recorded in `other`
+        void merge(LatencyHistogram const& other) noexcept
+        {
+            for (std::size_t i = 0; i < buckets; ++i)
+            {
+                _counts[i] += other._counts[i];
+            }
+            _count += other._count;
+            _sum += other._sum;
+            _min = std::min(_min, other._min);
+            _max = std::max(_max, other._max);
+        }
+
+        void reset() noexcept
+        {
+            _counts.fill(0);
+            _count = 0;
+            _sum   = 0;
+            _min   = std::numeric_limits<std::uint64_t>::max();
+            _max   = 0;
+        }
+
+        [[nodiscard]] std::uint64_t count() const
+        {
+            return _count;
+        }
+
+        [[nodiscard]] std::uint64_t min() const
+        {
+            return _count == 0 ? 0 : _min;
+        }
+
+        [[nodiscard]] std::uint64_t max() const
+        {
+            return _max;
+        }
+
+        [[nodiscard]] double mean() const
+        {
+            return _count == 0 ? 0.0 : static_cast<double>(_sum) / static_cast<double>(_count);
+        }
+
+        /// @brief the value `percent` of the recorded values are at or
+        /// below, e.g. `percentile(99.9)`. Reported as the highest value
+        /// of its bucket, so it never understates a tail.
+        [[nodiscard]] std::uint64_t percentile(double percent) const
+        {
+            if (_count == 0)
+            {
+                return 0;
+            }
+
+            // The nearest rank: the smallest value with at least `percent`
+            // of the values at or below it
+            auto const fraction = std::clamp(percent, 0.0, 100.0) / 100.0;
+            auto const nearest  = std::ceil(fraction * static_cast<double>(_count));
+            auto const rank     = std::max<std::uint64_t>(static_cast<std::uint64_t>(nearest), 1);
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < buckets; ++i)
+            {
+                seen += _counts[i];
+                if (seen >= rank)
+                {
+                    return std::min(highest_in(i), _max);
+                }
+            }
+            return _max;
+        }
+
+        /// @brief one line with the count, p50, p99, p999 and max of
+        /// nanosecond values, in microseconds
+        void report(std::ostream& out, std::string_view name) const
+        {
+            auto const micros = [](std::uint64_t nanos) { return static_cast<double>(nanos) / 1'000.0; };
+            out << std::fixed << std::setprecision(1) << name << ": " << _count << " samples, p50 "
+                << micros(percentile(50.0)) << "us, p99 " << micros(percentile(99.0)) << "us, p999 "
+                << micros(percentile(99.9)) << "us, max " << micros(max()) << "us\n";
+            out << std::defaultfloat;
+        }
+
+    private:
+        static constexpr std::size_t linear      = 64;
+        static constexpr std::size_t half        = linear / 2;
+        static constexpr std::size_t linear_bits = 6;
+        static constexpr std::size_t buckets     = linear + ((64 - linear_bits) * half);
+
+        static constexpr std::size_t bucket(std::uint64_t value)
+        {
+            if (value < linear)
+            {
+                return static_cast<std::size_t>(value);
+            }
+
+            // Keep the 6 top bits, the first of which is always set
+            auto const shift = static_cast<std::size_t>(std::bit_width(value)) - linear_bits;
+            return linear + ((shift - 1) * half) + static_cast<std::size_t>((value >> shift) - half);
+        }
+
+        static constexpr std::uint64_t highest_in(std::size_t bucket)
+        {
+            if (bucket < linear)
+            {
+                return bucket;
+            }
+
+            auto const shift = ((bucket - linear) / half) + 1;
+            auto const top   = static_cast<std::uint64_t>(half + ((bucket - linear) % half));
+            return (top << shift) + ((std::uint64_t{1} << shift) - 1);
+        }
+
+        std::array<std::uint64_t, buckets> _counts{};
+        std::uint64_t _count{0};
+        std::uint64_t _sum{0};
+        std::uint64_t _min{std::numeric_limits<std::uint64_t>::max()};
+        std::uint64_t _max{0};
+    };
+
+#ifdef __linux__
+    /// @brief Host events `PerfCounters` can count
+    enum class PerfEvent : std::uint8_t
+    {
+        Cycles,
+        Instructions,
+        BranchMisses,
+        L1dReadMisses,
+        TaskClock
+    };
+
+    constexpr std::string_view perf_event_name(PerfEvent event)
+    {
+        switch (event)
+        {
+        case PerfEvent::Cycles:
+            return "cycles";
+        case PerfEvent::Instructions:
+            return "instructions";
+        case PerfEvent::BranchMisses:
+            return "branch-misses";
+        case PerfEvent::L1dReadMisses:
+            return "L1-dcache-load-misses";
+        case PerfEvent::TaskClock:
+            return "task-clock";
+        }
+        return "unknown";
+    }
+
+    /// The hardware events that tell dispatch costs (branch misses) apart
+    /// from memory access costs (L1 data cache misses)
+    inline constexpr std::array<PerfEvent, 4> default_perf_events{
+        PerfEvent::Cycles, PerfEvent::Instructions, PerfEvent::BranchMisses, PerfEvent::L1dReadMisses};
+
+    /// @brief Host performance counters of the calling thread, in user
+    /// space only, read through Linux `perf_event_open`.
+    ///
+    /// All the counters are opened as one group, so a single `read`
+    /// returns them all measured over the same interval. Events the host
+    /// cannot count (no PMU in a VM, `perf_event_paranoid` too high) are
+    /// left out and always read as zero, see `available`.
+    class PerfCounters
+    {
+    public:
+        static constexpr std::size_t max_events = 8;
+        using Values                            = std::array<std::uint64_t, max_events>;
+
+        explicit PerfCounters(std::span<PerfEvent const> events = default_perf_events)
+            : _events{events.begin(), events.end()}
+        {
+            if (_events.size() > max_events)
+            {
+                throw std::invalid_argument("too many perf events");
+            }
+
+            _slots.fill(unavailable);
+            for (std::size_t i = 0; i < _events.size(); ++i)
+            {
+                auto attributes = make_attributes(_events[i]);
+                auto const fd   = static_cast<int>(
+                    syscall(SYS_perf_event_open, &attributes, 0, -1, _fds.empty() ? -1 : _fds.front(), 0));
+                if (fd < 0)
+                {
+                    continue;
+                }
+                _slots[i] = _fds.size();
+                _fds.push_back(fd);
+            }
+
+            if (_fds.empty())
             {
-                std::cout << "cannot store profile as books is null\n";
                 return;
             }
+            ioctl(_fds.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(_fds.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            calibrate();
+        }
+
+        PerfCounters(PerfCounters const&)            = delete;
+        PerfCounters& operator=(PerfCounters const&) = delete;
+
+        ~PerfCounters()
+        {
+            for (auto const fd : _fds)
+            {
+                close(fd);
+            }
+        }
+
+        [[nodiscard]] std::span<PerfEvent const> events() const
+        {
+            return _events;
+        }
 
-            _books->update(_unit_name, time_diff.count());
+        /// @brief whether the `index`th event of `events()` is counted
+        [[nodiscard]] bool available(std::size_t index) const
+        {
+            return _slots[index] != unavailable;
+        }
+
+        /// @brief the current counts, in the order of `events()`
+        [[nodiscard]] Values read() const
+        {
+            Values values{};
+            if (_fds.empty())
+            {
+                return values;
+            }
+
+            // With PERF_FORMAT_GROUP the leader reads as the number of
+            // counters followed by their values, in the order they opened
+            std::array<std::uint64_t, max_events + 1> group{};
+            if (::read(_fds.front(), group.data(), sizeof(group)) <= 0)
+            {
+                return values;
+            }
+            for (std::size_t i = 0; i < _events.size(); ++i)
+            {
+                values[i] = available(i) ? group[1 + _slots[i]] : 0;
+            }
+            return values;
+        }
+
+        /// @brief what two back to back `read`s count, the cost of reading
+        /// the counters to subtract from measurements of short intervals
+        [[nodiscard]] Values const& overhead() const
+        {
+            return _overhead;
+        }
+
+    private:
+        static constexpr std::size_t unavailable = max_events;
+
+        static perf_event_attr make_attributes(PerfEvent event)
+        {
+            perf_event_attr attributes{};
+            attributes.size           = sizeof(attributes);
+            attributes.type           = PERF_TYPE_HARDWARE;
+            attributes.read_format    = PERF_FORMAT_GROUP;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv     = 1;
+            attributes.disabled       = 1;
+
+            switch (event)
+            {
+            case PerfEvent::Cycles:
+                attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfEvent::Instructions:
+                attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfEvent::BranchMisses:
+                attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case PerfEvent::L1dReadMisses:
+                attributes.type   = PERF_TYPE_HW_CACHE;
+                attributes.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case PerfEvent::TaskClock:
+                attributes.type   = PERF_TYPE_SOFTWARE;
+                attributes.config = PERF_COUNT_SW_TASK_CLOCK;
+                break;
+            }
+            return attributes;
+        }
+
+        /// the smallest count between two reads, out of a few tries
+        void calibrate()
+        {
+            _overhead.fill(std::numeric_limits<std::uint64_t>::max());
+            for (int attempt = 0; attempt < 64; ++attempt)
+            {
+                auto const first  = read();
+                auto const second = read();
+                for (std::size_t i = 0; i < _events.size(); ++i)
+                {
+                    _overhead[i] = std::min(_overhead[i], second[i] - first[i]);
+                }
+            }
+        }
+
+        std::vector<PerfEvent> _events;
+        std::vector<int> _fds;
+
+        /// position of each event's counter in a group read
+        std::array<std::size_t, max_events> _slots{};
+        Values _overhead{};
+    };
+
+    struct PerfOpcodeStats
+    {
+        std::uint64_t count{0};
+
+        /// counts of each `PerfCounters::events()`, read overhead removed
+        PerfCounters::Values totals{};
+    };
+
+    /// @brief Host performance counters attributed to each of the 256
+    /// opcodes, by reading the counters before and after every dispatch.
+    ///
+    /// Every read is a system call, so a run gets a lot slower with this
+    /// attached: compare opcodes with each other, and time whole runs
+    /// with `PerfCounters` alone.
+    class PerfOpcodeCounters
+    {
+    public:
+        explicit PerfOpcodeCounters(std::span<PerfEvent const> events = default_perf_events) : _counters{events} {}
+
+        [[nodiscard]] PerfCounters::Values start() const
+        {
+            return _counters.read();
+        }
+
+        /// @brief adds what was counted since `start` to `opcode`
+        void record(std::uint8_t opcode, PerfCounters::Values const& start)
+        {
+            auto const end      = _counters.read();
+            auto const overhead = _counters.overhead();
+            auto& stats         = _stats[opcode];
+            ++stats.count;
+            for (std::size_t i = 0; i < _counters.events().size(); ++i)
+            {
+                auto const counted = end[i] - start[i];
+                stats.totals[i] += counted > overhead[i] ? counted - overhead[i] : 0;
+            }
+        }
+
+        [[nodiscard]] PerfCounters const& counters() const
+        {
+            return _counters;
+        }
+
+        [[nodiscard]] PerfOpcodeStats const& operator[](std::uint8_t opcode) const
+        {
+            return _stats[opcode];
+        }
+
+        [[nodiscard]] static constexpr std::size_t size()
+        {
+            return 256;
+        }
+
+    private:
+        PerfCounters _counters;
+        std::array<PerfOpcodeStats, 256> _stats{};
+    };
+#endif // __linux__
+
+    struct TimelineEvent
+    {
+        std::string_view name;
+        std::string_view category;
+        std::uint32_t thread;
+
+        /// microseconds since the timeline was created
+        std::int64_t start;
+        std::int64_t duration;
+    };
+
+    /// @brief Timed spans of work from any number of threads, written out
+    /// in the Chrome trace event format so a run can be looked at on a
+    /// timeline in `chrome://tracing` or https://ui.perfetto.dev.
+    ///
+    /// Event names and categories are not copied, they must outlive the
+    /// timeline (string literals do). Recording takes a lock, so events
+    /// are meant for coarse spans such as execute slices and frames, not
+    /// for single instructions.
+    class Timeline
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        Timeline() : _origin{Clock::now()} {}
+
+        /// @brief names the calling thread in the trace
+        void name_thread(std::string name)
+        {
+            std::scoped_lock const lock{_mutex};
+            _threads[thread_index()].second = std::move(name);
+        }
+
+        /// @brief records that `name` ran on the calling thread from
+        /// `start` to `end`
+        void record(std::string_view name, std::string_view category, Clock::time_point start, Clock::time_point end)
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+
+            auto const offset   = duration_cast<microseconds>(start - _origin).count();
+            auto const duration = duration_cast<microseconds>(end - start).count();
+
+            std::scoped_lock const lock{_mutex};
+            _events.push_back(TimelineEvent{
+                .name = name, .category = category, .thread = thread_index(), .start = offset, .duration = duration});
+        }
+
+        [[nodiscard]] std::vector<TimelineEvent> events() const
+        {
+            std::scoped_lock const lock{_mutex};
+            return _events;
+        }
+
+        /// @brief writes the events as a Chrome trace event JSON document:
+        /// one complete ("X") event per span, and a metadata ("M") event
+        /// naming each thread that was named
+        void write_chrome_trace(std::ostream& out) const
+        {
+            std::scoped_lock const lock{_mutex};
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            char const* separator = "\n";
+            for (std::size_t thread = 0; thread < _threads.size(); ++thread)
+            {
+                if (_threads[thread].second.empty())
+                {
+                    continue;
+                }
+                out << separator << R"({"ph":"M","pid":1,"tid":)" << thread
+                    << R"(,"name":"thread_name","args":{"name":)";
+                write_string(out, _threads[thread].second);
+                out << "}}";
+                separator = ",\n";
+            }
+            for (auto const& event : _events)
+            {
+                out << separator << R"({"ph":"X","pid":1,"tid":)" << event.thread << R"(,"ts":)" << event.start
+                    << R"(,"dur":)" << event.duration << R"(,"name":)";
+                write_string(out, event.name);
+                out << R"(,"cat":)";
+                write_string(out, event.category);
+                out << "}";
+                separator = ",\n";
+            }
+            out << "\n]}\n";
+        }
+
+    private:
+        /// small id of the calling thread, in the order threads first
+        /// showed up. The mutex must be held.
+        std::uint32_t thread_index()
+        {
+            auto const id = std::this_thread::get_id();
+            for (std::size_t i = 0; i < _threads.size(); ++i)
+            {
+                if (_threads[i].first == id)
+                {
+                    return static_cast<std::uint32_t>(i);
+                }
+            }
+            _threads.emplace_back(id, std::string{});
+            return static_cast<std::uint32_t>(_threads.size() - 1);
+        }
+
+        /// @brief writes `text` as a JSON string. Quotes, backslashes and
+        /// control characters are escaped, other bytes (UTF-8 included)
+        /// are copied as they are.
+        static void write_string(std::ostream& out, std::string_view text)
+        {
+            constexpr std::string_view hex_digits{"0123456789abcdef"};
+
+            out << '"';
+            for (auto const c : text)
+            {
+                auto const byte = static_cast<unsigned char>(c);
+                switch (c)
+                {
+                case '"':
+                case '\\':
+                    out << '\\' << c;
+                    break;
+                case '\n':
+                    out << "\\n";
+                    break;
+                case '\r':
+                    out << "\\r";
+                    break;
+                case '\t':
+                    out << "\\t";
+                    break;
+                default:
+                    if (byte < 0x20)
+                    {
+                        out << "\\u00" << hex_digits[byte >> 4] << hex_digits[byte & 0xf];
+                    }
+                    else
+                    {
+                        out << c;
+                    }
+                }
+            }
+            out << '"';
+        }
+
+        Clock::time_point _origin;
+        mutable std::mutex _mutex;
+        std::vector<TimelineEvent> _events;
+        std::vector<std::pair<std::thread::id, std::string>> _threads;
+    };
+
+    /// @brief Records its own lifetime, or until `stop`, as an event on a
+    /// `Timeline`
+    class ScopedEvent
+    {
+    public:
+        ScopedEvent(Timeline& timeline, std::string_view name, std::string_view category)
+            : _timeline{timeline}, _name{name}, _category{category}, _start{Timeline::Clock::now()}
+        {
+        }
+
+        ScopedEvent(ScopedEvent const&)            = delete;
+        ScopedEvent& operator=(ScopedEvent const&) = delete;
+
+        ~ScopedEvent()
+        {
+            stop();
+        }
+
+        /// @brief ends the event before the end of the scope
+        void stop()
+        {
+            if (!_stopped)
+            {
+                _timeline.record(_name, _category, _start, Timeline::Clock::now());
+                _stopped = true;
+            }
         }
 
     private:
-        std::string _unit_name;
-        std::chrono::time_point<std::chrono::system_clock> _start;
-        std::shared_ptr<T> _books;
+        Timeline& _timeline;
+        std::string_view _name;
+        std::string_view _category;
+        Timeline::Clock::time_point _start;
+        bool _stopped{false};
     };
 } // namespace profiler
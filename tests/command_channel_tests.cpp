@@ -0,0 +1,112 @@
+import command_channel;
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <thread>
+
+// NOLINTNEXTLINE
+TEST(CommandChannelTests, QueueKeepsOrderAcrossWraparound)
+{
+    emulator::app::SpscQueue<std::uint32_t, 4> queue;
+    ASSERT_TRUE(queue.empty());
+
+    // Fill and drain it a few times over, so the indices wrap round the slots
+    std::uint32_t pushed = 0;
+    std::uint32_t popped = 0;
+    for (int round = 0; round < 5; ++round)
+    {
+        while (queue.try_push(pushed))
+        {
+            ++pushed;
+        }
+        ASSERT_EQ(pushed - popped, 4);
+
+        while (auto const value = queue.try_pop())
+        {
+            ASSERT_EQ(*value, popped);
+            ++popped;
+        }
+        ASSERT_TRUE(queue.empty());
+    }
+    ASSERT_EQ(popped, 20);
+}
+
+// NOLINTNEXTLINE
+TEST(CommandChannelTests, QueueLosesNothingUnderConcurrentUse)
+{
+    constexpr std::uint32_t values = 500'000;
+    emulator::app::SpscQueue<std::uint32_t, 64> queue;
+
+    // Stops early if the consumer bails out on a failed assertion
+    std::jthread producer{[&queue](std::stop_token const& stop) {
+        for (std::uint32_t value = 0; value < values && !stop.stop_requested();)
+        {
+            if (queue.try_push(value))
+            {
+                ++value;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }};
+
+    std::uint32_t expected = 0;
+    while (expected < values)
+    {
+        if (auto const value = queue.try_pop())
+        {
+            ASSERT_EQ(*value, expected);
+            ++expected;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+    ASSERT_TRUE(queue.empty());
+}
+
+// NOLINTNEXTLINE
+TEST(CommandChannelTests, WaitWakesUpOnSend)
+{
+    emulator::app::CommandChannel channel;
+    std::atomic<bool> woken{false};
+    std::optional<emulator::app::Command> received;
+
+    std::jthread consumer{[&] {
+        channel.wait();
+        received = channel.poll();
+        woken.store(true, std::memory_order_release);
+    }};
+
+    // Give the consumer time to park, though the test holds either way
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    ASSERT_FALSE(woken.load(std::memory_order_acquire));
+
+    ASSERT_TRUE(channel.send(emulator::app::Command::Step));
+    consumer.join();
+    ASSERT_TRUE(woken.load(std::memory_order_acquire));
+    ASSERT_EQ(received, emulator::app::Command::Step);
+    ASSERT_FALSE(channel.poll().has_value());
+}
+
+// NOLINTNEXTLINE
+TEST(CommandChannelTests, WaitReturnsAtOnceWithCommandsQueued)
+{
+    emulator::app::CommandChannel channel;
+    ASSERT_TRUE(channel.send(emulator::app::Command::Pause));
+    ASSERT_TRUE(channel.send(emulator::app::Command::Continue));
+
+    channel.wait();
+    ASSERT_EQ(channel.poll(), emulator::app::Command::Pause);
+    ASSERT_EQ(channel.poll(), emulator::app::Command::Continue);
+    ASSERT_FALSE(channel.poll().has_value());
+}
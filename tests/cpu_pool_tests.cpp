@@ -0,0 +1,108 @@
+/*
+These tests check the huge page backed arena and the cpu
+pool built on top of it.
+
+Cpus handed out by the pool must always look like a
+freshly constructed cpu, even when they are reused.
+*/
+
+import emulator;
+
+#include "common.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(CpuPoolTests, ArenaAllocationsAreAligned)
+{
+    emulator::HugePageArena arena{1};
+    ASSERT_EQ(arena.capacity(), emulator::huge_page_size);
+
+    auto* const first  = arena.allocate(3);
+    auto* const second = arena.allocate(8);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(second) % emulator::cache_line_size, std::uintptr_t{0});
+    ASSERT_EQ(static_cast<std::uint8_t*>(second)[0], 0x00);
+
+    // Running out of space is not an error, the caller maps another arena
+    ASSERT_EQ(arena.allocate(emulator::huge_page_size), nullptr);
+}
+
+// NOLINTNEXTLINE
+TEST(CpuPoolTests, ArenaStartsOnAHugePage)
+{
+    // Reserved or transparent, the arena only gets huge pages if it is aligned to them
+    emulator::HugePageArena arena{3 * emulator::huge_page_size};
+    auto* const first = static_cast<std::uint8_t*>(arena.allocate(1, 1));
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(first) % emulator::huge_page_size, std::uintptr_t{0});
+
+    // Populated and zeroed to the very last byte
+    auto* const last = static_cast<std::uint8_t*>(arena.allocate(arena.capacity() - 1, 1));
+    ASSERT_EQ(last[arena.capacity() - 2], 0x00);
+    last[arena.capacity() - 2] = 0xff;
+}
+
+// NOLINTNEXTLINE
+TEST(CpuPoolTests, AcquiredCpuIsPoweredOn)
+{
+    emulator::CpuPool pool{4};
+    auto cpu = pool.acquire();
+
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(cpu.get()) % emulator::cache_line_size, std::uintptr_t{0});
+    ASSERT_EQ(cpu->reg.sp, 0xff);
+    ASSERT_EQ(cpu->reg.pc, 0x00);
+    ASSERT_EQ(cpu->flags, make_flags(0b0000'0000));
+    ASSERT_EQ(cpu->mem[0x0000], 0x00);
+    ASSERT_EQ(cpu->mem[0xffff], 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(CpuPoolTests, ReleasedCpuIsResetOnReuse)
+{
+    emulator::CpuPool pool{1};
+    emulator::Cpu* first_address = nullptr;
+    {
+        auto cpu         = pool.acquire();
+        first_address    = cpu.get();
+        cpu->clock_speed = 0;
+
+        // LDA #$aa, STA $0200, SEC
+        constexpr std::array<std::uint8_t, 6> program{0xa9, 0xaa, 0x8d, 0x00, 0x02, 0x38};
+        emulator::execute(*cpu, program);
+        ASSERT_EQ(cpu->mem[0x0200], 0xaa);
+    }
+
+    auto cpu = pool.acquire();
+    ASSERT_EQ(cpu.get(), first_address);
+    ASSERT_EQ(cpu->reg.a, 0x00);
+    ASSERT_EQ(cpu->reg.pc, 0x00);
+    ASSERT_EQ(cpu->flags, make_flags(0b0000'0000));
+    ASSERT_EQ(cpu->mem[0x0200], 0x00);
+    ASSERT_EQ(cpu->clock_speed, emulator::Cpu{}.clock_speed);
+}
+
+// NOLINTNEXTLINE
+TEST(CpuPoolTests, PoolGrowsByWholeArenas)
+{
+    emulator::CpuPool pool{2};
+    std::vector<emulator::CpuPool::Handle> cpus;
+    for (int i = 0; i < 64; ++i)
+    {
+        cpus.push_back(pool.acquire());
+        cpus.back()->mem[0x0000] = static_cast<std::uint8_t>(i);
+    }
+
+    // Every cpu has its own memory
+    for (std::size_t i = 0; i < cpus.size(); ++i)
+    {
+        ASSERT_EQ(cpus[i]->mem[0x0000], static_cast<std::uint8_t>(i));
+    }
+
+    auto const capacity = pool.capacity();
+    cpus.clear();
+    ASSERT_EQ(pool.available(), capacity);
+}
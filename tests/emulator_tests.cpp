@@ -4,6 +4,9 @@ import emulator;
 
 #include <gtest/gtest.h>
 
+#include <limits>
+#include <stdexcept>
+
 
 // NOLINTNEXTLINE
 TEST(EmulatorTests, EmulateInxNoFlag)
@@ -164,3 +167,199 @@ TEST(EmulatorTests, EmulateCpxSetCarry)
         ASSERT_EQ(cpu.flags.c, 0);
     }
 }
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, RunStopsOnBudgetAndResumes)
+{
+    // LDX #$01, INX, INX, INX
+    std::vector<std::uint8_t> program{0xa2, 0x01, 0xe8, 0xe8, 0xe8};
+
+    emulator::Cpu cpu;
+    // A budget of one cycle runs exactly one instruction
+    auto const first = emulator::run(cpu, {program.data(), program.size()}, 1);
+    ASSERT_EQ(first.reason, emulator::StopReason::Budget);
+    ASSERT_EQ(cpu.reg.x, 0x01);
+    ASSERT_EQ(cpu.reg.pc, 0x02);
+
+    auto const second = emulator::run(cpu, {program.data(), program.size()}, 100);
+    ASSERT_EQ(second.reason, emulator::StopReason::EndOfProgram);
+    ASSERT_EQ(cpu.reg.x, 0x04);
+    ASSERT_EQ(cpu.reg.pc, 0x05);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, RunStopsOnHalt)
+{
+    // LDX #$01, BRK
+    std::vector<std::uint8_t> program{0xa2, 0x01, 0x00};
+
+    emulator::Cpu cpu;
+    auto const result = emulator::run(cpu, {program.data(), program.size()}, 100);
+    ASSERT_EQ(result.reason, emulator::StopReason::Halted);
+    ASSERT_EQ(cpu.reg.x, 0x01);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, StateHashFollowsFinalState)
+{
+    // LDX #$05, STX $10
+    std::vector<std::uint8_t> program{0xa2, 0x05, 0x86, 0x10};
+    // LDX #$06, STX $10
+    std::vector<std::uint8_t> other{0xa2, 0x06, 0x86, 0x10};
+
+    emulator::Cpu first;
+    first.clock_speed = 0;
+    emulator::run(first, program, 100);
+
+    emulator::Cpu second;
+    second.clock_speed = 0;
+    emulator::run(second, program, 100);
+
+    emulator::Cpu third;
+    third.clock_speed = 0;
+    emulator::run(third, other, 100);
+
+    ASSERT_EQ(emulator::state_hash(first), emulator::state_hash(second));
+    ASSERT_NE(emulator::state_hash(first), emulator::state_hash(third));
+
+    // Bringing the state in line makes the hashes agree
+    third.mem[0x10] = 0x05;
+    third.reg.x     = 0x05;
+    ASSERT_EQ(emulator::state_hash(first), emulator::state_hash(third));
+    third.mem[0x11] = 0x01;
+    ASSERT_NE(emulator::state_hash(first), emulator::state_hash(third));
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, StepsYieldEveryInstruction)
+{
+    // LDX #$01, INX, INX, BRK
+    std::vector<std::uint8_t> program{0xa2, 0x01, 0xe8, 0xe8, 0x00};
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+
+    std::vector<std::uint8_t> xs;
+    std::vector<emulator::StopReason> reasons;
+    for (auto const& step : emulator::steps(cpu, program))
+    {
+        xs.push_back(cpu.reg.x);
+        reasons.push_back(step.reason);
+    }
+
+    ASSERT_EQ(xs, (std::vector<std::uint8_t>{0x01, 0x02, 0x03, 0x03}));
+    ASSERT_EQ(reasons.back(), emulator::StopReason::Halted);
+    ASSERT_EQ(reasons.front(), emulator::StopReason::Budget);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, SlicesResumeWhereTheyLeftOff)
+{
+    // INX, CPX #$00, BNE -3, i.e. 256 iterations of 4 cycles
+    std::vector<std::uint8_t> program{0xe8, 0xe0, 0x00, 0xd0, 0xfb};
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+
+    std::size_t slices = 0;
+    std::size_t cycles = 0;
+    for (auto const& slice : emulator::slices(cpu, program, 100))
+    {
+        ++slices;
+        cycles += slice.cycles;
+        if (slice.reason == emulator::StopReason::Budget)
+        {
+            ASSERT_GE(slice.budget_used, std::size_t{100});
+        }
+    }
+
+    emulator::Cpu reference;
+    reference.clock_speed = 0;
+    auto const expected = emulator::execute(reference, program);
+
+    ASSERT_GT(slices, std::size_t{1});
+    ASSERT_EQ(cycles, expected);
+    ASSERT_EQ(cpu.reg.x, reference.reg.x);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, SlicesOfNoCyclesStillGetThrough)
+{
+    // LDX #$03, DEX, BNE -3
+    std::vector<std::uint8_t> program{0xa2, 0x03, 0xca, 0xd0, 0xfd};
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+
+    // Taken as single steps, rather than yielding empty slices forever
+    std::size_t slices = 0;
+    for (auto const& slice : emulator::slices(cpu, program, 0))
+    {
+        ASSERT_LE(++slices, std::size_t{100});
+        if (slice.reason == emulator::StopReason::Budget)
+        {
+            ASSERT_GT(slice.budget_used, std::size_t{0});
+        }
+    }
+    ASSERT_EQ(cpu.reg.x, 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, FramesNeedAPositiveRate)
+{
+    std::vector<std::uint8_t> program{0xea};
+    emulator::Cpu cpu;
+
+    ASSERT_THROW(emulator::frames(cpu, program, 0.0), std::invalid_argument);
+    ASSERT_THROW(emulator::frames(cpu, program, -60.0), std::invalid_argument);
+    ASSERT_THROW(emulator::frames(cpu, program, std::numeric_limits<double>::quiet_NaN()), std::invalid_argument);
+    ASSERT_NO_THROW(emulator::frames(cpu, program, 60.0));
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, ThrottledRunsRecordTheirPacing)
+{
+    // INX, CPX #$00, BNE -3, at 1 MHz so a cycle is a microsecond
+    std::vector<std::uint8_t> program{0xe8, 0xe0, 0x00, 0xd0, 0xfb};
+
+    emulator::Cpu cpu;
+    cpu.clock_speed   = 1;
+    auto const result = emulator::run(cpu, program, 100'000);
+
+    auto const& pacing = cpu.pacing;
+    ASSERT_EQ(pacing.cycles, result.cycles);
+    ASSERT_EQ(pacing.emulated_time, std::chrono::microseconds{result.cycles});
+
+    // Sleeps never end early, so the host can only fall behind
+    ASSERT_GE(pacing.actual_sleep, pacing.requested_sleep);
+    ASSERT_GE(pacing.host_time, pacing.emulated_time);
+    ASSERT_EQ(pacing.drift(), pacing.overshoot - pacing.undershoot);
+    ASSERT_GT(pacing.effective_mhz(), 0.0);
+
+    // A reset cpu starts its pacing stats over
+    cpu.reset();
+    ASSERT_EQ(cpu.pacing.cycles, 0);
+    ASSERT_EQ(cpu.pacing.host_time, std::chrono::nanoseconds{0});
+
+    emulator::Cpu unthrottled;
+    unthrottled.clock_speed = 0;
+    emulator::run(unthrottled, program, 100'000);
+    ASSERT_EQ(unthrottled.pacing.cycles, 0);
+}
+
+// NOLINTNEXTLINE
+TEST(EmulatorTests, OpcodeTableNamesEveryDocumentedOpcode)
+{
+    ASSERT_EQ(emulator::opcode_name(0xa9), "LDA #");
+    ASSERT_EQ(emulator::opcode_name(0xbd), "LDA abs,X");
+    ASSERT_EQ(emulator::opcode_name(0xb1), "LDA (zp),Y");
+    ASSERT_EQ(emulator::opcode_name(0xe8), "INX");
+    ASSERT_EQ(emulator::opcode_name(0x0a), "ASL A");
+    ASSERT_EQ(emulator::opcode_name(0x02), "???");
+
+    auto const documented = std::ranges::count_if(
+        emulator::opcode_table, [](emulator::OpcodeInfo const& info) { return info.mnemonic != "???"; });
+    ASSERT_EQ(documented, 151);
+    ASSERT_EQ(emulator::instruction_size(emulator::opcode_table[0x6c].mode), std::size_t{3});
+    ASSERT_EQ(emulator::instruction_size(emulator::opcode_table[0xd0].mode), std::size_t{2});
+}
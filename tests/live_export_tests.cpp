@@ -0,0 +1,164 @@
+import emulator;
+import live_export;
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    std::string export_name()
+    {
+        return "/emulator-live-tests-" + std::to_string(::getpid());
+    }
+
+    /// @brief what running the three instruction loop `program` once round costs
+    emulator::RunResult one_iteration(std::vector<std::uint8_t> const& program)
+    {
+        emulator::Cpu cpu;
+        cpu.clock_speed = 0;
+        emulator::RunResult total{.cycles = 0, .reason = emulator::StopReason::Budget};
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            auto const result = emulator::run(cpu, program, 1);
+            total.cycles += result.cycles;
+            total.budget_used += result.budget_used;
+        }
+        return total;
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(LiveExportTests, ViewSeesGuestWritesAndRegisters)
+{
+    // LDA #$2a, STA $0200, LDX #$07
+    std::vector<std::uint8_t> const program{0xa9, 0x2a, 0x8d, 0x00, 0x02, 0xa2, 0x07};
+
+    emulator::live::LiveExport live{export_name()};
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    cpu.mem         = emulator::Memory{live.memory()};
+
+    emulator::live::LiveView const view{export_name()};
+    auto snapshot = std::make_unique<emulator::live::Snapshot>();
+    ASSERT_TRUE(view.try_read(*snapshot));
+    ASSERT_EQ(snapshot->registers.cycles, 0);
+
+    // Memory is live, the registers wait for the publish
+    auto const result = emulator::run(cpu, program, 1'000);
+    ASSERT_TRUE(view.try_read(*snapshot));
+    ASSERT_EQ(snapshot->memory[0x02][0x00], 0x2a);
+    ASSERT_EQ(snapshot->registers.cycles, 0);
+
+    live.publish(cpu, result.cycles);
+    ASSERT_TRUE(view.try_read(*snapshot));
+    ASSERT_EQ(snapshot->registers.a, 0x2a);
+    ASSERT_EQ(snapshot->registers.x, 0x07);
+    ASSERT_EQ(snapshot->registers.pc, program.size());
+    ASSERT_EQ(snapshot->registers.cycles, result.cycles);
+    ASSERT_EQ(view.sequence(), snapshot->sequence);
+}
+
+// NOLINTNEXTLINE
+TEST(LiveExportTests, RegistersAreNeverTorn)
+{
+    // INX, TXA, JMP $0000: A and X always match between loop iterations
+    std::vector<std::uint8_t> const program{0xe8, 0x8a, 0x4c, 0x00, 0x00};
+
+    auto const iteration = one_iteration(program);
+
+    emulator::live::LiveExport live{export_name()};
+    emulator::live::LiveView const view{export_name()};
+
+    std::jthread emulation{[&](std::stop_token const& stop)
+        {
+            emulator::Cpu cpu;
+            cpu.clock_speed = 0;
+            cpu.mem         = emulator::Memory{live.memory()};
+            while (!stop.stop_requested())
+            {
+                // Whole loop iterations only, one instruction at a time
+                std::size_t cycles = 0;
+                for (std::size_t i = 0; i < 3 * 17; ++i)
+                {
+                    cycles += emulator::run(cpu, program, 1).cycles;
+                }
+                live.publish(cpu, cycles);
+                std::this_thread::yield();
+            }
+        }};
+
+    // Only start reading once the emulation is going
+    while (view.sequence() == 0)
+    {
+        std::this_thread::yield();
+    }
+
+    auto snapshot = std::make_unique<emulator::live::Snapshot>();
+    std::uint32_t last_sequence = 0;
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        view.read(*snapshot);
+        ASSERT_EQ(snapshot->sequence % 2, 0);
+        ASSERT_GE(snapshot->sequence, last_sequence);
+        ASSERT_EQ(snapshot->registers.a, snapshot->registers.x);
+        ASSERT_EQ(snapshot->registers.cycles % (iteration.cycles * 17), 0);
+        last_sequence = snapshot->sequence;
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(LiveExportTests, ReadsGetThroughBackToBackSlices)
+{
+    // INX, TXA, JMP $0000, with slices of a hundred whole iterations
+    std::vector<std::uint8_t> const program{0xe8, 0x8a, 0x4c, 0x00, 0x00};
+    auto const iteration    = one_iteration(program);
+    auto const slice_budget = iteration.budget_used * 100;
+
+    emulator::live::LiveExport live{export_name()};
+    emulator::live::LiveView const view{export_name()};
+
+    // The emulation publishes and starts the next slice straight away, it never yields
+    std::jthread emulation{[&](std::stop_token const& stop)
+        {
+            emulator::Cpu cpu;
+            cpu.clock_speed = 0;
+            cpu.mem         = emulator::Memory{live.memory()};
+            while (!stop.stop_requested())
+            {
+                auto const result = emulator::run(cpu, program, slice_budget);
+                live.publish(cpu, result.cycles);
+            }
+        }};
+
+    // Keep reading until the reads have followed a good number of slices
+    auto snapshot      = std::make_unique<emulator::live::Snapshot>();
+    auto const give_up = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    std::uint64_t last_cycles = 0;
+    for (std::size_t slices_seen = 0; slices_seen < 20;)
+    {
+        ASSERT_LT(std::chrono::steady_clock::now(), give_up) << "reads only followed " << slices_seen << " slices";
+        if (!view.try_read(*snapshot))
+        {
+            continue;
+        }
+
+        ASSERT_EQ(snapshot->registers.a, snapshot->registers.x);
+        ASSERT_EQ(snapshot->registers.cycles % (iteration.cycles * 100), 0);
+        ASSERT_GE(snapshot->registers.cycles, last_cycles);
+        if (snapshot->registers.cycles != last_cycles)
+        {
+            ++slices_seen;
+        }
+        last_cycles = snapshot->registers.cycles;
+    }
+}
@@ -0,0 +1,113 @@
+import emulator;
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+    /// @brief runs `program` on `cpu` on its own, as the reference the
+    /// lockstep lanes are checked against
+    emulator::RunResult run_scalar(emulator::Cpu& cpu, std::vector<std::uint8_t> const& program)
+    {
+        cpu.clock_speed = 0;
+        return emulator::run(cpu, program, 1'000);
+    }
+
+    template <std::size_t Lanes>
+    void expect_lanes_match_scalar(std::vector<std::uint8_t> const& program, std::array<emulator::Cpu, Lanes>& cpus)
+    {
+        emulator::Lockstep<Lanes> lockstep{std::span<emulator::Cpu const, Lanes>{cpus}};
+        auto const results = lockstep.run(program, 1'000);
+
+        for (std::size_t lane = 0; lane < Lanes; ++lane)
+        {
+            auto const expected = run_scalar(cpus[lane], program);
+            auto const reg      = lockstep.registers(lane);
+
+            EXPECT_EQ(results[lane].reason, expected.reason);
+            EXPECT_EQ(results[lane].cycles, expected.cycles);
+            EXPECT_EQ(reg.a, cpus[lane].reg.a);
+            EXPECT_EQ(reg.x, cpus[lane].reg.x);
+            EXPECT_EQ(reg.y, cpus[lane].reg.y);
+            EXPECT_EQ(reg.sp, cpus[lane].reg.sp);
+            EXPECT_EQ(reg.pc, cpus[lane].reg.pc);
+            EXPECT_EQ(lockstep.status(lane), cpus[lane].sr());
+            for (std::size_t addr = 0; addr < 0x0200; ++addr)
+            {
+                EXPECT_EQ(lockstep.memory(lane)[addr], cpus[lane].mem[addr]);
+            }
+        }
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(LockstepTests, ConvergedLanesMatchScalar)
+{
+    // Register only instructions, every lane stays on the same path:
+    // TAX, INX, TXA, EOR #$5a, ASL A, ROL A, SEC, ROR A, TAY, DEY,
+    // CPY #$10, AND #$f0, ORA #$03, LSR A, CLC, NOP, STA $20
+    std::vector<std::uint8_t> const program{0xaa, 0xe8, 0x8a, 0x49, 0x5a, 0x0a, 0x2a, 0x38, 0x6a, 0xa8, 0x88, 0xc0,
+        0x10, 0x29, 0xf0, 0x09, 0x03, 0x4a, 0x18, 0xea, 0x85, 0x20};
+
+    std::array<emulator::Cpu, 16> cpus{};
+    for (std::size_t lane = 0; lane < cpus.size(); ++lane)
+    {
+        cpus[lane].reg.a = static_cast<std::uint8_t>(lane * 17);
+    }
+
+    emulator::Lockstep<16> lockstep{std::span<emulator::Cpu const, 16>{cpus}};
+    lockstep.run(program, 1'000);
+    EXPECT_GT(lockstep.vector_steps(), std::size_t{0});
+
+    expect_lanes_match_scalar(program, cpus);
+}
+
+// NOLINTNEXTLINE
+TEST(LockstepTests, DivergedLanesMatchScalar)
+{
+    // CMP #$04, BCS +3, INX, INX, INX, TXA, STA $10, INY
+    // Lanes with A >= 4 skip the increments, the rest fall through and
+    // meet the others again at TXA
+    std::vector<std::uint8_t> const program{
+        0xc9, 0x04, 0xb0, 0x03, 0xe8, 0xe8, 0xe8, 0x8a, 0x85, 0x10, 0xc8};
+
+    std::array<emulator::Cpu, 8> cpus{};
+    for (std::size_t lane = 0; lane < cpus.size(); ++lane)
+    {
+        cpus[lane].reg.a = static_cast<std::uint8_t>(lane);
+    }
+
+    emulator::Lockstep<8> lockstep{std::span<emulator::Cpu const, 8>{cpus}};
+    lockstep.run(program, 1'000);
+    EXPECT_GT(lockstep.vector_steps(), std::size_t{0});
+    EXPECT_GT(lockstep.scalar_steps(), std::size_t{0});
+
+    expect_lanes_match_scalar(program, cpus);
+}
+
+// NOLINTNEXTLINE
+TEST(LockstepTests, LanesStopOnBudgetAndHalt)
+{
+    // LDA #$01, BRK
+    std::vector<std::uint8_t> const halting{0xa9, 0x01, 0x00};
+    // JMP $0000
+    std::vector<std::uint8_t> const looping{0x4c, 0x00, 0x00};
+
+    std::array<emulator::Cpu, 32> cpus{};
+
+    emulator::Lockstep<32> halted{std::span<emulator::Cpu const, 32>{cpus}};
+    for (auto const& result : halted.run(halting, 1'000))
+    {
+        EXPECT_EQ(result.reason, emulator::StopReason::Halted);
+    }
+    EXPECT_EQ(halted.registers(31).a, 0x01);
+
+    emulator::Lockstep<32> looped{std::span<emulator::Cpu const, 32>{cpus}};
+    for (auto const& result : looped.run(looping, 100))
+    {
+        EXPECT_EQ(result.reason, emulator::StopReason::Budget);
+    }
+}
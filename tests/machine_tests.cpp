@@ -0,0 +1,74 @@
+import emulator;
+import machine;
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    std::unique_ptr<emulator::Cpu> unthrottled_cpu()
+    {
+        auto cpu         = std::make_unique<emulator::Cpu>();
+        cpu->clock_speed = 0;
+        return cpu;
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(MachineTests, CoresTalkThroughSharedMemory)
+{
+    // LDA #$2a, STA $0300, then wait for the reply: LDA $0301, BEQ -5
+    std::vector<std::uint8_t> const main_program{0xa9, 0x2a, 0x8d, 0x00, 0x03, 0xad, 0x01, 0x03, 0xf0, 0xfb};
+
+    // LDA $0300, BEQ -5, then reply with it plus one: TAX, INX, STX $0301
+    std::vector<std::uint8_t> const coprocessor{0xad, 0x00, 0x03, 0xf0, 0xfb, 0xaa, 0xe8, 0x8e, 0x01, 0x03};
+
+    emulator::Machine machine{{{.first_page = 0x03, .pages = 1}}, 16};
+    machine.add(unthrottled_cpu(), main_program);
+    machine.add(unthrottled_cpu(), coprocessor);
+
+    auto const results = machine.run(100'000);
+    ASSERT_EQ(results[0].reason, emulator::StopReason::EndOfProgram);
+    ASSERT_EQ(results[1].reason, emulator::StopReason::EndOfProgram);
+    ASSERT_EQ(machine.cpu(0).reg.a, 0x2b);
+    ASSERT_EQ(machine.cpu(1).reg.x, 0x2b);
+    ASSERT_EQ(machine.shared(0x0300), 0x2a);
+    ASSERT_EQ(machine.shared(0x0301), 0x2b);
+}
+
+// NOLINTNEXTLINE
+TEST(MachineTests, PrivateMemoryStaysPrivate)
+{
+    // LDA #$01, STA $10, STA $0300
+    std::vector<std::uint8_t> const first{0xa9, 0x01, 0x85, 0x10, 0x8d, 0x00, 0x03};
+
+    // LDA #$02, STA $10, STA $0300
+    std::vector<std::uint8_t> const second{0xa9, 0x02, 0x85, 0x10, 0x8d, 0x00, 0x03};
+
+    emulator::Machine machine{{{.first_page = 0x03, .pages = 2}}};
+    machine.add(unthrottled_cpu(), first);
+    machine.add(unthrottled_cpu(), second);
+    machine.run(1'000);
+
+    ASSERT_EQ(machine.cpu(0).mem[0x10], 0x01);
+    ASSERT_EQ(machine.cpu(1).mem[0x10], 0x02);
+
+    // Both wrote the shared byte in the same quantum, the last core wins everywhere
+    ASSERT_EQ(machine.shared(0x0300), 0x02);
+    ASSERT_EQ(machine.cpu(0).mem[0x0300], 0x02);
+    ASSERT_EQ(machine.cpu(1).mem[0x0300], 0x02);
+    ASSERT_THROW(static_cast<void>(machine.shared(0x0500)), std::out_of_range);
+}
+
+// NOLINTNEXTLINE
+TEST(MachineTests, RejectsBadRegions)
+{
+    ASSERT_THROW(emulator::Machine({{.first_page = 0xff, .pages = 2}}), std::invalid_argument);
+    ASSERT_THROW(emulator::Machine({{.first_page = 0x02, .pages = 2}, {.first_page = 0x03, .pages = 1}}),
+        std::invalid_argument);
+    ASSERT_THROW(emulator::Machine({}, 0), std::invalid_argument);
+}
@@ -0,0 +1,421 @@
+/*
+These tests check the page table backed memory and the
+bank switching mapper built on top of it.
+
+A mapper swaps 4 KiB or 8 KiB banks of a larger store
+into a window of the address space whenever the guest
+writes the bank number to the control register.
+
+Memories built from a shared image read from the image
+and only copy the pages the guest writes to. Sparse
+memories read zero until a page is written, and take
+their pages from a shared pool.
+
+Resetting a memory only restores the pages written
+since the previous reset.
+*/
+
+import emulator;
+
+#include "common.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace
+{
+    /// @brief creates a store where every byte of bank `n` holds `n`
+    std::vector<std::uint8_t> make_store(std::size_t banks, emulator::BankSize size)
+    {
+        auto const bank_size = static_cast<std::size_t>(size);
+        std::vector<std::uint8_t> store(banks * bank_size);
+        for (std::size_t i = 0; i < store.size(); ++i)
+        {
+            store[i] = static_cast<std::uint8_t>(i / bank_size);
+        }
+        return store;
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ReadWriteWholeAddressSpace)
+{
+    emulator::Memory mem;
+    mem[0x0000] = 0x01;
+    mem[0xffff] = 0x02;
+
+    ASSERT_EQ(mem.read(0x0000), 0x01);
+    ASSERT_EQ(mem.read(0xffff), 0x02);
+
+    // Addresses wrap around the 16-bit address space
+    ASSERT_EQ(mem.read(0x10000), 0x01);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ReadOnlyPageIgnoresWrites)
+{
+    emulator::Memory mem;
+    std::array<std::uint8_t, emulator::page_size> rom{};
+    rom.fill(0xaa);
+
+    mem.map_read_only(0x80, rom.data());
+    mem[0x8010] = 0x55;
+
+    ASSERT_EQ(mem.read(0x8010), 0xaa);
+    ASSERT_EQ(rom[0x10], 0xaa);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, MapperSelectsBankZeroOnAttach)
+{
+    emulator::Memory mem;
+    auto mapper = std::make_shared<emulator::Mapper>(
+        emulator::BankConfig{.window = 0x8000, .size = emulator::BankSize::KiB8, .control = 0x4000, .writable = false},
+        make_store(4, emulator::BankSize::KiB8));
+    emulator::attach_mapper(mem, mapper);
+
+    ASSERT_EQ(mapper->bank_count(), std::size_t{4});
+    ASSERT_EQ(mapper->current_bank(), std::size_t{0});
+    ASSERT_EQ(mem.read(0x8000), 0x00);
+    ASSERT_EQ(mem.read(0x9fff), 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, MapperSwitchesOnControlWrite)
+{
+    emulator::Cpu cpu;
+    auto mapper = std::make_shared<emulator::Mapper>(
+        emulator::BankConfig{.window = 0x8000, .size = emulator::BankSize::KiB4, .control = 0x4000, .writable = false},
+        make_store(8, emulator::BankSize::KiB4));
+    emulator::attach_mapper(cpu.mem, mapper);
+
+    // LDA #$03, STA $4000, LDA $8fff
+    constexpr std::array<std::uint8_t, 8> program{0xa9, 0x03, 0x8d, 0x00, 0x40, 0xad, 0xff, 0x8f};
+    emulator::execute(cpu, program);
+
+    ASSERT_EQ(mapper->current_bank(), std::size_t{3});
+    ASSERT_EQ(cpu.reg.a, 0x03);
+
+    // The page after the window is untouched by the mapper
+    ASSERT_EQ(cpu.mem[0x9000], 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, MapperRamBanksKeepTheirContents)
+{
+    emulator::Memory mem;
+    auto mapper = std::make_shared<emulator::Mapper>(
+        emulator::BankConfig{.window = 0x6000, .size = emulator::BankSize::KiB4, .control = 0x5fff, .writable = true},
+        make_store(2, emulator::BankSize::KiB4));
+    emulator::attach_mapper(mem, mapper);
+
+    mem[0x6000] = 0x42;
+    mem[0x5fff] = 0x01;
+    ASSERT_EQ(mem.read(0x6000), 0x01);
+
+    mem[0x5fff] = 0x00;
+    ASSERT_EQ(mem.read(0x6000), 0x42);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, CopiesGetTheirOwnMapper)
+{
+    emulator::Memory mem;
+    auto mapper = std::make_shared<emulator::Mapper>(
+        emulator::BankConfig{.window = 0x6000, .size = emulator::BankSize::KiB4, .control = 0x5fff, .writable = true},
+        make_store(2, emulator::BankSize::KiB4));
+    emulator::attach_mapper(mem, mapper);
+    mem[0x6000] = 0x42;
+
+    auto copy    = mem;
+    copy[0x6000] = 0x24;
+    copy[0x5fff] = 0x01;
+
+    ASSERT_EQ(copy.read(0x6000), 0x01);
+    ASSERT_EQ(mapper->current_bank(), std::size_t{0});
+    ASSERT_EQ(mem.read(0x6000), 0x42);
+
+    copy[0x5fff] = 0x00;
+    ASSERT_EQ(copy.read(0x6000), 0x24);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, MapperRejectsMisalignedWindow)
+{
+    ASSERT_THROW(emulator::Mapper(emulator::BankConfig{.window = 0x8100,
+                                      .size                  = emulator::BankSize::KiB4,
+                                      .control               = 0x4000,
+                                      .writable              = false},
+                     make_store(2, emulator::BankSize::KiB4)),
+        std::invalid_argument);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ImageIsSharedUntilWritten)
+{
+    constexpr std::array<std::uint8_t, 4> rom{0xde, 0xad, 0xbe, 0xef};
+    auto const image = std::make_shared<emulator::Image const>(rom, 0xc000);
+
+    emulator::Memory first{image};
+    emulator::Memory second{image};
+    ASSERT_EQ(first.private_pages(), std::size_t{0});
+    ASSERT_EQ(first.read(0xc001), 0xad);
+    ASSERT_EQ(second.read(0xc003), 0xef);
+
+    first[0xc001] = 0x00;
+    first[0x0010] = 0x01;
+
+    // Only the written pages get copied, the rest of the page is kept
+    ASSERT_EQ(first.private_pages(), std::size_t{2});
+    ASSERT_EQ(first.read(0xc000), 0xde);
+    ASSERT_EQ(first.read(0xc001), 0x00);
+    ASSERT_EQ(first.read(0x0010), 0x01);
+
+    // The other memory and the image itself are unchanged
+    ASSERT_EQ(second.private_pages(), std::size_t{0});
+    ASSERT_EQ(second.read(0xc001), 0xad);
+    ASSERT_EQ(second.read(0x0010), 0x00);
+    ASSERT_EQ(image->page(0xc0)[1], 0xad);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, CpusShareImage)
+{
+    constexpr std::array<std::uint8_t, 1> rom{0x40};
+    auto const image = std::make_shared<emulator::Image const>(rom, 0x0200);
+
+    // LDA $0200, ASL A, STA $0200
+    constexpr std::array<std::uint8_t, 7> program{0xad, 0x00, 0x02, 0x0a, 0x8d, 0x00, 0x02};
+
+    std::vector<emulator::Cpu> cpus;
+    for (int i = 0; i < 4; ++i)
+    {
+        cpus.push_back(emulator::Cpu{.mem = emulator::Memory{image}});
+    }
+
+    emulator::execute(cpus[0], program);
+
+    ASSERT_EQ(cpus[0].mem[0x0200], 0x80);
+    ASSERT_EQ(cpus[0].mem.private_pages(), std::size_t{1});
+    for (std::size_t i = 1; i < cpus.size(); ++i)
+    {
+        ASSERT_EQ(cpus[i].mem[0x0200], 0x40);
+        ASSERT_EQ(cpus[i].mem.private_pages(), std::size_t{0});
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, CopyKeepsPrivatePages)
+{
+    auto const image = std::make_shared<emulator::Image const>();
+    emulator::Memory original{image};
+    original[0x0300] = 0x12;
+
+    emulator::Memory copy{original};
+    copy[0x0300] = 0x34;
+
+    ASSERT_EQ(original.read(0x0300), 0x12);
+    ASSERT_EQ(copy.read(0x0300), 0x34);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, SparseMemoryReadsZeroWithoutAllocating)
+{
+    auto const pool = std::make_shared<emulator::PagePool>();
+    emulator::Memory mem{pool};
+
+    ASSERT_EQ(mem.read(0x0000), 0x00);
+    ASSERT_EQ(mem.read(0xffff), 0x00);
+    ASSERT_EQ(mem.private_pages(), std::size_t{0});
+    ASSERT_EQ(pool->capacity(), std::size_t{0});
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, SparseMemoryBacksPagesOnWrite)
+{
+    auto const pool = std::make_shared<emulator::PagePool>(4);
+    emulator::Cpu cpu{.mem = emulator::Memory{pool}};
+
+    // LDA #$0f, PHA, STA $02ff, INC $02ff
+    constexpr std::array<std::uint8_t, 9> program{0xa9, 0x0f, 0x48, 0x8d, 0xff, 0x02, 0xee, 0xff, 0x02};
+    emulator::execute(cpu, program);
+
+    // Only the stack page and page 2 have been written to
+    ASSERT_EQ(cpu.mem.private_pages(), std::size_t{2});
+    ASSERT_EQ(cpu.mem[0x01ff], 0x0f);
+    ASSERT_EQ(cpu.mem[0x02ff], 0x10);
+    ASSERT_EQ(cpu.mem[0x02fe], 0x00);
+    ASSERT_EQ(pool->capacity(), std::size_t{4});
+    ASSERT_EQ(pool->available(), std::size_t{2});
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, SparseMemoryReturnsPagesToPool)
+{
+    auto const pool = std::make_shared<emulator::PagePool>(4);
+    {
+        emulator::Memory mem{pool};
+        mem[0x0010] = 0xff;
+        mem[0x1010] = 0xff;
+        ASSERT_EQ(pool->available(), std::size_t{2});
+    }
+    ASSERT_EQ(pool->available(), std::size_t{4});
+
+    // Reused pages come back zeroed to the next memory
+    emulator::Memory mem{pool};
+    mem[0x2000] = 0x01;
+    ASSERT_EQ(mem.read(0x2010), 0x00);
+    ASSERT_EQ(pool->capacity(), std::size_t{4});
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetOnlyTouchesDirtyPages)
+{
+    emulator::Memory mem;
+    ASSERT_EQ(mem.dirty_pages(), std::size_t{0});
+
+    mem[0x0010] = 0x01;
+    mem[0x0011] = 0x02;
+    mem[0x8000] = 0x03;
+    ASSERT_EQ(mem.dirty_pages(), std::size_t{2});
+
+    mem.reset();
+    ASSERT_EQ(mem.dirty_pages(), std::size_t{0});
+    ASSERT_EQ(mem.read(0x0010), 0x00);
+    ASSERT_EQ(mem.read(0x0011), 0x00);
+    ASSERT_EQ(mem.read(0x8000), 0x00);
+
+    // Pages are tracked again after a reset
+    mem[0x8000] = 0x04;
+    ASSERT_EQ(mem.dirty_pages(), std::size_t{1});
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetToBaseImage)
+{
+    constexpr std::array<std::uint8_t, 2> rom{0x12, 0x34};
+    emulator::Image const base{rom, 0x0400};
+
+    emulator::Memory mem;
+    mem[0x0400] = 0xff;
+    mem[0x0500] = 0xff;
+    mem.reset(base);
+
+    ASSERT_EQ(mem.read(0x0400), 0x12);
+    ASSERT_EQ(mem.read(0x0401), 0x34);
+    ASSERT_EQ(mem.read(0x0500), 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetToAnotherBaseRestoresCleanPages)
+{
+    constexpr std::array<std::uint8_t, 1> first_rom{0x12};
+    constexpr std::array<std::uint8_t, 1> second_rom{0x34};
+    emulator::Image const first{first_rom, 0x0400};
+    emulator::Image const second{second_rom, 0x0500};
+
+    emulator::Memory mem;
+    mem.reset(first);
+    ASSERT_EQ(mem.read(0x0400), 0x12);
+
+    // Page 4 is clean, but still holds the first image
+    mem.reset(second);
+    ASSERT_EQ(mem.read(0x0400), 0x00);
+    ASSERT_EQ(mem.read(0x0500), 0x34);
+
+    mem.reset();
+    ASSERT_EQ(mem.read(0x0500), 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetToANewImageAtTheSameAddress)
+{
+    constexpr std::array<std::uint8_t, 1> first_rom{0x12};
+    constexpr std::array<std::uint8_t, 1> second_rom{0x34};
+
+    // The second image is built where the first one was, like a local
+    // image in a loop
+    std::optional<emulator::Image> image;
+    image.emplace(first_rom, 0x0400);
+    auto const* const address = &*image;
+
+    emulator::Memory mem;
+    mem.reset(*image);
+    ASSERT_EQ(mem.read(0x0400), 0x12);
+
+    image.emplace(second_rom, 0x0500);
+    ASSERT_EQ(&*image, address);
+    mem.reset(*image);
+    ASSERT_EQ(mem.read(0x0400), 0x00);
+    ASSERT_EQ(mem.read(0x0500), 0x34);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetToBaseReturnsPagesToPool)
+{
+    constexpr std::array<std::uint8_t, 1> rom{0x12};
+    constexpr std::array<std::uint8_t, 1> patch{0x56};
+    auto const image = std::make_shared<emulator::Image const>(rom, 0x0300);
+    auto const pool  = std::make_shared<emulator::PagePool>(4);
+    emulator::Image const base{patch, 0x0400};
+
+    emulator::Memory mem{image, pool};
+    mem[0x0300] = 0xff;
+    mem[0x0600] = 0xff;
+    mem.reset(base);
+
+    // Only pages 3 and 4 differ from the image, page 6 goes back to the pool
+    ASSERT_EQ(mem.private_pages(), std::size_t{2});
+    ASSERT_EQ(pool->available(), std::size_t{2});
+    ASSERT_EQ(mem.read(0x0300), 0x00);
+    ASSERT_EQ(mem.read(0x0400), 0x56);
+    ASSERT_EQ(mem.read(0x0600), 0x00);
+
+    mem.reset();
+    ASSERT_EQ(mem.private_pages(), std::size_t{0});
+    ASSERT_EQ(pool->available(), std::size_t{4});
+    ASSERT_EQ(mem.read(0x0300), 0x12);
+    ASSERT_EQ(mem.read(0x0400), 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, ResetReturnsPagesToPool)
+{
+    constexpr std::array<std::uint8_t, 1> rom{0x12};
+    auto const image = std::make_shared<emulator::Image const>(rom, 0x0300);
+    auto const pool  = std::make_shared<emulator::PagePool>(4);
+
+    emulator::Memory mem{image, pool};
+    mem[0x0300] = 0xff;
+    mem[0x0400] = 0xff;
+    ASSERT_EQ(pool->available(), std::size_t{2});
+
+    mem.reset();
+    ASSERT_EQ(pool->available(), std::size_t{4});
+    ASSERT_EQ(mem.private_pages(), std::size_t{0});
+    ASSERT_EQ(mem.read(0x0300), 0x12);
+    ASSERT_EQ(mem.read(0x0400), 0x00);
+}
+
+// NOLINTNEXTLINE
+TEST(MemoryTests, CpuResetRestoresRegisters)
+{
+    emulator::Cpu cpu;
+
+    // LDX #$10, TXS, LDA #$aa, PHA, SEC
+    constexpr std::array<std::uint8_t, 7> program{0xa2, 0x10, 0x9a, 0xa9, 0xaa, 0x48, 0x38};
+    emulator::execute(cpu, program);
+    ASSERT_EQ(cpu.mem[0x0110], 0xaa);
+
+    cpu.reset();
+    ASSERT_EQ(cpu.reg.a, 0x00);
+    ASSERT_EQ(cpu.reg.x, 0x00);
+    ASSERT_EQ(cpu.reg.sp, 0xff);
+    ASSERT_EQ(cpu.reg.pc, 0x00);
+    ASSERT_EQ(cpu.flags, make_flags(0b0000'0000));
+    ASSERT_EQ(cpu.mem[0x0110], 0x00);
+    ASSERT_EQ(cpu.mem.dirty_pages(), std::size_t{0});
+}
@@ -0,0 +1,194 @@
+import emulator;
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace
+{
+    // LDA #$07, LDX #$02, then twice round STA $10,X, INC $20, DEX,
+    // BNE -7, then LDA $11, PHA, PLA
+    std::vector<std::uint8_t> const program{
+        0xa9, 0x07, 0xa2, 0x02, 0x95, 0x10, 0xe6, 0x20, 0xca, 0xd0, 0xf9, 0xa5, 0x11, 0x48, 0x68};
+
+    struct Access
+    {
+        std::uint16_t addr;
+        std::uint8_t value;
+        bool write;
+
+        bool operator==(Access const&) const = default;
+    };
+
+    struct Branch
+    {
+        std::uint16_t from;
+        std::uint16_t to;
+        bool taken;
+
+        bool operator==(Branch const&) const = default;
+    };
+
+    struct Recorder
+    {
+        std::vector<std::uint16_t> instructions;
+        std::vector<Access> accesses;
+        std::vector<Branch> branches;
+        std::size_t cycles{0};
+
+        void on_instruction(std::uint16_t pc, std::uint8_t /* opcode */, std::size_t instruction_cycles)
+        {
+            instructions.push_back(pc);
+            cycles += instruction_cycles;
+        }
+
+        void on_mem_read(std::uint16_t addr, std::uint8_t value)
+        {
+            accesses.push_back({.addr = addr, .value = value, .write = false});
+        }
+
+        void on_mem_write(std::uint16_t addr, std::uint8_t value)
+        {
+            accesses.push_back({.addr = addr, .value = value, .write = true});
+        }
+
+        void on_branch(std::uint16_t from, std::uint16_t to, bool taken)
+        {
+            branches.push_back({.from = from, .to = to, .taken = taken});
+        }
+    };
+} // namespace
+
+static_assert(emulator::Observer<emulator::NullObserver>);
+static_assert(!emulator::MemoryObserver<emulator::NullObserver>);
+static_assert(emulator::MemoryObserver<Recorder> && emulator::BranchObserver<Recorder>);
+static_assert(!emulator::MemoryObserver<emulator::Coverage> && emulator::BranchObserver<emulator::Coverage>);
+static_assert(emulator::FetchObserver<emulator::OpcodeProfiler> && !emulator::FetchObserver<Recorder>);
+static_assert(!emulator::MemoryObserver<emulator::OpcodeProfiler>);
+
+// NOLINTNEXTLINE
+TEST(ObserverTests, ReportsEveryHook)
+{
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    Recorder recorder;
+    auto const result = emulator::run(cpu, program, 1'000, recorder);
+    ASSERT_EQ(result.reason, emulator::StopReason::EndOfProgram);
+
+    std::vector<std::uint16_t> const instructions{0, 2, 4, 6, 8, 9, 4, 6, 8, 9, 11, 13, 14};
+    ASSERT_EQ(recorder.instructions, instructions);
+    ASSERT_EQ(recorder.cycles, result.budget_used);
+
+    std::vector<Access> const accesses{
+        {.addr = 0x12, .value = 0x07, .write = true},
+        {.addr = 0x20, .value = 0x00, .write = false},
+        {.addr = 0x20, .value = 0x01, .write = true},
+        {.addr = 0x11, .value = 0x07, .write = true},
+        {.addr = 0x20, .value = 0x01, .write = false},
+        {.addr = 0x20, .value = 0x02, .write = true},
+        {.addr = 0x11, .value = 0x07, .write = false},
+        {.addr = 0x01ff, .value = 0x07, .write = true},
+        {.addr = 0x01ff, .value = 0x07, .write = false},
+    };
+    ASSERT_EQ(recorder.accesses, accesses);
+
+    std::vector<Branch> const branches{{.from = 9, .to = 4, .taken = true}, {.from = 9, .to = 11, .taken = false}};
+    ASSERT_EQ(recorder.branches, branches);
+}
+
+// NOLINTNEXTLINE
+TEST(ObserverTests, NullObserverRunsLikePlainRun)
+{
+    emulator::Cpu observed;
+    observed.clock_speed = 0;
+    emulator::NullObserver observer;
+    auto const with_observer = emulator::run(observed, program, 1'000, observer);
+
+    emulator::Cpu plain;
+    plain.clock_speed = 0;
+    auto const without = emulator::run(plain, program, 1'000);
+
+    ASSERT_EQ(with_observer.budget_used, without.budget_used);
+    ASSERT_EQ(observed.reg.pc, plain.reg.pc);
+    ASSERT_EQ(observed.mem[0x20], plain.mem[0x20]);
+}
+
+// NOLINTNEXTLINE
+TEST(ObserverTests, CoverageAndWatchpoints)
+{
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    emulator::Coverage coverage;
+    emulator::run(cpu, program, 1'000, coverage);
+    ASSERT_EQ(coverage.instructions(), 9);
+    ASSERT_TRUE(coverage.executed(0x0d));
+    ASSERT_FALSE(coverage.executed(0x05));
+    ASSERT_TRUE(coverage.both_ways(0x09));
+
+    cpu.reset();
+    cpu.clock_speed = 0;
+    emulator::Watchpoints watchpoints;
+    watchpoints.watch(0x11);
+    emulator::run(cpu, program, 1'000, watchpoints);
+
+    auto const& hits = watchpoints.hits();
+    ASSERT_EQ(hits.size(), 2);
+    ASSERT_EQ(hits[0].pc, 0x04);
+    ASSERT_TRUE(hits[0].write);
+    ASSERT_EQ(hits[1].pc, 0x0b);
+    ASSERT_FALSE(hits[1].write);
+    ASSERT_EQ(hits[1].value, 0x07);
+}
+
+// NOLINTNEXTLINE
+TEST(ObserverTests, ExecutionCountsHottest)
+{
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    emulator::ExecutionCounts counts;
+    auto const result = emulator::run(cpu, program, 1'000, counts);
+    ASSERT_EQ(counts.instructions(), 13);
+    ASSERT_EQ(counts.cycles(), result.budget_used);
+
+    // The loop body ran twice, everything else once, so the hottest are
+    // the loop opcodes in opcode order (ties keep the first key seen)
+    std::array<emulator::HotCount, 3> opcodes{};
+    ASSERT_EQ(counts.hottest_opcodes(opcodes), 3);
+    ASSERT_EQ(opcodes[0].key, 0x95);
+    ASSERT_EQ(opcodes[0].count, 2);
+    ASSERT_EQ(opcodes[1].key, 0xca);
+    ASSERT_EQ(opcodes[2].key, 0xd0);
+
+    std::array<emulator::HotCount, 16> addresses{};
+    ASSERT_EQ(counts.hottest_addresses(addresses), 9);
+    ASSERT_EQ(addresses[0].key, 0x04);
+    ASSERT_EQ(addresses[0].count, 2);
+    ASSERT_EQ(addresses[4].count, 1);
+
+    counts.reset();
+    ASSERT_EQ(counts.instructions(), 0);
+    ASSERT_EQ(counts.hottest_opcodes(opcodes), 0);
+}
+
+// NOLINTNEXTLINE
+TEST(ObserverTests, OpcodeProfilerTimesEveryInstruction)
+{
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    emulator::OpcodeProfiler profiler;
+    emulator::run(cpu, program, 1'000, profiler);
+
+    // DEX ran twice, in the loop
+    ASSERT_EQ(profiler.counters()[0xca].count, 2);
+    ASSERT_EQ(profiler.counters()[0xa9].count, 1);
+    ASSERT_EQ(profiler.counters()[0xea].count, 0);
+
+    auto const report = profiler.report();
+    ASSERT_EQ(report.size(), 9);
+    ASSERT_TRUE(std::ranges::is_sorted(report, std::ranges::greater{}, &emulator::OpcodeProfile::ticks));
+}
@@ -0,0 +1,93 @@
+import emulator;
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(PcSamplerTests, SamplesEveryPeriod)
+{
+    emulator::PcSampler sampler{10};
+    sampler.advance(0x0100, 9);
+    ASSERT_EQ(sampler.total(), 0);
+
+    // Crosses one period boundary, then a long instruction crosses two
+    sampler.advance(0x0200, 1);
+    sampler.advance(0x0300, 25);
+    ASSERT_EQ(sampler.samples(0x0200), 1);
+    ASSERT_EQ(sampler.samples(0x0300), 2);
+    ASSERT_EQ(sampler.total(), 3);
+
+    // 35 cycles in, so the next sample is due after 5 more
+    sampler.advance(0x0400, 4);
+    ASSERT_EQ(sampler.samples(0x0400), 0);
+    sampler.advance(0x0400, 1);
+    ASSERT_EQ(sampler.samples(0x0400), 1);
+
+    sampler.reset();
+    ASSERT_EQ(sampler.total(), 0);
+    ASSERT_THROW(emulator::PcSampler{0}, std::invalid_argument);
+}
+
+// NOLINTNEXTLINE
+TEST(PcSamplerTests, FindsTheHotLoop)
+{
+    // LDX #$00, then 256 times round INX, CPX #$00, BNE -3, then a tail
+    std::vector<std::uint8_t> const program{0xa2, 0x00, 0xe8, 0xe0, 0x00, 0xd0, 0xfb, 0xea, 0xea};
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    emulator::PcSampler sampler{7};
+    auto const result = emulator::run(cpu, program, 1'000'000, sampler);
+    ASSERT_EQ(result.reason, emulator::StopReason::EndOfProgram);
+    ASSERT_EQ(sampler.total(), result.budget_used / 7);
+
+    auto const hottest = sampler.hottest(3);
+    ASSERT_EQ(hottest.size(), 3);
+    for (auto const& spot : hottest)
+    {
+        ASSERT_GE(spot.first, 0x02);
+        ASSERT_LE(spot.first, 0x05);
+    }
+
+    auto const ranges = sampler.hot_ranges(1);
+    ASSERT_EQ(ranges.size(), 1);
+    ASSERT_EQ(ranges[0].first, 0x02);
+    ASSERT_EQ(ranges[0].last, 0x05);
+    ASSERT_GE(ranges[0].samples, sampler.total() - 2);
+}
+
+// NOLINTNEXTLINE
+TEST(PcSamplerTests, ReportUsesSymbols)
+{
+    std::istringstream labels{"; ld65 -Ln output\n"
+                              "al 000002 .loop\n"
+                              "$0007 tail\n"};
+    auto const symbols = emulator::Symbols::parse(labels);
+    ASSERT_EQ(symbols.name(0x0002), "loop");
+    ASSERT_EQ(symbols.name(0x0005), "loop+0x3");
+    ASSERT_EQ(symbols.name(0x0008), "tail+0x1");
+    ASSERT_EQ(symbols.name(0x0001), "");
+
+    emulator::PcSampler sampler{1};
+    sampler.advance(0x0003, 1);
+    auto const report = sampler.report(5, symbols);
+    ASSERT_NE(report.find("0003"), std::string::npos);
+    ASSERT_NE(report.find("loop+0x1"), std::string::npos);
+}
+
+// NOLINTNEXTLINE
+TEST(PcSamplerTests, SymbolsRejectBadAddresses)
+{
+    std::istringstream not_hex{"C000 start\nzz00 broken\n"};
+    ASSERT_THROW(emulator::Symbols::parse(not_hex), std::invalid_argument);
+
+    std::istringstream too_wide{"al 10000 .outside\n"};
+    ASSERT_THROW(emulator::Symbols::parse(too_wide), std::invalid_argument);
+
+    std::istringstream prefixed{"0xc000 start\n"};
+    ASSERT_EQ(emulator::Symbols::parse(prefixed).name(0xc000), "start");
+}
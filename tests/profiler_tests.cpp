@@ -0,0 +1,235 @@
+import profiler;
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, TimelineRecordsScopedEvents)
+{
+    profiler::Timeline timeline;
+    timeline.name_thread("main");
+    {
+        profiler::ScopedEvent const frame{timeline, "frame", "render"};
+        profiler::ScopedEvent sleep{timeline, "pacing", "render"};
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        sleep.stop();
+    }
+    std::jthread{[&timeline] { profiler::ScopedEvent const slice{timeline, "execute", "emulation"}; }}.join();
+
+    auto const events = timeline.events();
+    ASSERT_EQ(events.size(), 3);
+    ASSERT_EQ(events[0].name, "pacing");
+    ASSERT_GE(events[0].duration, 2'000);
+    ASSERT_EQ(events[1].name, "frame");
+    ASSERT_LE(events[1].start, events[0].start);
+    ASSERT_GE(events[1].duration, events[0].duration);
+    ASSERT_EQ(events[0].thread, events[1].thread);
+    ASSERT_NE(events[2].thread, events[1].thread);
+    ASSERT_EQ(events[2].category, "emulation");
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, TimelineWritesChromeTrace)
+{
+    profiler::Timeline timeline;
+    timeline.name_thread("render \"main\"");
+    auto const start = profiler::Timeline::Clock::now();
+    timeline.record("frame", "render", start, start + std::chrono::microseconds{1500});
+
+    std::ostringstream out;
+    timeline.write_chrome_trace(out);
+    auto const json = out.str();
+    ASSERT_TRUE(json.starts_with(R"({"displayTimeUnit":"ms","traceEvents":[)"));
+    ASSERT_NE(json.find(R"({"ph":"M","pid":1,"tid":0,"name":"thread_name","args":{"name":"render \"main\""}})"),
+        std::string::npos);
+    ASSERT_NE(json.find(R"("dur":1500,"name":"frame","cat":"render"})"), std::string::npos);
+    ASSERT_TRUE(json.ends_with("]}\n"));
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, TimelineEscapesControlCharacters)
+{
+    profiler::Timeline timeline;
+    timeline.name_thread("worker\t1\n");
+    auto const start = profiler::Timeline::Clock::now();
+    timeline.record("slice\x01\x1f", "emu\\lation", start, start);
+
+    std::ostringstream out;
+    timeline.write_chrome_trace(out);
+    auto const json = out.str();
+    ASSERT_NE(json.find(R"("args":{"name":"worker\t1\n"})"), std::string::npos);
+    ASSERT_NE(json.find(R"("name":"slice\u0001\u001f","cat":"emu\\lation")"), std::string::npos);
+
+    // No raw control character makes it into the trace besides the line breaks between events
+    ASSERT_TRUE(std::ranges::none_of(json, [](char c) { return c != '\n' && static_cast<unsigned char>(c) < 0x20; }));
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, ProfileBooksMergeEveryThread)
+{
+    profiler::ProfileBooks books;
+    std::atomic<bool> done{false};
+
+    // Merged while the workers record, then again once they exited
+    std::jthread reader{[&]
+        {
+            while (!done.load())
+            {
+                ASSERT_LE(books.merged()[0xea].count, 4'000);
+            }
+        }};
+    {
+        std::vector<std::jthread> workers;
+        for (std::uint64_t worker = 0; worker < 4; ++worker)
+        {
+            workers.emplace_back(
+                [&books, worker]
+                {
+                    for (std::uint64_t i = 0; i < 1'000; ++i)
+                    {
+                        books.record(0xea, worker + 1);
+                    }
+                });
+        }
+    }
+    done.store(true);
+    reader.join();
+    books.record(0x00, 7);
+
+    ASSERT_EQ(books.threads(), 5);
+    auto const merged = books.merged();
+    ASSERT_EQ(merged[0xea].count, 4'000);
+    ASSERT_EQ(merged[0xea].total, 10'000);
+    ASSERT_EQ(merged[0xea].min, 1);
+    ASSERT_EQ(merged[0xea].max, 4);
+    ASSERT_EQ(merged[0x00].count, 1);
+    ASSERT_EQ(merged[0x01].count, 0);
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, HistogramPercentiles)
+{
+    profiler::LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentile(99.0), 0);
+
+    // Small values are exact
+    for (std::uint64_t value = 1; value <= 50; ++value)
+    {
+        histogram.record(value);
+    }
+    ASSERT_EQ(histogram.percentile(50.0), 25);
+    ASSERT_EQ(histogram.percentile(100.0), 50);
+    ASSERT_EQ(histogram.min(), 1);
+    ASSERT_DOUBLE_EQ(histogram.mean(), 25.5);
+
+    // Large ones are within 1/32, and never reported below their value
+    histogram.reset();
+    for (std::uint64_t value = 1; value <= 100'000; ++value)
+    {
+        histogram.record(value * 1'000);
+    }
+    for (auto const percent : {50.0, 99.0, 99.9})
+    {
+        auto const exact    = static_cast<std::uint64_t>(percent * 1'000) * 1'000;
+        auto const reported = histogram.percentile(percent);
+        ASSERT_GE(reported, exact);
+        ASSERT_LE(reported, exact + (exact / 32));
+    }
+    ASSERT_EQ(histogram.percentile(100.0), 100'000'000);
+    ASSERT_EQ(histogram.count(), 100'000);
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, HistogramTailAndMerge)
+{
+    // 999 fast frames and a single slow one: the mean hides it, p999 not
+    profiler::LatencyHistogram fast;
+    for (int i = 0; i < 999; ++i)
+    {
+        fast.record(std::chrono::milliseconds{16});
+    }
+    profiler::LatencyHistogram slow;
+    slow.record(std::chrono::milliseconds{250});
+    slow.record(std::chrono::nanoseconds{-5});
+
+    fast.merge(slow);
+    ASSERT_EQ(fast.count(), 1'001);
+    ASSERT_EQ(fast.min(), 0);
+    ASSERT_LE(fast.percentile(99.0), 16'500'000);
+    ASSERT_GE(fast.percentile(99.95), 250'000'000);
+    ASSERT_EQ(fast.max(), 250'000'000);
+
+    std::ostringstream out;
+    fast.report(out, "frame");
+    ASSERT_TRUE(out.str().starts_with("frame: 1001 samples, p50 16"));
+    ASSERT_TRUE(out.str().ends_with("max 250000.0us\n"));
+}
+
+#ifdef __linux__
+namespace
+{
+    /// Keeps the host busy for about `duration` of task clock
+    void spin(std::chrono::microseconds duration)
+    {
+        auto const until = std::chrono::steady_clock::now() + duration;
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, PerfCountersCountTheCallingThread)
+{
+    // Software events work without a PMU, e.g. in virtual machines
+    std::array const events{profiler::PerfEvent::TaskClock};
+    profiler::PerfCounters const counters{events};
+    if (!counters.available(0))
+    {
+        GTEST_SKIP() << "perf_event_open is not allowed here";
+    }
+
+    auto const before = counters.read();
+    spin(std::chrono::milliseconds{5});
+    auto const after = counters.read();
+
+    // Task clock counts nanoseconds
+    ASSERT_GE(after[0] - before[0], 4'000'000);
+    ASSERT_LT(counters.overhead()[0], after[0] - before[0]);
+    ASSERT_EQ(after[1], 0);
+}
+
+// NOLINTNEXTLINE
+TEST(ProfilerTests, PerfCountersPerOpcode)
+{
+    std::array const events{profiler::PerfEvent::TaskClock, profiler::PerfEvent::Cycles};
+    profiler::PerfOpcodeCounters profile{events};
+    if (!profile.counters().available(0))
+    {
+        GTEST_SKIP() << "perf_event_open is not allowed here";
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto const start = profile.start();
+        spin(std::chrono::microseconds{500});
+        profile.record(0xea, start);
+    }
+    auto const start = profile.start();
+    profile.record(0xe8, start);
+
+    ASSERT_EQ(profile[0xea].count, 3);
+    ASSERT_GE(profile[0xea].totals[0], 1'000'000);
+    ASSERT_LT(profile[0xe8].totals[0], profile[0xea].totals[0]);
+    ASSERT_EQ(profile[0x00].count, 0);
+}
+#endif // __linux__
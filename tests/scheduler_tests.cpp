@@ -0,0 +1,81 @@
+import emulator;
+import scheduler;
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(SchedulerTests, RunsThousandsOfSessions)
+{
+    // LDX #$00, INX, CPX #$c8, BNE -3, STX $10
+    std::vector<std::uint8_t> const program{0xa2, 0x00, 0xe8, 0xe0, 0xc8, 0xd0, 0xfb, 0x86, 0x10};
+
+    emulator::Scheduler scheduler{4, 64};
+    for (std::size_t i = 0; i < 2'000; ++i)
+    {
+        scheduler.add(std::make_unique<emulator::Cpu>(), program);
+    }
+    scheduler.start();
+    scheduler.wait();
+
+    emulator::Cpu reference;
+    reference.clock_speed = 0;
+    emulator::run(reference, program, 1'000'000);
+
+    for (emulator::SessionId id = 0; id < scheduler.size(); ++id)
+    {
+        auto const status = scheduler.status(id);
+        ASSERT_EQ(status.state, emulator::SessionState::Finished);
+        ASSERT_EQ(status.reason, emulator::StopReason::EndOfProgram);
+        ASSERT_GT(status.quanta, std::size_t{1});
+        ASSERT_EQ(scheduler.cpu(id).reg.x, 0xc8);
+        ASSERT_EQ(scheduler.cpu(id).mem[0x10], 0xc8);
+        ASSERT_EQ(emulator::state_hash(scheduler.cpu(id)), emulator::state_hash(reference));
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(SchedulerTests, SessionStopsAtQuota)
+{
+    // JMP $0000
+    std::vector<std::uint8_t> const looping{0x4c, 0x00, 0x00};
+
+    emulator::Scheduler scheduler{2, 100};
+    auto const id = scheduler.add(std::make_unique<emulator::Cpu>(), looping, {.quota = 1'050});
+    scheduler.start();
+    scheduler.wait();
+
+    auto const status = scheduler.status(id);
+    ASSERT_EQ(status.state, emulator::SessionState::QuotaExhausted);
+    ASSERT_FALSE(status.reason.has_value());
+    ASSERT_EQ(status.quanta, std::size_t{11});
+}
+
+// NOLINTNEXTLINE
+TEST(SchedulerTests, InteractiveSessionsRunFirst)
+{
+    // INX, CPX #$00, BNE -3, i.e. 256 iterations
+    std::vector<std::uint8_t> const program{0xe8, 0xe0, 0x00, 0xd0, 0xfb};
+
+    // A single worker and small quanta, so the order is down to priority
+    emulator::Scheduler scheduler{1, 16};
+    std::vector<emulator::SessionId> batch;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        batch.push_back(scheduler.add(std::make_unique<emulator::Cpu>(), program));
+    }
+    auto const interactive = scheduler.add(
+        std::make_unique<emulator::Cpu>(), program, {.priority = emulator::Priority::Interactive});
+
+    scheduler.start();
+    scheduler.wait();
+
+    ASSERT_EQ(scheduler.status(interactive).completion, std::size_t{0});
+    for (auto const id : batch)
+    {
+        ASSERT_EQ(scheduler.status(id).state, emulator::SessionState::Finished);
+    }
+}
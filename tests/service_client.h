@@ -0,0 +1,132 @@
+#ifndef TESTS_SERVICE_CLIENT_H
+#define TESTS_SERVICE_CLIENT_H
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// @brief Blocking stand-in for a real emulator service client, enough
+/// to drive the server from the tests. Expects the service_protocol
+/// module to be imported.
+class ServiceClient
+{
+public:
+    struct Message
+    {
+        emulator::service::Header header;
+        std::vector<std::uint8_t> payload;
+    };
+
+    explicit ServiceClient(std::filesystem::path const& path) : _fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)}
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        if (::connect(_fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "connect");
+        }
+    }
+
+    ServiceClient(ServiceClient const&)            = delete;
+    ServiceClient& operator=(ServiceClient const&) = delete;
+
+    ~ServiceClient()
+    {
+        ::close(_fd);
+    }
+
+    void send(std::vector<std::uint8_t> const& bytes)
+    {
+        std::size_t sent = 0;
+        while (sent < bytes.size())
+        {
+            auto const result = ::send(_fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (result <= 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "send");
+            }
+            sent += static_cast<std::size_t>(result);
+        }
+    }
+
+    Message receive()
+    {
+        Message message{};
+        read_exactly({reinterpret_cast<std::uint8_t*>(&message.header), sizeof(message.header)});
+        message.payload.resize(message.header.size);
+        read_exactly(message.payload);
+        return message;
+    }
+
+    std::uint32_t create(std::vector<std::uint8_t> const& program)
+    {
+        send(emulator::service::message(emulator::service::MessageType::Create, 0, program));
+        return expect(emulator::service::MessageType::Created).header.session;
+    }
+
+    emulator::service::RunReply run(std::uint32_t session, std::uint64_t max_cycles)
+    {
+        send(emulator::service::message(
+            emulator::service::MessageType::Run, session, emulator::service::RunRequest{.max_cycles = max_cycles}));
+        return ran();
+    }
+
+    emulator::service::RunReply step(std::uint32_t session)
+    {
+        send(emulator::service::message(emulator::service::MessageType::Step, session));
+        return ran();
+    }
+
+    Message request(emulator::service::MessageType type, std::uint32_t session)
+    {
+        send(emulator::service::message(type, session));
+        return receive();
+    }
+
+    Message expect(emulator::service::MessageType type)
+    {
+        auto message = receive();
+        if (message.header.type != type)
+        {
+            throw std::runtime_error("unexpected reply");
+        }
+        return message;
+    }
+
+private:
+    emulator::service::RunReply ran()
+    {
+        auto const message = expect(emulator::service::MessageType::Ran);
+        return *emulator::service::get<emulator::service::RunReply>(message.payload);
+    }
+
+    void read_exactly(std::span<std::uint8_t> out)
+    {
+        std::size_t received = 0;
+        while (received < out.size())
+        {
+            auto const result = ::recv(_fd, out.data() + received, out.size() - received, 0);
+            if (result <= 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "recv");
+            }
+            received += static_cast<std::size_t>(result);
+        }
+    }
+
+    int _fd;
+};
+
+#endif // TESTS_SERVICE_CLIENT_H
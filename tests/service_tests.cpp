@@ -0,0 +1,152 @@
+import emulator;
+import service;
+import service_protocol;
+
+#include "service_client.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    /// @brief runs a server on a fresh socket for the duration of a test
+    class ServiceTests : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            _path = std::filesystem::temp_directory_path() / ("emulator-service-" + std::to_string(::getpid()));
+            _server = std::make_unique<emulator::service::Server>(emulator::service::ServerConfig{.path = _path});
+            _thread = std::jthread{[this] { _server->run(); }};
+        }
+
+        void TearDown() override
+        {
+            _server->stop();
+            _thread.join();
+            _server.reset();
+        }
+
+        std::filesystem::path _path;
+        std::unique_ptr<emulator::service::Server> _server;
+        std::jthread _thread;
+    };
+} // namespace
+
+// NOLINTNEXTLINE
+TEST_F(ServiceTests, RunStepAndSnapshot)
+{
+    // LDX #$05, INX, STX $10, INX
+    std::vector<std::uint8_t> const program{0xa2, 0x05, 0xe8, 0x86, 0x10, 0xe8};
+
+    ServiceClient client{_path};
+    auto const session = client.create(program);
+
+    auto const stepped = client.step(session);
+    ASSERT_EQ(stepped.reason, static_cast<std::uint8_t>(emulator::StopReason::Budget));
+    ASSERT_EQ(stepped.x, 0x05);
+    ASSERT_EQ(stepped.pc, 0x02);
+
+    auto const ran = client.run(session, 1'000);
+    ASSERT_EQ(ran.reason, static_cast<std::uint8_t>(emulator::StopReason::EndOfProgram));
+    ASSERT_EQ(ran.x, 0x07);
+
+    auto const state = client.request(emulator::service::MessageType::Snapshot, session);
+    ASSERT_EQ(state.header.type, emulator::service::MessageType::State);
+    ASSERT_EQ(state.payload.size(), sizeof(emulator::service::SnapshotHeader) + emulator::address_space_size);
+
+    auto const registers = emulator::service::get<emulator::service::SnapshotHeader>(state.payload);
+    ASSERT_EQ(registers->x, 0x07);
+    ASSERT_EQ(state.payload[sizeof(emulator::service::SnapshotHeader) + 0x10], 0x06);
+}
+
+// NOLINTNEXTLINE
+TEST_F(ServiceTests, WatchStreamsDisplayDeltas)
+{
+    // LDA #$03, STA $0200, LDA #$07, STA $05ff
+    std::vector<std::uint8_t> const program{0xa9, 0x03, 0x8d, 0x00, 0x02, 0xa9, 0x07, 0x8d, 0xff, 0x05};
+
+    ServiceClient client{_path};
+    auto const session = client.create(program);
+
+    std::array<std::uint8_t, emulator::service::display_size> display{};
+    display.fill(0xff);
+
+    ASSERT_EQ(client.request(emulator::service::MessageType::Watch, session).header.type,
+        emulator::service::MessageType::Done);
+    auto const full = client.expect(emulator::service::MessageType::Display);
+    ASSERT_TRUE(emulator::service::apply_display_delta(full.payload, display));
+    ASSERT_EQ(display, (std::array<std::uint8_t, emulator::service::display_size>{}));
+
+    client.run(session, 1'000);
+    auto const delta = client.expect(emulator::service::MessageType::Display);
+    ASSERT_LT(delta.payload.size(), std::size_t{32});
+    ASSERT_TRUE(emulator::service::apply_display_delta(delta.payload, display));
+    ASSERT_EQ(display[0x000], 0x03);
+    ASSERT_EQ(display[0x3ff], 0x07);
+}
+
+// NOLINTNEXTLINE
+TEST_F(ServiceTests, ManySessionsAndUnknownSession)
+{
+    // INX, CPX #$00, BNE -3
+    std::vector<std::uint8_t> const program{0xe8, 0xe0, 0x00, 0xd0, 0xfb};
+
+    std::vector<std::unique_ptr<ServiceClient>> clients;
+    std::vector<std::uint32_t> sessions;
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+        auto& client = clients.emplace_back(std::make_unique<ServiceClient>(_path));
+        for (std::size_t j = 0; j < 128; ++j)
+        {
+            sessions.push_back(client->create(program));
+        }
+    }
+
+    for (std::size_t i = 0; i < sessions.size(); ++i)
+    {
+        auto const reply = clients[i / 128]->run(sessions[i], 100'000);
+        ASSERT_EQ(reply.reason, static_cast<std::uint8_t>(emulator::StopReason::EndOfProgram));
+        ASSERT_EQ(reply.x, 0x00);
+    }
+
+    auto const error = clients[0]->request(emulator::service::MessageType::Step, 0xdead);
+    ASSERT_EQ(error.header.type, emulator::service::MessageType::Error);
+}
+
+// NOLINTNEXTLINE
+TEST_F(ServiceTests, ClientLeavingMidSnapshotDoesNotStopTheServer)
+{
+    // LDA #$01, STA $0200
+    std::vector<std::uint8_t> const program{0xa9, 0x01, 0x8d, 0x00, 0x02};
+    {
+        ServiceClient client{_path};
+        auto const session = client.create(program);
+
+        // Far more snapshots than the socket buffers, then hang up once
+        // the first one arrived, so the rest is still queued on the server
+        std::vector<std::uint8_t> requests;
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            auto const request = emulator::service::message(emulator::service::MessageType::Snapshot, session);
+            requests.insert(requests.end(), request.begin(), request.end());
+        }
+        client.send(requests);
+        ASSERT_EQ(client.receive().header.type, emulator::service::MessageType::State);
+    }
+
+    ServiceClient client{_path};
+    auto const session = client.create(program);
+    auto const reply   = client.run(session, 1'000);
+    ASSERT_EQ(reply.reason, static_cast<std::uint8_t>(emulator::StopReason::EndOfProgram));
+    ASSERT_EQ(reply.a, 0x01);
+}
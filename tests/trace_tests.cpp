@@ -0,0 +1,123 @@
+import emulator;
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(TraceTests, RingHandsRecordsOverInOrder)
+{
+    ASSERT_THROW(emulator::TraceRing{3}, std::invalid_argument);
+
+    // Far more records than fit in the ring, so the producer has to wait
+    // for the consumer, and the spans the consumer gets wrap around
+    constexpr std::uint64_t records = 10'000;
+    emulator::TraceRing ring{8};
+    std::jthread producer{[&ring]
+        {
+            for (std::uint64_t i = 0; i < records; ++i)
+            {
+                ring.push(emulator::TraceRecord{.cycle = i});
+            }
+        }};
+
+    std::uint64_t expected = 0;
+    while (expected < records)
+    {
+        auto const span = ring.peek();
+        if (span.empty())
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        ASSERT_LE(span.size(), 8);
+        for (auto const& record : span)
+        {
+            ASSERT_EQ(record.cycle, expected++);
+        }
+        ring.consume(span.size());
+    }
+    ASSERT_TRUE(ring.peek().empty());
+}
+
+// NOLINTNEXTLINE
+TEST(TraceTests, TracedRunDecodes)
+{
+    // LDX #$03, then three times round DEX, BNE -3, then LDA $1234,X
+    std::vector<std::uint8_t> const program{0xa2, 0x03, 0xca, 0xd0, 0xfd, 0xbd, 0x34, 0x12};
+    auto const path = std::filesystem::temp_directory_path() / "65k_trace_tests.trace";
+
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+    std::size_t budget_used = 0;
+    {
+        emulator::TraceWriter trace{path, 4};
+        auto const result = emulator::run(cpu, program, 1'000, trace);
+        ASSERT_EQ(result.reason, emulator::StopReason::EndOfProgram);
+        budget_used = result.budget_used;
+    }
+
+    emulator::TraceReader reader{path};
+    std::vector<emulator::TraceRecord> records;
+    while (auto const record = reader.next())
+    {
+        records.push_back(*record);
+    }
+    std::filesystem::remove(path);
+
+    ASSERT_EQ(records.size(), 8);
+    ASSERT_EQ(records.front().pc, 0x00);
+    ASSERT_EQ(records.front().x, 0x03);
+    ASSERT_EQ(records[5].pc, 0x02);
+    ASSERT_EQ(records[5].x, 0x00);
+    ASSERT_EQ(records.back().cycle, budget_used);
+    for (std::size_t i = 1; i < records.size(); ++i)
+    {
+        ASSERT_GT(records[i].cycle, records[i - 1].cycle);
+    }
+
+    auto const disassemble = [](emulator::TraceRecord const& record)
+    { return emulator::disassemble(record.opcode, record.operands, record.pc); };
+    ASSERT_EQ(disassemble(records[0]), "LDX #$03");
+    ASSERT_EQ(disassemble(records[1]), "DEX");
+    ASSERT_EQ(disassemble(records[2]), "BNE $0002");
+    ASSERT_EQ(disassemble(records.back()), "LDA $1234,X");
+}
+
+// NOLINTNEXTLINE
+TEST(TraceTests, ReaderRejectsOtherFiles)
+{
+    ASSERT_THROW(emulator::TraceReader{"/nonexistent/65k.trace"}, std::runtime_error);
+
+    auto const path = std::filesystem::temp_directory_path() / "65k_trace_tests.bin";
+    {
+        emulator::TraceWriter trace{path};
+    }
+    std::filesystem::resize_file(path, 4);
+    ASSERT_THROW(emulator::TraceReader{path}, std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+// NOLINTNEXTLINE
+TEST(TraceTests, CloseReportsFailedWrites)
+{
+    // Every write to /dev/full fails with ENOSPC
+    if (!std::filesystem::exists("/dev/full"))
+    {
+        GTEST_SKIP() << "no /dev/full";
+    }
+
+    std::vector<std::uint8_t> const program{0xa2, 0x03, 0xca, 0xd0, 0xfd};
+    emulator::Cpu cpu;
+    cpu.clock_speed = 0;
+
+    emulator::TraceWriter trace{"/dev/full", 4};
+    emulator::run(cpu, program, 1'000, trace);
+    ASSERT_THROW(trace.close(), std::runtime_error);
+}
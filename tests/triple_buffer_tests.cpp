@@ -0,0 +1,110 @@
+import triple_buffer;
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
+
+namespace
+{
+    constexpr std::uint64_t frames = 200'000;
+
+    // Big enough that a torn copy would show as mixed words
+    struct Frame
+    {
+        std::array<std::uint64_t, 32> words{};
+
+        [[nodiscard]] std::uint64_t sequence() const
+        {
+            return words[0];
+        }
+
+        [[nodiscard]] bool consistent() const
+        {
+            return std::ranges::all_of(words, [this](auto word) { return word == words[0]; });
+        }
+    };
+
+    void publish_frames(emulator::app::TripleBuffer<Frame>& buffer)
+    {
+        for (std::uint64_t sequence = 1; sequence <= frames; ++sequence)
+        {
+            buffer.back().words.fill(sequence);
+            buffer.publish();
+        }
+    }
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TripleBufferTests, UpdateGetsTheLatestPublished)
+{
+    emulator::app::TripleBuffer<int> buffer;
+    ASSERT_FALSE(buffer.update());
+    ASSERT_EQ(buffer.front(), 0);
+
+    buffer.back() = 1;
+    buffer.publish();
+    ASSERT_TRUE(buffer.update());
+    ASSERT_EQ(buffer.front(), 1);
+
+    // Nothing new, the front stays where it was
+    ASSERT_FALSE(buffer.update());
+    ASSERT_EQ(buffer.front(), 1);
+
+    // Frames published between two updates are skipped, the last one is kept
+    for (int value = 2; value <= 4; ++value)
+    {
+        buffer.back() = value;
+        buffer.publish();
+    }
+    ASSERT_TRUE(buffer.update());
+    ASSERT_EQ(buffer.front(), 4);
+    ASSERT_FALSE(buffer.update());
+}
+
+// NOLINTNEXTLINE
+TEST(TripleBufferTests, ReaderNeverSeesHalfWrittenFrames)
+{
+    emulator::app::TripleBuffer<Frame> buffer;
+    std::jthread writer{[&buffer] { publish_frames(buffer); }};
+
+    // The last frame must come through, whatever got skipped on the way
+    std::uint64_t reads = 0;
+    while (buffer.front().sequence() != frames)
+    {
+        buffer.update();
+        ASSERT_TRUE(buffer.front().consistent()) << "torn frame after " << reads << " reads";
+        ++reads;
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(TripleBufferTests, UpdateOnlyReportsNewFrames)
+{
+    emulator::app::TripleBuffer<Frame> buffer;
+    std::jthread writer{[&buffer] { publish_frames(buffer); }};
+
+    std::uint64_t last    = 0;
+    std::uint64_t updates = 0;
+    while (last != frames)
+    {
+        if (buffer.update())
+        {
+            // Every frame is published once, so a new front is a newer frame
+            ASSERT_GT(buffer.front().sequence(), last);
+            ++updates;
+        }
+        else
+        {
+            ASSERT_EQ(buffer.front().sequence(), last);
+        }
+        last = buffer.front().sequence();
+    }
+
+    writer.join();
+    ASSERT_FALSE(buffer.update());
+    ASSERT_GE(updates, 1);
+    ASSERT_LE(updates, frames);
+}
@@ -0,0 +1,200 @@
+import work_stealing;
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, OwnerPopsNewestThievesStealOldest)
+{
+    emulator::batch::WorkStealingDeque<std::uint32_t> deque{4};
+    ASSERT_TRUE(deque.empty());
+    ASSERT_FALSE(deque.pop().has_value());
+    ASSERT_FALSE(deque.steal().has_value());
+
+    for (std::uint32_t value = 1; value <= 4; ++value)
+    {
+        ASSERT_TRUE(deque.push(value));
+    }
+    ASSERT_FALSE(deque.push(5));
+
+    ASSERT_EQ(deque.pop(), 4);
+    ASSERT_EQ(deque.steal(), 1);
+    ASSERT_EQ(deque.pop(), 3);
+    ASSERT_EQ(deque.steal(), 2);
+    ASSERT_TRUE(deque.empty());
+    ASSERT_FALSE(deque.pop().has_value());
+    ASSERT_FALSE(deque.steal().has_value());
+
+    // Taking from both ends freed the slots, round the buffer again
+    for (std::uint32_t value = 6; value <= 9; ++value)
+    {
+        ASSERT_TRUE(deque.push(value));
+    }
+    ASSERT_EQ(deque.steal(), 6);
+    ASSERT_EQ(deque.pop(), 9);
+}
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, CapacityRoundsUpToAPowerOfTwo)
+{
+    emulator::batch::WorkStealingDeque<std::uint32_t> deque{3};
+    for (std::uint32_t value = 0; value < 4; ++value)
+    {
+        ASSERT_TRUE(deque.push(value));
+    }
+    ASSERT_FALSE(deque.push(4));
+
+    // Even a zero capacity holds one item
+    emulator::batch::WorkStealingDeque<std::uint32_t> single{0};
+    ASSERT_TRUE(single.push(1));
+    ASSERT_FALSE(single.push(2));
+    ASSERT_EQ(single.pop(), 1);
+}
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, LastItemGoesToExactlyOneSide)
+{
+    constexpr std::uint32_t rounds = 100'000;
+    emulator::batch::WorkStealingDeque<std::uint32_t> deque{1};
+
+    // The thief keeps stealing until the owner is done, so every pop
+    // below races it for the only item in the deque
+    std::vector<std::uint32_t> stolen;
+    std::atomic<bool> done{false};
+    std::jthread thief{[&] {
+        while (!done.load(std::memory_order_acquire) || !deque.empty())
+        {
+            if (auto const value = deque.steal())
+            {
+                stolen.push_back(*value);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }};
+
+    std::vector<std::uint32_t> popped;
+    for (std::uint32_t value = 0; value < rounds; ++value)
+    {
+        ASSERT_TRUE(deque.push(value));
+        // Give the thief a go between the push and the pop now and then
+        if (value % 4 == 0)
+        {
+            std::this_thread::yield();
+        }
+        if (auto const item = deque.pop())
+        {
+            popped.push_back(*item);
+        }
+    }
+    done.store(true, std::memory_order_release);
+    thief.join();
+
+    std::vector<std::uint32_t> taken(rounds, 0);
+    for (auto const value : popped)
+    {
+        ++taken[value];
+    }
+    for (auto const value : stolen)
+    {
+        ++taken[value];
+    }
+    for (std::uint32_t value = 0; value < rounds; ++value)
+    {
+        ASSERT_EQ(taken[value], 1) << "item " << value;
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, ParallelForRunsEveryIndexOnce)
+{
+    constexpr std::size_t jobs    = 20'000;
+    constexpr std::size_t workers = 16;
+
+    std::vector<std::atomic<std::uint32_t>> runs(jobs);
+    std::atomic<bool> bad_worker{false};
+    emulator::batch::parallel_for(jobs,
+        workers,
+        [&](std::size_t worker, std::size_t index)
+        {
+            // Wildly uneven job lengths, so the blocks finish at different times
+            if (index % 101 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds{50});
+            }
+            else if (index % 7 == 0)
+            {
+                std::this_thread::yield();
+            }
+
+            if (worker >= workers)
+            {
+                bad_worker.store(true, std::memory_order_relaxed);
+            }
+            runs[index].fetch_add(1, std::memory_order_relaxed);
+        });
+
+    ASSERT_FALSE(bad_worker.load());
+    for (std::size_t index = 0; index < jobs; ++index)
+    {
+        ASSERT_EQ(runs[index].load(), 1) << "index " << index;
+    }
+}
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, ParallelForSharesOutASlowBlock)
+{
+    constexpr std::size_t jobs    = 64;
+    constexpr std::size_t workers = 4;
+
+    // Only the first worker's block is slow, the others must come and help
+    std::vector<std::size_t> ran_on(jobs, workers);
+    emulator::batch::parallel_for(jobs,
+        workers,
+        [&](std::size_t worker, std::size_t index)
+        {
+            if (index < jobs / workers)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds{2});
+            }
+            ran_on[index] = worker;
+        });
+
+    std::size_t helped = 0;
+    for (std::size_t index = 0; index < jobs / workers; ++index)
+    {
+        helped += ran_on[index] != 0 ? 1 : 0;
+    }
+    ASSERT_GT(helped, 0);
+}
+
+// NOLINTNEXTLINE
+TEST(WorkStealingTests, ParallelForCopesWithOddWorkerCounts)
+{
+    // No jobs at all
+    std::size_t calls = 0;
+    emulator::batch::parallel_for(0, 8, [&](std::size_t, std::size_t) { ++calls; });
+    ASSERT_EQ(calls, 0);
+
+    // No workers asked for still runs on the calling thread
+    std::vector<std::size_t> ran_on(5, 99);
+    emulator::batch::parallel_for(5, 0, [&](std::size_t worker, std::size_t index) { ran_on[index] = worker; });
+    ASSERT_EQ(ran_on, std::vector<std::size_t>(5, 0));
+
+    // More workers than jobs
+    std::vector<std::atomic<std::uint32_t>> runs(3);
+    emulator::batch::parallel_for(
+        3, 64, [&](std::size_t, std::size_t index) { runs[index].fetch_add(1, std::memory_order_relaxed); });
+    for (auto const& count : runs)
+    {
+        ASSERT_EQ(count.load(), 1);
+    }
+}
@@ -33,7 +33,7 @@ namespace
 
 export namespace emulator::ui
 {
-    auto draw_flag_table(emulator::Cpu& cpu)
+    auto draw_flag_table(emulator::Flags const& flags)
     {
         if (ImGui::BeginTable("FlagsTable", columns_count, ImGuiTableFlags_Borders | ImGuiTableFlags_Reorderable))
         {
@@ -61,13 +61,13 @@ export namespace emulator::ui
 
             // Submit table contents
             ImGui::TableNextRow();
-            draw_register_cell(cpu.flags.n, 0);
-            draw_register_cell(cpu.flags.v, 1);
-            draw_register_cell(cpu.flags.b, 3);
-            draw_register_cell(cpu.flags.d, 4);
-            draw_register_cell(cpu.flags.i, 5);
-            draw_register_cell(cpu.flags.z, 6);
-            draw_register_cell(cpu.flags.c, 7);
+            draw_register_cell(flags.n, 0);
+            draw_register_cell(flags.v, 1);
+            draw_register_cell(flags.b, 3);
+            draw_register_cell(flags.d, 4);
+            draw_register_cell(flags.i, 5);
+            draw_register_cell(flags.z, 6);
+            draw_register_cell(flags.c, 7);
             ImGui::EndTable();
         }
     }
@@ -0,0 +1,135 @@
+module;
+
+#include <imgui.h>
+
+#include <array>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+export module profiler_panel_ui;
+
+import emulator;
+
+export namespace emulator::ui
+{
+    /// @brief Performance of the emulation thread, as of its last slice
+    struct PerformanceSnapshot
+    {
+        static constexpr std::size_t hot_entries = 5;
+
+        /// emulated cycles and instructions per host second, over the
+        /// last slice
+        double emulated_mhz{0};
+        double instructions_per_second{0};
+
+        /// host time the last slice took minus the time it emulates,
+        /// late when positive
+        double pacing_error_ms{0};
+
+        /// host time behind the emulated clock since the start, ahead of
+        /// it when negative (see `emulator::PacingStats`)
+        double drift_ms{0};
+
+        std::uint64_t instructions{0};
+        std::array<HotCount, hot_entries> opcodes{};
+        std::size_t opcode_count{0};
+        std::array<HotCount, hot_entries> addresses{};
+        std::size_t address_count{0};
+    };
+} // namespace emulator::ui
+
+namespace
+{
+    /// Number of frames the history plots go back
+    constexpr std::size_t history_size = 120;
+
+    /// @brief Fixed ring of the last `history_size` values, in the layout
+    /// `ImGui::PlotLines` takes (values plus the offset of the oldest)
+    struct History
+    {
+        std::array<float, history_size> values{};
+        int next{0};
+
+        void push(float value)
+        {
+            values[static_cast<std::size_t>(next)] = value;
+            next                                   = (next + 1) % static_cast<int>(history_size);
+        }
+
+        void plot(char const* label, char const* overlay) const
+        {
+            ImGui::PlotLines(label, values.data(), static_cast<int>(values.size()), next, overlay, 0.0f, FLT_MAX,
+                ImVec2(0, 40));
+        }
+    };
+
+    History mhz_history;
+    History frame_history;
+
+    void draw_hot_table(char const* id, std::span<emulator::HotCount const> entries, std::uint64_t total, bool opcodes)
+    {
+        if (!ImGui::BeginTable(id, 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            return;
+        }
+
+        ImGui::TableSetupColumn(opcodes ? "Opcode" : "Address");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("Share");
+        ImGui::TableHeadersRow();
+        for (auto const& [key, count] : entries)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            if (opcodes)
+            {
+                // Names are string views into the opcode table, never copied
+                auto const mnemonic = emulator::opcode_table[key].mnemonic;
+                ImGui::Text("0x%02x %.*s", key, static_cast<int>(mnemonic.size()), mnemonic.data());
+            }
+            else
+            {
+                ImGui::Text("0x%04x", key);
+            }
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%llu", static_cast<unsigned long long>(count));
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%5.1f%%", 100.0 * static_cast<double>(count) / static_cast<double>(total == 0 ? 1 : total));
+        }
+        ImGui::EndTable();
+    }
+} // namespace
+
+export namespace emulator::ui
+{
+    /// @brief draws the live profiler window. Everything is formatted
+    /// straight into ImGui's own buffers, so drawing allocates nothing.
+    /// @param performance the latest snapshot from the emulation thread
+    /// @param frame_ms how long the previous render frame took
+    void draw_profiler_panel(PerformanceSnapshot const& performance, float frame_ms)
+    {
+        mhz_history.push(static_cast<float>(performance.emulated_mhz));
+        frame_history.push(frame_ms);
+
+        ImGui::Begin("Profiler");
+
+        ImGui::Text("%.3f MHz emulated, %.0f instructions/s", performance.emulated_mhz,
+            performance.instructions_per_second);
+        ImGui::Text("frame %.1f ms, pacing error %+.2f ms", static_cast<double>(frame_ms),
+            performance.pacing_error_ms);
+        ImGui::Text("drift %+.2f ms", performance.drift_ms);
+        mhz_history.plot("##mhz", "MHz");
+        frame_history.plot("##frame", "frame ms");
+
+        ImGui::SeparatorText("Hottest opcodes");
+        draw_hot_table("HotOpcodes", std::span{performance.opcodes.data(), performance.opcode_count},
+            performance.instructions, true);
+        ImGui::SeparatorText("Hottest addresses");
+        draw_hot_table("HotAddresses", std::span{performance.addresses.data(), performance.address_count},
+            performance.instructions, false);
+
+        ImGui::End();
+    }
+} // namespace emulator::ui
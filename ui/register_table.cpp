@@ -34,7 +34,7 @@ namespace
 
 export namespace emulator::ui
 {
-    auto draw_register_table(emulator::Cpu& cpu)
+    auto draw_register_table(emulator::Registers const& reg, std::uint8_t sr)
     {
         if (ImGui::BeginTable("RegistersTable", columns_count, ImGuiTableFlags_Borders | ImGuiTableFlags_Reorderable))
         {
@@ -62,13 +62,13 @@ export namespace emulator::ui
 
             // Submit table contents
             ImGui::TableNextRow();
-            draw_register_cell(static_cast<std::uint8_t>(cpu.reg.pc & 0xff), 0);
-            draw_register_cell(static_cast<std::uint8_t>((cpu.reg.pc >> 8) & 0xff), 1);
-            draw_register_cell(cpu.reg.a, 2);
-            draw_register_cell(cpu.reg.x, 3);
-            draw_register_cell(cpu.reg.y, 4);
-            draw_register_cell(cpu.sr(), 5);
-            draw_register_cell(cpu.reg.sp, 6);
+            draw_register_cell(static_cast<std::uint8_t>(reg.pc & 0xff), 0);
+            draw_register_cell(static_cast<std::uint8_t>((reg.pc >> 8) & 0xff), 1);
+            draw_register_cell(reg.a, 2);
+            draw_register_cell(reg.x, 3);
+            draw_register_cell(reg.y, 4);
+            draw_register_cell(sr, 5);
+            draw_register_cell(reg.sp, 6);
             ImGui::EndTable();
         }
     }